@@ -0,0 +1,364 @@
+//  Program:      nes-py
+//  File:         benchmark.cpp
+//  Description:  A native benchmark of the emulator that reports JSON
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "emulator.hpp"
+#include "lockstep_emulator.hpp"
+#include "rom_image.hpp"
+#include "vec_emulator.hpp"
+
+using namespace NES;
+
+/// The version of the JSON layout of the report
+static const int REPORT_VERSION = 2;
+/// The number of times each measurement is repeated (the best is reported)
+static const int REPEATS = 3;
+/// The number of snapshots and restores to time the latency of
+static const int SNAPSHOTS = 2000;
+/// The number of emulators that step with different inputs on one thread
+static const std::size_t LANES = 16;
+/// The mappers the emulator supports
+static const int SUPPORTED_MAPPERS[] = {0, 1, 2, 3};
+
+/// A clock for timing the measurements
+typedef std::chrono::steady_clock Clock;
+
+/// Return the seconds elapsed since a time point.
+///
+/// @param start the time point to return the seconds since
+/// @return the number of seconds since the time point
+///
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/// Return the best of a number of timings of a function.
+///
+/// @param function the function to time
+/// @return the fewest seconds any repeat of the function took
+///
+template <typename Function>
+static double best_time(Function function) {
+    double best = 0;
+    for (int repeat = 0; repeat < REPEATS; repeat++) {
+        const auto start = Clock::now();
+        function();
+        const double elapsed = seconds_since(start);
+        if (repeat == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+/// Return a deterministic trace of controller bytes.
+///
+/// The trace presses start for the first frames of every 200 (to leave the
+/// title screen and menus) and otherwise holds a pseudo-random set of
+/// buttons for 8 frames at a time.
+///
+/// @param frames the number of frames in the trace
+/// @param seed the seed of the pseudo-random buttons
+/// @return the controller byte of each frame
+///
+static std::vector<NES_Byte> make_trace(int frames, uint32_t seed = 1) {
+    std::vector<NES_Byte> trace(frames);
+    NES_Byte buttons = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        if (frame % 8 == 0) {
+            seed = seed * 1103515245 + 12345;
+            // never hold select (bit 2) so the games stay in one mode
+            buttons = (seed >> 16) & 0xfb;
+        }
+        trace[frame] = frame % 200 < 10 ? 0x08 : buttons;
+    }
+    return trace;
+}
+
+/// Return the name of a ROM file without its directories and extension.
+///
+/// @param path the path to the ROM file
+/// @return the name of the ROM
+///
+static std::string rom_name(const std::string& path) {
+    const std::size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const std::size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+/// Return a string escaped to print inside the quotes of a JSON string.
+///
+/// @param text the string to escape
+/// @return the string with quotes, backslashes, and control characters
+/// escaped
+///
+static std::string json_escape(const std::string& text) {
+    std::string escaped;
+    for (const char character : text) {
+        if (character == '"' || character == '\\') {
+            escaped += '\\';
+            escaped += character;
+        } else if (static_cast<unsigned char>(character) < 0x20) {
+            char code[7];
+            std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(character));
+            escaped += code;
+        } else {
+            escaped += character;
+        }
+    }
+    return escaped;
+}
+
+/// Return the iNES mapper number of a ROM image, or -1 without a header.
+///
+/// @param rom the image of the ROM to return the mapper of
+/// @return the mapper number of the ROM
+///
+static int rom_mapper(const ROMImage& rom) {
+    if (rom.size() < 16 || std::memcmp(rom.data(), "NES\x1A", 4) != 0)
+        return -1;
+    return (rom.data()[6] >> 4) | (rom.data()[7] & 0xf0);
+}
+
+/// Reset an emulator and play a trace on it.
+///
+/// @param emulator the emulator to play the trace on
+/// @param trace the controller byte of each frame
+/// @param is_rendering whether to compose the pixels of the frames
+///
+static void play(Emulator& emulator, const std::vector<NES_Byte>& trace, bool is_rendering = true) {
+    emulator.reset();
+    for (NES_Byte buttons : trace) {
+        *emulator.get_controller(0) = buttons;
+        emulator.step(is_rendering);
+    }
+}
+
+/// Write the measurements of a single emulator on a ROM as a JSON object.
+///
+/// @param rom the image of the ROM to measure
+/// @param trace the controller byte of each frame
+///
+static void measure_rom(std::shared_ptr<const ROMImage> rom, const std::vector<NES_Byte>& trace) {
+    const double frames = trace.size();
+    Emulator emulator(rom);
+    // frames per second of the full step in each render mode
+    const double scanline = best_time([&]() { play(emulator, trace); });
+    const double headless = best_time([&]() { play(emulator, trace, false); });
+    emulator.set_cpu_engine(CPU::ENGINE_BLOCK_CACHE);
+    const double blocks = best_time([&]() { play(emulator, trace, false); });
+    emulator.set_cpu_engine(CPU::ENGINE_INTERPRETER);
+    emulator.set_render_mode(PPU::RENDER_DOT);
+    const double dot = best_time([&]() { play(emulator, trace); });
+    emulator.set_render_mode(PPU::RENDER_SCANLINE);
+
+    // a redraw of the frame at the end of the trace, i.e., the PPU running
+    // a whole frame eagerly like load_state(redraw=True) does (it isn't the
+    // share of the PPU in a step, which catches the PPU up lazily)
+    play(emulator, trace);
+    std::unique_ptr<State> state(new State);
+    emulator.snapshot(state.get());
+    const double redraw = best_time([&]() {
+        emulator.restore(state.get());
+        for (std::size_t frame = 0; frame < trace.size(); frame++)
+            emulator.ppu_step();
+    });
+
+    // the latency of saving and loading a state
+    const double snapshot = best_time([&]() {
+        for (int index = 0; index < SNAPSHOTS; index++)
+            emulator.snapshot(state.get());
+    });
+    const double restore = best_time([&]() {
+        for (int index = 0; index < SNAPSHOTS; index++)
+            emulator.restore(state.get());
+    });
+
+    std::printf("      \"step_fps\": %.1f,\n", frames / scanline);
+    std::printf("      \"step_dot_fps\": %.1f,\n", frames / dot);
+    std::printf("      \"step_headless_fps\": %.1f,\n", frames / headless);
+    std::printf("      \"step_headless_blocks_fps\": %.1f,\n", frames / blocks);
+    std::printf("      \"redraw_fps\": %.1f,\n", frames / redraw);
+    std::printf("      \"snapshot_ns\": %.1f,\n", 1e9 * snapshot / SNAPSHOTS);
+    std::printf("      \"restore_ns\": %.1f,\n", 1e9 * restore / SNAPSHOTS);
+    std::printf("      \"state_bytes\": %zu,\n", sizeof(State));
+}
+
+/// Return a trace for each of the LANES emulators of a batch.
+///
+/// The traces only share the frames that press start, so the games diverge
+/// like the lanes of a data-collection job.
+///
+/// @param frames the number of frames in each trace
+/// @return the controller byte of each frame of each lane
+///
+static std::vector<std::vector<NES_Byte>> make_lane_traces(int frames) {
+    std::vector<std::vector<NES_Byte>> traces;
+    for (std::size_t lane = 0; lane < LANES; lane++)
+        traces.push_back(make_trace(frames, lane + 1));
+    return traces;
+}
+
+/// Write the frames per second of emulators on one thread, each playing
+/// its own trace, as a JSON object.
+///
+/// This is the scalar baseline for engines that step the emulators of a
+/// batch together on one core, e.g., LockstepEmulator.
+///
+/// @param rom the image of the ROM to measure
+/// @param frames the number of frames in each trace
+///
+static void measure_lanes(std::shared_ptr<const ROMImage> rom, int frames) {
+    const std::vector<std::vector<NES_Byte>> traces = make_lane_traces(frames);
+    std::vector<std::unique_ptr<Emulator>> lanes;
+    for (std::size_t lane = 0; lane < LANES; lane++)
+        lanes.emplace_back(new Emulator(rom));
+    const double elapsed = best_time([&]() {
+        for (auto& emulator : lanes)
+            emulator->reset();
+        for (int frame = 0; frame < frames; frame++) {
+            for (std::size_t lane = 0; lane < LANES; lane++) {
+                *lanes[lane]->get_controller(0) = traces[lane][frame];
+                lanes[lane]->step();
+            }
+        }
+    });
+    std::printf("      \"lanes\": {\"emulators\": %zu, \"threads\": 1, \"fps_per_core\": %.1f},\n",
+        LANES, LANES * frames / elapsed);
+}
+
+/// Write the frames per second of the lockstep engine on the traces of
+/// measure_lanes, and the fraction of the frames its lanes shared, as a
+/// JSON object.
+///
+/// @param rom the image of the ROM to measure
+/// @param frames the number of frames in each trace
+///
+static void measure_lockstep(std::shared_ptr<const ROMImage> rom, int frames) {
+    const std::vector<std::vector<NES_Byte>> traces = make_lane_traces(frames);
+    LockstepEmulator group(rom, LANES);
+    std::vector<NES_Byte> actions(LANES);
+    const double elapsed = best_time([&]() {
+        group.reset();
+        for (int frame = 0; frame < frames; frame++) {
+            for (std::size_t lane = 0; lane < LANES; lane++)
+                actions[lane] = traces[lane][frame];
+            group.step(actions.data(), 1);
+        }
+    });
+    std::printf("      \"lockstep\": {\"emulators\": %zu, \"threads\": 1, \"fps_per_core\": %.1f, \"shared\": %.3f},\n",
+        LANES, LANES * frames / elapsed, double(group.get_shared_frames()) / group.get_frames());
+}
+
+/// Write the scaling of batches of emulators on a ROM as a JSON array.
+///
+/// @param rom the image of the ROM to measure
+/// @param trace the controller byte of each frame
+/// @param max_threads the largest number of emulators (and threads)
+///
+static void measure_scaling(std::shared_ptr<const ROMImage> rom, const std::vector<NES_Byte>& trace, std::size_t max_threads) {
+    std::vector<std::size_t> counts;
+    for (std::size_t count = 1; count < max_threads; count *= 2)
+        counts.push_back(count);
+    counts.push_back(max_threads);
+    double single = 0;
+    std::printf("      \"scaling\": [\n");
+    for (std::size_t index = 0; index < counts.size(); index++) {
+        const std::size_t count = counts[index];
+        VecEmulator batch(rom, count, count);
+        std::vector<NES_Byte> actions(count);
+        const double elapsed = best_time([&]() {
+            batch.reset();
+            for (NES_Byte buttons : trace) {
+                std::fill(actions.begin(), actions.end(), buttons);
+                batch.step(actions.data(), 1);
+            }
+        });
+        const double fps = count * trace.size() / elapsed;
+        if (index == 0) single = fps;
+        std::printf("        {\"emulators\": %zu, \"threads\": %zu, \"fps\": %.1f, \"efficiency\": %.3f}%s\n",
+            count, batch.num_threads(), fps, fps / (count * single),
+            index + 1 < counts.size() ? "," : "");
+    }
+    std::printf("      ]\n");
+}
+
+/// Print the usage of the benchmark.
+///
+/// @param program the name of the benchmark program
+///
+static void usage(const char* program) {
+    std::fprintf(stderr, "usage: %s [--frames N] [--threads N] ROM...\n", program);
+}
+
+int main(int argc, char** argv) {
+    int frames = 3000;
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> paths;
+    for (int index = 1; index < argc; index++) {
+        const std::string argument = argv[index];
+        if ((argument == "--frames" || argument == "--threads") && index + 1 < argc) {
+            const int value = std::atoi(argv[++index]);
+            if (value < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+            if (argument == "--frames")
+                frames = value;
+            else
+                threads = value;
+        } else if (argument.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(argument);
+        }
+    }
+    if (paths.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const std::vector<NES_Byte> trace = make_trace(frames);
+    std::printf("{\n");
+    std::printf("  \"version\": %d,\n", REPORT_VERSION);
+    std::printf("  \"frames\": %d,\n", frames);
+    std::printf("  \"repeats\": %d,\n", REPEATS);
+    std::printf("  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+    std::printf("  \"roms\": [\n");
+    for (std::size_t index = 0; index < paths.size(); index++) {
+        std::printf("    {\n");
+        std::printf("      \"rom\": \"%s\",\n", json_escape(rom_name(paths[index])).c_str());
+        try {
+            auto rom = ROMImage::open(paths[index]);
+            const int mapper = rom_mapper(*rom);
+            std::printf("      \"mapper\": %d,\n", mapper);
+            if (std::find(std::begin(SUPPORTED_MAPPERS), std::end(SUPPORTED_MAPPERS), mapper) == std::end(SUPPORTED_MAPPERS)) {
+                std::printf("      \"error\": \"unsupported mapper\"\n");
+            } else {
+                measure_rom(rom, trace);
+                measure_lanes(rom, frames);
+                measure_lockstep(rom, frames);
+                measure_scaling(rom, trace, threads);
+            }
+        } catch (const std::exception& error) {
+            std::printf("      \"error\": \"%s\"\n", json_escape(error.what()).c_str());
+        }
+        std::printf("    }%s\n", index + 1 < paths.size() ? "," : "");
+        std::fflush(stdout);
+    }
+    std::printf("  ]\n");
+    std::printf("}\n");
+    return 0;
+}
@@ -0,0 +1,89 @@
+//  Program:      nes-py
+//  File:         block_cache.hpp
+//  Description:  A cache of decoded blocks of instructions in PRG ROM
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef BLOCK_CACHE_HPP
+#define BLOCK_CACHE_HPP
+
+#include <array>
+#include <vector>
+#include "common.hpp"
+#include "cpu.hpp"
+#include "main_bus.hpp"
+
+namespace NES {
+
+/// A cache of straight-line blocks of instructions decoded from PRG ROM.
+///
+/// A block starts at an address in $8000-$FFFF and runs until the first
+/// branch, jump, call, or return (which ends it), the end of its page, or
+/// MAX_INSTRUCTIONS. The opcodes and operands of its instructions are
+/// decoded once, so executing a block skips the fetches through the bus.
+///
+/// A block is tagged with the memory of the PRG pages it was decoded from,
+/// a bank switch maps other memory to the pages, so the blocks of the old
+/// bank miss and are decoded again. Code in RAM isn't cached and the
+/// interpreter runs it, as do BRK and unused opcodes.
+///
+class BlockCache {
+ public:
+    /// The maximal number of instructions in a block
+    static const int MAX_INSTRUCTIONS = 16;
+    /// The number of blocks in the cache (a power of 2)
+    static const int SLOTS = 2048;
+
+    /// A block of decoded instructions
+    struct Block {
+        /// the memory of the page of the entry and the page after it
+        std::array<const NES_Byte*, 2> pages;
+        /// the address of the first instruction, 0 for an empty slot
+        NES_Address address;
+        /// the number of instructions in the block, 0 to interpret the address
+        int count;
+        /// the number of CPU cycles the block takes at most
+        int max_cycles;
+        /// the decoded instructions of the block
+        CPU::DecodedInstruction instructions[MAX_INSTRUCTIONS];
+    };
+
+    /// Initialize a new empty cache.
+    BlockCache() : slots(SLOTS) { }
+
+    /// Return the block at an address, decoding it if it isn't cached.
+    ///
+    /// @param address the address of the next instruction
+    /// @param bus the bus that maps the PRG pages
+    /// @return the block at the address, nullptr if it is interpreted
+    ///
+    inline const Block* find(NES_Address address, const MainBus& bus) {
+        // code in RAM can change under a block, leave it to the interpreter
+        if (address < 0x8000)
+            return nullptr;
+        Block& block = slots[address & (SLOTS - 1)];
+        const NES_Byte* page = bus.get_read_page(address >> 8);
+        const NES_Byte* next = bus.get_read_page(((address >> 8) + 1) & 0xff);
+        if (block.address != address || block.pages[0] != page || block.pages[1] != next)
+            decode(block, address, page, next);
+        return block.count > 0 ? &block : nullptr;
+    }
+
+ private:
+    /// the blocks of the cache, indexed by the low bits of the address
+    std::vector<Block> slots;
+
+    /// Decode the block at an address into a slot.
+    ///
+    /// @param block the slot to decode the block into
+    /// @param address the address of the first instruction
+    /// @param page the memory of the page of the address
+    /// @param next the memory of the page after it
+    ///
+    static void decode(Block& block, NES_Address address, const NES_Byte* page, const NES_Byte* next);
+};
+
+}  // namespace NES
+
+#endif  // BLOCK_CACHE_HPP
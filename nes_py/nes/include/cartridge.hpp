@@ -8,19 +8,53 @@
 #ifndef CARTRIDGE_HPP
 #define CARTRIDGE_HPP
 
-#include <vector>
+#include <cstddef>
+#include <memory>
 #include <string>
 #include "common.hpp"
+#include "rom_image.hpp"
 
 namespace NES {
 
+/// A read-only view of a block of ROM in a ROM image
+class ROMBlock {
+ private:
+    /// the first byte of the block
+    const NES_Byte* bytes;
+    /// the number of bytes in the block
+    std::size_t length;
+
+ public:
+    /// Initialize an empty block.
+    ROMBlock() : bytes(nullptr), length(0) { }
+
+    /// Initialize a block of ROM.
+    ///
+    /// @param bytes the first byte of the block
+    /// @param length the number of bytes in the block
+    ///
+    ROMBlock(const NES_Byte* bytes, std::size_t length) :
+        bytes(bytes), length(length) { }
+
+    /// Return the byte at the given offset in the block.
+    inline const NES_Byte& operator[](std::size_t offset) const { return bytes[offset]; }
+
+    /// Return the first byte of the block.
+    inline const NES_Byte* data() const { return bytes; }
+
+    /// Return the number of bytes in the block.
+    inline std::size_t size() const { return length; }
+};
+
 /// A cartridge holding game ROM and a special hardware mapper emulation
 class Cartridge {
  private:
+    /// the shared image of the ROM file the PRG and CHR ROM are in
+    std::shared_ptr<const ROMImage> image;
     /// the PRG ROM
-    std::vector<NES_Byte> prg_rom;
+    ROMBlock prg_rom;
     /// the CHR ROM
-    std::vector<NES_Byte> chr_rom;
+    ROMBlock chr_rom;
     /// the name table mirroring mode
     NES_Byte name_table_mirroring;
     /// the mapper ID number
@@ -36,10 +70,13 @@ class Cartridge {
         has_extended_ram(false) { }
 
     /// Return the ROM data.
-    const inline std::vector<NES_Byte>& getROM() { return prg_rom; }
+    const inline ROMBlock& getROM() { return prg_rom; }
 
     /// Return the VROM data.
-    const inline std::vector<NES_Byte>& getVROM() { return chr_rom; }
+    const inline ROMBlock& getVROM() { return chr_rom; }
+
+    /// Return the image of the ROM file.
+    inline const std::shared_ptr<const ROMImage>& getImage() { return image; }
 
     /// Return the mapper ID number.
     inline NES_Byte getMapper() { return mapper_number; }
@@ -51,7 +88,19 @@ class Cartridge {
     inline bool hasExtendedRAM() { return has_extended_ram; }
 
     /// Load a ROM file into the cartridge and build the corresponding mapper.
+    ///
+    /// @param path the path to the ROM file, shared with other cartridges
+    /// that load the same file
+    ///
     void loadFromFile(std::string path);
+
+    /// Load a ROM image into the cartridge.
+    ///
+    /// @param rom the image of an iNES ROM file to reference
+    /// @throws std::invalid_argument if the ROM is shorter than its header
+    /// claims
+    ///
+    void loadFromImage(std::shared_ptr<const ROMImage> rom);
 };
 
 }  // namespace NES
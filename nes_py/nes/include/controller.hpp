@@ -9,6 +9,7 @@
 #define CONTROLLER_HPP
 
 #include "common.hpp"
+#include "state.hpp"
 
 namespace NES {
 
@@ -41,6 +42,18 @@ class Controller {
         if (!is_strobe) joypad_bits = joypad_buttons;
     }
 
+    /// Save the latches of the controller.
+    ///
+    /// @param state the state to save the latches to
+    ///
+    void save(ControllerState& state) const;
+
+    /// Load the latches of the controller.
+    ///
+    /// @param state the state to load the latches from
+    ///
+    void load(const ControllerState& state);
+
     /// Read the controller state.
     ///
     /// @return a state from the controller
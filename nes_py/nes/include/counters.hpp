@@ -0,0 +1,83 @@
+//  Program:      nes-py
+//  File:         counters.hpp
+//  Description:  Optional counters of the work done by the hot paths
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef COUNTERS_HPP
+#define COUNTERS_HPP
+
+#include <cstdint>
+#include "common.hpp"
+
+namespace NES {
+
+/// The regions of the CPU address space that bus accesses are counted in
+enum BusRegion {
+    /// $0000-$1FFF, the RAM and its mirrors
+    BUS_RAM = 0,
+    /// $2000-$3FFF, the PPU registers and their mirrors
+    BUS_PPU,
+    /// $4000-$5FFF, the APU and IO registers and the expansion ROM
+    BUS_IO,
+    /// $6000-$7FFF, the extended RAM
+    BUS_EXTENDED_RAM,
+    /// $8000-$FFFF, the PRG ROM and the mapper registers
+    BUS_PRG,
+    /// the number of regions
+    BUS_REGIONS,
+};
+
+/// Return the region of the CPU address space an address is in.
+///
+/// @param address the 16-bit address to return the region of
+/// @return the region of the address
+///
+inline BusRegion bus_region(NES_Address address) {
+    return address >= 0x8000 ? BUS_PRG : static_cast<BusRegion>(address >> 13);
+}
+
+/// Counters of the work done by the hot paths of an emulator.
+///
+/// The counters are only incremented if the emulator is compiled with
+/// NES_COUNTERS defined, otherwise they stay zero and the hot paths don't
+/// reference them at all.
+///
+struct Counters {
+    /// the number of CPU instructions retired
+    uint64_t instructions = 0;
+    /// the number of CPU cycles run
+    uint64_t cycles = 0;
+    /// the number of CPU bus reads in each region
+    uint64_t reads[BUS_REGIONS] = {};
+    /// the number of CPU bus writes in each region
+    uint64_t writes[BUS_REGIONS] = {};
+    /// the number of writes to the bank registers of the mapper
+    uint64_t bank_switches = 0;
+    /// the number of non-maskable interrupts fired by the PPU
+    uint64_t nmis = 0;
+    /// the number of PPU dots on the pre-render and visible scanlines
+    uint64_t rendering_dots = 0;
+    /// the number of PPU dots on the post-render and vertical blank lines
+    uint64_t vblank_dots = 0;
+    /// the number of frames stepped
+    uint64_t frames = 0;
+};
+
+#if defined(NES_COUNTERS)
+    /// Whether the emulator is compiled with counters
+    const bool COUNTERS_ENABLED = true;
+    /// Update a field of the counters of a component, if it has counters.
+    #define NES_COUNT(counters, update) \
+        do { if (counters) (counters)->update; } while (false)
+#else
+    /// Whether the emulator is compiled with counters
+    const bool COUNTERS_ENABLED = false;
+    /// Update a field of the counters of a component (compiled out).
+    #define NES_COUNT(counters, update) do { } while (false)
+#endif
+
+}  // namespace NES
+
+#endif  // COUNTERS_HPP
@@ -8,9 +8,14 @@
 #ifndef CPU_HPP
 #define CPU_HPP
 
+#include <algorithm>
+#include <array>
+#include <utility>
 #include "common.hpp"
+#include "counters.hpp"
 #include "cpu_opcodes.hpp"
 #include "main_bus.hpp"
+#include "state.hpp"
 
 namespace NES {
 
@@ -33,6 +38,50 @@ class CPU {
     int skip_cycles;
     /// The number of cycles the CPU has run
     int cycles;
+    /// The opcode of the last instruction
+    NES_Byte last_opcode = 0;
+    /// The number of instructions the CPU has executed
+    unsigned steps = 0;
+
+    /// The maximal number of bytes an idle loop jumps back over
+    static const int MAX_SPIN_LOOP_BYTES = 16;
+
+    /// A short loop in PRG ROM that only reads memory and jumps back to its
+    /// start, and the registers the CPU last entered it with
+    struct SpinLoop {
+        /// the address of the first instruction
+        NES_Address address = 0;
+        /// the address of the JMP or branch back to the first instruction
+        NES_Address branch = 0;
+        /// the memory of the pages of the first and last byte of the loop
+        const NES_Byte* pages[2] = {nullptr, nullptr};
+        /// the number of instructions of the loop, 0 if it isn't idle
+        int instructions = 0;
+        /// whether the loop reads the PPU status register
+        bool is_reading_ppu = false;
+        /// the change of the counted register on each repeat of a DEX, DEY,
+        /// INX, or INY and a BNE back to it, 0 if the loop only reads
+        int step = 0;
+        /// whether the loop counts in the X register, or else in Y
+        bool is_counting_x = false;
+        /// whether the CPU entered the loop since the last interrupt
+        bool is_entered = false;
+        /// the A, X, Y, SP, and flags registers on the last entry
+        NES_Byte registers[5] = {};
+        /// the cycles and instructions of the CPU on the last entry
+        int cycles = 0;
+        unsigned steps = 0;
+        /// the cycles of the last full repeat of the loop
+        int length = 0;
+#if defined(NES_COUNTERS)
+        /// the bus reads of each repeat of the loop in each region
+        int reads[BUS_REGIONS] = {};
+#endif
+    } spin_loop;
+#if defined(NES_COUNTERS)
+    /// the counters to update (only in builds with counters)
+    Counters* counters = nullptr;
+#endif
 
     /// Set the zero and negative flags based on the given value.
     ///
@@ -61,6 +110,34 @@ class CPU {
         bus.write(0x100 | register_SP--, value);
     }
 
+    /// Fetch the byte operand at the program counter and step over it.
+    ///
+    /// @tparam is_decoded whether the operand was resolved ahead of time
+    /// @param bus the bus to read the operand from if it isn't decoded
+    /// @param operand the decoded operand
+    /// @return the byte operand of the instruction
+    ///
+    template <bool is_decoded>
+    inline NES_Byte fetch_byte(MainBus &bus, NES_Address operand) {
+        if (is_decoded) {
+            ++register_PC;
+            return operand;
+        }
+        return bus.read(register_PC++);
+    }
+
+    /// Fetch the address operand at the program counter.
+    ///
+    /// @tparam is_decoded whether the operand was resolved ahead of time
+    /// @param bus the bus to read the operand from if it isn't decoded
+    /// @param operand the decoded operand
+    /// @return the 16-bit address operand of the instruction
+    ///
+    template <bool is_decoded>
+    inline NES_Address fetch_address(MainBus &bus, NES_Address operand) {
+        return is_decoded ? operand : read_address(bus, register_PC);
+    }
+
     /// Pop a value off the stack.
     ///
     /// @param bus the bus to read data from
@@ -82,43 +159,92 @@ class CPU {
 
     /// Execute an implied mode instruction.
     ///
+    /// @tparam opcode the opcode of the operation to perform
+    /// @tparam is_decoded whether the operand was resolved ahead of time
     /// @param bus the bus to read and write data from and to
-    /// @param opcode the opcode of the operation to perform
+    /// @param operand the decoded operand (unused if not decoded)
     /// @return true if the instruction succeeds
     ///
-    bool implied(MainBus &bus, NES_Byte opcode);
+    template <NES_Byte opcode, bool is_decoded>
+    bool implied(MainBus &bus, NES_Address operand);
 
     /// Execute a branch instruction.
     ///
+    /// @tparam opcode the opcode of the operation to perform
+    /// @tparam is_decoded whether the operand was resolved ahead of time
     /// @param bus the bus to read and write data from and to
-    /// @param opcode the opcode of the operation to perform
+    /// @param operand the decoded operand (unused if not decoded)
     /// @return true if the instruction succeeds
     ///
-    bool branch(MainBus &bus, NES_Byte opcode);
+    template <NES_Byte opcode, bool is_decoded>
+    bool branch(MainBus &bus, NES_Address operand);
 
     /// Execute a type 0 instruction.
     ///
+    /// @tparam opcode the opcode of the operation to perform
+    /// @tparam is_decoded whether the operand was resolved ahead of time
     /// @param bus the bus to read and write data from and to
-    /// @param opcode the opcode of the operation to perform
+    /// @param operand the decoded operand (unused if not decoded)
     /// @return true if the instruction succeeds
     ///
-    bool type0(MainBus &bus, NES_Byte opcode);
+    template <NES_Byte opcode, bool is_decoded>
+    bool type0(MainBus &bus, NES_Address operand);
 
     /// Execute a type 1 instruction.
     ///
+    /// @tparam opcode the opcode of the operation to perform
+    /// @tparam is_decoded whether the operand was resolved ahead of time
     /// @param bus the bus to read and write data from and to
-    /// @param opcode the opcode of the operation to perform
+    /// @param operand the decoded operand (unused if not decoded)
     /// @return true if the instruction succeeds
     ///
-    bool type1(MainBus &bus, NES_Byte opcode);
+    template <NES_Byte opcode, bool is_decoded>
+    bool type1(MainBus &bus, NES_Address operand);
 
     /// Execute a type 2 instruction.
     ///
+    /// @tparam opcode the opcode of the operation to perform
+    /// @tparam is_decoded whether the operand was resolved ahead of time
     /// @param bus the bus to read and write data from and to
-    /// @param opcode the opcode of the operation to perform
+    /// @param operand the decoded operand (unused if not decoded)
     /// @return true if the instruction succeeds
     ///
-    bool type2(MainBus &bus, NES_Byte opcode);
+    template <NES_Byte opcode, bool is_decoded>
+    bool type2(MainBus &bus, NES_Address operand);
+
+    /// A handler that executes the instruction of a single opcode
+    typedef void (*Instruction)(CPU &cpu, MainBus &bus, NES_Address operand);
+
+    /// The handlers for each opcode that fetch operands from the bus,
+    /// generated at compile time
+    static const std::array<Instruction, 0x100> instructions;
+
+    /// The handlers for each opcode that take decoded operands
+    static const std::array<Instruction, 0x100> decoded_instructions;
+
+    /// Execute the instruction of an opcode and add its cycles.
+    ///
+    /// @tparam opcode the opcode of the instruction to execute
+    /// @tparam is_decoded whether the operand was resolved ahead of time
+    /// @param cpu the CPU to execute the instruction on
+    /// @param bus the bus to read and write data from and to
+    /// @param operand the decoded operand (unused if not decoded)
+    ///
+    template <NES_Byte opcode, bool is_decoded>
+    static void execute(CPU &cpu, MainBus &bus, NES_Address operand);
+
+    /// Return the table of handlers for the given opcodes.
+    template <bool is_decoded, std::size_t... opcodes>
+    static constexpr std::array<Instruction, 0x100> make_instructions(std::index_sequence<opcodes...>);
+
+    /// Enter the loop ending in the last instruction, if it is idle.
+    ///
+    /// @param branch the address of the JMP or branch back to the loop
+    /// @param bus the bus that maps the code of the loop
+    /// @return the cycles of the last repeat of the loop if it is idle and
+    /// left the registers as they were, 0 otherwise
+    ///
+    int enter_spin_loop(NES_Address branch, const MainBus& bus);
 
     /// Reset the emulator using the given starting address.
     ///
@@ -127,6 +253,18 @@ class CPU {
     void reset(NES_Address start_address);
 
  public:
+    /// An instruction decoded ahead of time with its operand resolved
+    struct DecodedInstruction {
+        /// the handler that executes the instruction with the operand
+        Instruction handler;
+        /// the 8 or 16-bit operand after the opcode (0 if none)
+        NES_Address operand;
+        /// the opcode of the instruction
+        NES_Byte opcode;
+        /// the number of bytes of the opcode and operand
+        NES_Byte length;
+    };
+
     /// The interrupt types available to this CPU
     enum InterruptType {
         IRQ_INTERRUPT,
@@ -134,6 +272,14 @@ class CPU {
         BRK_INTERRUPT,
     };
 
+    /// The engines for executing the instructions of the CPU
+    enum Engine {
+        /// fetch and dispatch every instruction through the bus (reference)
+        ENGINE_INTERPRETER,
+        /// execute blocks of PRG ROM decoded ahead of time (see BlockCache)
+        ENGINE_BLOCK_CACHE,
+    };
+
     /// Initialize a new CPU.
     CPU() { };
 
@@ -153,18 +299,175 @@ class CPU {
     ///
     void interrupt(MainBus &bus, InterruptType type);
 
+    /// Execute the next instruction, the CPU must not be in a skip cycle.
+    ///
+    /// @param bus the bus to read and write data from / to
+    /// @return the number of cycles the instruction takes
+    ///
+    inline int step(MainBus &bus) {
+        // increment the number of cycles
+        ++cycles;
+        NES_COUNT(counters, cycles++);
+        NES_COUNT(counters, instructions++);
+        ++steps;
+        // reset the number of skip cycles to 0
+        skip_cycles = 0;
+        // read the opcode from the bus and execute it from the dispatch table
+        last_opcode = bus.read(register_PC++);
+        instructions[last_opcode](*this, bus, 0);
+        return skip_cycles;
+    }
+
+    /// Execute a decoded instruction, which must be the next instruction.
+    /// The opcode and operand bytes aren't read from the bus (or counted).
+    ///
+    /// @param bus the bus to read and write data from / to
+    /// @param instruction the instruction at the program counter
+    /// @return the number of cycles the instruction takes
+    ///
+    inline int step(MainBus &bus, const DecodedInstruction& instruction) {
+        ++cycles;
+        NES_COUNT(counters, cycles++);
+        NES_COUNT(counters, instructions++);
+        ++steps;
+        skip_cycles = 0;
+        last_opcode = instruction.opcode;
+        ++register_PC;
+        instruction.handler(*this, bus, instruction.operand);
+        return skip_cycles;
+    }
+
+    /// Decode an instruction ahead of time.
+    ///
+    /// @param opcode the opcode of the instruction
+    /// @param operand the 8 or 16-bit operand after the opcode
+    /// @return the decoded instruction
+    ///
+    static DecodedInstruction decode(NES_Byte opcode, NES_Address operand);
+
+    /// Return the number of bytes of an instruction.
+    ///
+    /// @param opcode the opcode of the instruction
+    /// @return the number of bytes of the opcode and operand, 0 if the
+    /// opcode isn't a documented instruction
+    ///
+    static int instruction_length(NES_Byte opcode);
+
     /// Perform a full CPU cycle using and storing data in the given bus.
     ///
     /// @param bus the bus to read and write data from / to
     ///
     void cycle(MainBus &bus);
 
+    /// Return the number of upcoming cycles the CPU only counts down in.
+    ///
+    /// @return the number of calls to cycle before the next instruction runs
+    ///
+    inline int get_idle_cycles() const {
+        return skip_cycles > 1 ? skip_cycles - 1 : 0;
+    }
+
+    /// Run a number of cycles that don't execute an instruction at once.
+    ///
+    /// @param count the number of cycles to run, at most get_idle_cycles()
+    ///
+    inline void idle(int count) {
+        cycles += count;
+        skip_cycles -= count;
+        NES_COUNT(counters, cycles += count);
+    }
+
+    /// Return the program counter.
+    inline NES_Address get_PC() const { return register_PC; }
+
+    /// Return the cycles of the idle loop the CPU spins in, if any.
+    ///
+    /// The CPU spins if its last instruction, at the given address, was a
+    /// JMP or a taken branch back to the start of a short loop in PRG ROM
+    /// that only reads RAM, PRG, or the PPU status without side effects
+    /// (e.g., a JMP to itself, or LDA $2002 / BPL), and a full repeat of the
+    /// loop left the registers as they were. The loop then repeats the same
+    /// reads and changes nothing but the cycle count, until an interrupt or
+    /// a change of the PPU status (see is_spinning_on_ppu). A delay loop of
+    /// a DEX, DEY, INX, or INY and a BNE back to it also spins, and only
+    /// changes its counter until it reaches 0.
+    ///
+    /// @param address the address of the last instruction
+    /// @param bus the bus that maps the code of the loop
+    /// @return the cycles of each repeat of the loop, 0 if the CPU isn't
+    /// spinning
+    ///
+    inline int get_spin_cycles(NES_Address address, const MainBus& bus) {
+        // only a JMP or taken branch back over a few bytes closes a loop
+        if (register_PC > address || address - register_PC > MAX_SPIN_LOOP_BYTES)
+            return 0;
+        if (last_opcode != JMP && (last_opcode & BRANCH_INSTRUCTION_MASK) != BRANCH_INSTRUCTION_MASK_RESULT)
+            return 0;
+        return enter_spin_loop(address, bus);
+    }
+
+    /// Return true if the idle loop the CPU spins in reads the PPU status.
+    inline bool is_spinning_on_ppu() const { return spin_loop.is_reading_ppu; }
+
+    /// Repeat the idle loop the CPU spins in at once.
+    ///
+    /// @param repeats the number of times to repeat the loop, the CPU must
+    /// be spinning (see get_spin_cycles)
+    /// @return the number of repeats run, fewer if a counting loop would
+    /// exit before
+    ///
+    inline int spin(int repeats) {
+        if (spin_loop.step != 0) {
+            NES_Byte& counter = spin_loop.is_counting_x ? register_X : register_Y;
+            // stop a repeat before the counter reaches 0 and the loop exits
+            repeats = std::min(repeats, spin_loop.step < 0 ? counter - 1 : 0xff - counter);
+            counter += repeats * spin_loop.step;
+            set_ZN(counter);
+            spin_loop.registers[spin_loop.is_counting_x ? 1 : 2] = counter;
+        }
+        cycles += repeats * spin_loop.length;
+        spin_loop.cycles = cycles;
+#if defined(NES_COUNTERS)
+        if (counters) {
+            counters->instructions += repeats * spin_loop.instructions;
+            counters->cycles += repeats * spin_loop.length;
+            for (int region = 0; region < BUS_REGIONS; region++)
+                counters->reads[region] += repeats * spin_loop.reads[region];
+        }
+#endif
+        return repeats;
+    }
+
+    /// Save the registers of the CPU.
+    ///
+    /// @param state the state to save the registers to
+    ///
+    void save(CPUState& state) const;
+
+    /// Load the registers of the CPU.
+    ///
+    /// @param state the state to load the registers from
+    ///
+    void load(const CPUState& state);
+
+    /// Return true if the registers of a state are in range for the CPU.
+    ///
+    /// @param state the state to check the registers of
+    /// @return true if the state can be loaded safely, false otherwise
+    ///
+    static bool is_valid(const CPUState& state);
+
     /// Skip DMA cycles.
     ///
     /// 513 = 256 read + 256 write + 1 dummy read
     /// &1 -> +1 if on odd cycle
     ///
     inline void skip_DMA_cycles() { skip_cycles += 513 + (cycles & 1); }
+
+#if defined(NES_COUNTERS)
+    /// Set the counters for the CPU to update.
+    inline void set_counters(Counters* counters_) { counters = counters_; }
+#endif
 };
 
 }  // namespace NES
@@ -9,18 +9,26 @@
 #define EMULATOR_HPP
 
 #include <array>
+#include <memory>
 #include <string>
 #include <algorithm>
 #include "common.hpp"
+#include "block_cache.hpp"
 #include "cartridge.hpp"
 #include "controller.hpp"
+#include "counters.hpp"
 #include "cpu.hpp"
 #include "ppu.hpp"
+#include "rom_image.hpp"
 #include "main_bus.hpp"
 #include "picture_bus.hpp"
+#include "state.hpp"
+#include "state_hash.hpp"
 
 namespace NES {
 
+class Movie;
+
 struct Core {
     /// the main data bus of the emulator
     MainBus bus;
@@ -30,12 +38,51 @@ struct Core {
     PPU ppu;
     /// the picture bus from the PPU of the emulator
     PictureBus picture_bus;
+    /// the number of CPU cycles run so far by the active call to run
+    int clock = 0;
+    /// the number of CPU cycles the PPU has been caught up to
+    int ppu_clock = 0;
+    /// whether the PPU changed since the interrupt deadline was computed
+    bool is_interrupt_stale = true;
+    /// the counters of the hot paths (only updated in builds with counters)
+    Counters counters;
+    /// the decoded blocks of PRG ROM, nullptr to interpret every instruction
+    std::unique_ptr<BlockCache> blocks;
 
-    void initialize(Controller* const controllers);    
     void reset();
     void set_mapper(Mapper *mapper);
-    void ppu_step(NESFrameBufferT* const framebuffer);
-    void step(NESFrameBufferT* const framebuffer);
+
+    /// Run the CPU for a number of cycles and catch the PPU up lazily.
+    ///
+    /// The CPU runs ahead of the PPU, which is caught up to the CPU only
+    /// when the CPU accesses it (through catch_up), when it interrupts the
+    /// CPU, and when the cycles are done. The result matches interleaving
+    /// 3 PPU cycles with each CPU cycle.
+    ///
+    /// @param framebuffer the screen for the PPU to render to
+    /// @param cycles the number of CPU cycles to run
+    ///
+    void run(NESFrameBufferT* const framebuffer, int cycles);
+
+    /// Run the CPU for a number of cycles with the given engine.
+    ///
+    /// A block is only executed if the interrupt deadline and the end of
+    /// the cycles can't pass within it, its instructions then run back to
+    /// back and the deadline is only checked again once the PPU is caught
+    /// up (an access to the PPU or mapper ends the block early).
+    ///
+    /// @tparam is_caching whether to execute the decoded blocks
+    /// @param framebuffer the screen for the PPU to render to
+    /// @param cycles the number of CPU cycles to run
+    ///
+    template <bool is_caching>
+    void run(NESFrameBufferT* const framebuffer, int cycles);
+
+    /// Run the PPU up to the current CPU cycle and render pending pixels.
+    ///
+    /// @param framebuffer the screen for the PPU to render to
+    ///
+    void catch_up(NESFrameBufferT* const framebuffer);
 };
 
 /// An NES Emulator and OpenAI Gym interface
@@ -52,12 +99,71 @@ class Emulator {
     ///
     explicit Emulator(std::string rom_path);
 
+    /// Initialize a new emulator with a ROM image.
+    ///
+    /// @param rom the image of the ROM for the emulator to run, shared with
+    /// the other emulators that run it
+    ///
+    explicit Emulator(std::shared_ptr<const ROMImage> rom);
+
+    Emulator(const Emulator&) = delete;
+    Emulator& operator=(const Emulator&) = delete;
+
+    /// Return a new emulator in the same state as this one.
+    ///
+    /// The clone shares the ROM image and copies the rest with copy_from.
+    ///
+    /// @return the new emulator
+    ///
+    std::unique_ptr<Emulator> clone();
+
+    /// Put the emulator in the same state as another that runs the ROM.
+    ///
+    /// Only the mutable state (the CPU, PPU, RAM, VRAM, mapper registers,
+    /// and CHR RAM) is copied, through a snapshot, so the callbacks and
+    /// page tables keep referring to the memory of this emulator. The
+    /// screen, render mode, pixel format, and CPU engine are copied too,
+    /// the hash ring and movie aren't. Reusing emulators this way avoids the allocation
+    /// of a clone, which dominates its cost.
+    ///
+    /// @param other the emulator to copy the state of
+    /// @throws std::invalid_argument if the other emulator runs another ROM
+    ///
+    void copy_from(Emulator& other);
+
+    /// Return the image of the ROM the emulator runs.
+    inline const std::shared_ptr<const ROMImage>& get_rom() { return cartridge.getImage(); }
+
     /// Return a 32-bit pointer to the screen buffer's first address.
     ///
     /// @return a 32-bit pointer to the screen buffer's first address
     ///
     inline NESFrameBufferT* const get_screen_buffer() { return &framebuffer; }
 
+    /// Return a pointer to the screen of palette indexes, which holds the
+    /// last frame in the indexed pixel format.
+    ///
+    /// @return a pointer to the HEIGHT x WIDTH screen of palette indexes
+    ///
+    inline NESIndexBufferT* get_index_buffer() { return &index_buffer; }
+
+    /// Return the format the PPU writes pixels in.
+    inline PPU::PixelFormat get_pixel_format() const { return core.ppu.get_pixel_format(); }
+
+    /// Set the format the PPU writes pixels in.
+    ///
+    /// In the indexed format the PPU only writes palette indexes and the
+    /// screen buffer is only updated by convert_screen. Switching back to
+    /// RGB converts the last frame to the screen buffer.
+    ///
+    /// @param format the new format for the PPU to write pixels in
+    ///
+    void set_pixel_format(PPU::PixelFormat format);
+
+    /// Convert the palette indexes of the last frame to the screen buffer,
+    /// if the PPU writes pixels in the indexed format.
+    void convert_screen();
+
     /// Return a 8-bit pointer to the RAM buffer's first address.
     ///
     /// @return a 8-bit pointer to the RAM buffer's first address
@@ -74,24 +180,145 @@ class Emulator {
     }
 
     /// Load the ROM into the NES.
-    inline void reset() { core.cpu.reset(core.bus); core.ppu.reset(); }
+    void reset();
 
     /// Perform a step on the emulator, i.e., a single frame.
     void step();
 
-    /// Perform a step on the PPU, i.e., a single frame.
+    /// Perform a step on the emulator, i.e., a single frame.
+    ///
+    /// @param is_rendering whether to compose the pixels of the frame, if
+    /// false the screen isn't written but the emulation is unchanged
+    ///
+    void step(bool is_rendering);
+
+    /// Perform a number of steps on the emulator holding the same input.
+    /// Only the last frame is rendered to the screen.
+    ///
+    /// @param player_1 the button bitmap for the first controller
+    /// @param player_2 the button bitmap for the second controller
+    /// @param frames the number of frames to step the emulator for
+    ///
+    void step(NES_Byte player_1, NES_Byte player_2, int frames);
+
+    /// Perform a step on the PPU, i.e., a single frame. The interrupts of
+    /// the frame reach the CPU, so a recording movie is cut afterward.
     void ppu_step();
 
-    /// Create a snapshot state on the emulator.
-    inline void snapshot(Core* const core) {
-        *core = this->core;
+    /// Return the mode the PPU renders pixels with.
+    inline PPU::RenderMode get_render_mode() const { return core.ppu.get_render_mode(); }
+
+    /// Set the mode the PPU renders pixels with.
+    ///
+    /// @param mode the new mode for the PPU to render pixels with
+    ///
+    inline void set_render_mode(PPU::RenderMode mode) {
+        core.ppu.set_render_mode(mode, core.picture_bus, &framebuffer);
     }
 
-    /// Restore the snapshot state on the emulator.
-    inline void restore(const Core* const core) {
-        this->core = *core;
+    /// Return the engine that executes the instructions of the CPU.
+    inline CPU::Engine get_cpu_engine() const {
+        return core.blocks ? CPU::ENGINE_BLOCK_CACHE : CPU::ENGINE_INTERPRETER;
     }
 
+    /// Set the engine that executes the instructions of the CPU. Both
+    /// engines emulate the same cycles, the block cache fetches fewer bytes
+    /// through the bus (which the counters reflect).
+    ///
+    /// @param engine the new engine to execute the instructions with
+    ///
+    void set_cpu_engine(CPU::Engine engine);
+
+    /// Return the counters of the hot paths since the last reset_counters.
+    /// They stay zero unless the emulator is compiled with NES_COUNTERS.
+    inline const Counters& get_counters() const { return core.counters; }
+
+    /// Reset the counters of the hot paths to zero.
+    inline void reset_counters() { core.counters = Counters(); }
+
+    /// Create a snapshot state on the emulator.
+    ///
+    /// @param state the state to save the CPU, PPU, buses, mapper, and
+    /// controllers to
+    ///
+    void snapshot(State* const state);
+
+    /// Return true if a state can be restored on this emulator.
+    ///
+    /// A state is compatible if its header matches this layout, mapper, and
+    /// ROM, and the registers of the CPU, PPU, and mapper are in range, so
+    /// states from untrusted bytes can't index memory out of bounds.
+    ///
+    /// @param state the state to check
+    /// @return true if the state can be restored, false otherwise
+    ///
+    bool is_compatible(const State* const state);
+
+    /// Restore the snapshot state on the emulator, cutting the movie the
+    /// emulator records (if any) to continue from the state.
+    ///
+    /// @param state a compatible state to load the emulator from
+    /// @throws std::invalid_argument if the state isn't compatible
+    ///
+    void restore(const State* const state);
+
+    /// Hash the state after every frame (steps and rollouts) into a ring.
+    ///
+    /// Frame n (counting from the call) writes the hash_state of the state
+    /// after it to ring[n % size], which is cheap enough to leave on while
+    /// recording rollouts that should replay bit-exactly elsewhere.
+    ///
+    /// @param ring the ring of hashes to write, it must outlive the hashing,
+    /// nullptr to stop hashing
+    /// @param size the number of hashes in the ring
+    /// @throws std::invalid_argument if the ring is empty
+    ///
+    void set_hash_ring(uint64_t* ring, std::size_t size);
+
+    /// Return the number of hashes written since the ring was set.
+    inline uint64_t get_hash_count() const { return hash_count; }
+
+    /// Return the hash of the current state of the emulator.
+    uint64_t hash();
+
+    /// Return the movie the emulator records its frames to, if any.
+    inline Movie* get_movie() const { return movie; }
+
+    /// Set the movie to record the frames of steps to, use Movie::record
+    /// and Movie::stop instead of calling this directly.
+    ///
+    /// @param movie the movie to append frames to, nullptr to stop
+    ///
+    inline void set_movie(Movie* movie_) { movie = movie_; }
+
+    /// Run an action sequence headless from a state and trace RAM bytes.
+    ///
+    /// The frames are stepped without composing pixels and the emulator is
+    /// left in the state after the last frame. Rollouts aren't recorded to
+    /// the movie of the emulator, it is cut to the state after the rollout.
+    ///
+    /// @param state a compatible state to start the rollout from
+    /// @param actions the (frames, players) row-major array of controller
+    /// bytes, player 2 keeps the buttons of the state if players is 1
+    /// @param players the number of controller bytes per frame (1 or 2)
+    /// @param frames the number of frames to step the emulator for
+    /// @param addresses the RAM addresses to trace, each below 0x800
+    /// @param count the number of RAM addresses to trace
+    /// @param trace the (frames, count) row-major array of RAM bytes to write
+    /// after each frame
+    /// @throws std::invalid_argument if the state isn't compatible or an
+    /// address is outside the RAM
+    ///
+    void rollout(
+        const State* const state,
+        const NES_Byte* actions,
+        std::size_t players,
+        int frames,
+        const NES_Address* addresses,
+        std::size_t count,
+        NES_Byte* trace
+    );
+
  private:
     /// The number of cycles in 1 frame
     static const int CYCLES_PER_FRAME = 29781;
@@ -100,11 +327,49 @@ class Emulator {
     Core core;    
     /// the virtual cartridge with ROM and mapper data
     Cartridge cartridge;
+    /// the mapper of the cartridge (destroyed before the cartridge)
+    std::unique_ptr<Mapper> mapper;
     /// the 2 controllers on the emulator
     Controller controllers[2];
 
     /// the rendering framebuffer of the emulator
     NESFrameBufferT framebuffer;
+    /// the screen of palette indexes for the indexed pixel format
+    NESIndexBufferT index_buffer;
+
+    /// the ring of per-frame state hashes, nullptr if not hashing
+    uint64_t* hash_ring = nullptr;
+    /// the number of hashes in the ring
+    std::size_t hash_ring_size = 0;
+    /// the number of hashes written to the ring
+    uint64_t hash_count = 0;
+    /// the hasher of the states of consecutive frames
+    std::unique_ptr<StateHasher> hasher;
+    /// the state to save before hashing
+    std::unique_ptr<State> hashed_state;
+    /// the movie to record frames to, nullptr if not recording
+    Movie* movie = nullptr;
+
+    /// Catch the PPU up to the CPU before accessing its state.
+    inline void sync_ppu() { core.catch_up(&framebuffer); }
+
+    /// Write the hash of the state to the ring, if hashing.
+    inline void record_hash() {
+        if (hash_ring != nullptr)
+            hash_ring[hash_count++ % hash_ring_size] = hash();
+    }
+
+    /// Record the hash and the inputs of a step after its frame.
+    void end_frame();
+
+    /// Load the snapshot state on the emulator without cutting the movie.
+    ///
+    /// @param state a compatible state to load the emulator from
+    ///
+    void load(const State* const state);
+
+    /// Cut the movie the emulator records after its state was replaced.
+    void cut_movie();
 };
 
 }  // namespace NES
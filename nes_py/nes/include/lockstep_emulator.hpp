@@ -0,0 +1,91 @@
+//  Program:      nes-py
+//  File:         lockstep_emulator.hpp
+//  Description:  An experimental engine that steps lanes of a ROM in lockstep
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef LOCKSTEP_EMULATOR_HPP
+#define LOCKSTEP_EMULATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "common.hpp"
+#include "emulator.hpp"
+#include "rom_image.hpp"
+#include "state.hpp"
+
+namespace NES {
+
+/// An experimental engine that steps the lanes of a group of emulators of
+/// one ROM in lockstep on the calling thread.
+///
+/// At the start of each frame, the lanes whose states (including the new
+/// buttons) are the same form a group. Each group runs the frame once on
+/// its first lane, and the other lanes of the group copy the result. A lane
+/// splits off as soon as its state or input differs and rejoins a group
+/// whenever it coincides again, e.g., on a screen that ignores the buttons.
+/// The scalar Emulator is the reference: every lane ends each frame in the
+/// state (and with the screen) it would have stepping on its own, only its
+/// counters don't advance on the frames it copies.
+///
+class LockstepEmulator {
+ public:
+    /// Initialize a new group of lanes that share a ROM image.
+    ///
+    /// @param rom the image of the ROM for the lanes to run
+    /// @param lanes the number of lanes in the group
+    ///
+    LockstepEmulator(std::shared_ptr<const ROMImage> rom, std::size_t lanes);
+
+    LockstepEmulator(const LockstepEmulator&) = delete;
+    LockstepEmulator& operator=(const LockstepEmulator&) = delete;
+
+    /// Return the number of lanes in the group.
+    inline std::size_t size() const { return emulators.size(); }
+
+    /// Return the emulator of a lane.
+    ///
+    /// @param lane the index of the lane
+    /// @return the emulator of the lane
+    ///
+    inline Emulator& operator[](std::size_t lane) { return *emulators[lane]; }
+
+    /// Reset every lane.
+    void reset();
+
+    /// Perform a step on every lane.
+    ///
+    /// @param actions the controller bytes of the lanes, lane-major with
+    /// one byte per player
+    /// @param players the number of controller bytes per lane, 1 or 2
+    ///
+    void step(const NES_Byte* actions, std::size_t players);
+
+    /// Return the number of frames the lanes stepped since the last reset.
+    inline uint64_t get_frames() const { return frames; }
+
+    /// Return the number of frames the lanes copied from the first lane of
+    /// their group instead of running them since the last reset.
+    inline uint64_t get_shared_frames() const { return shared_frames; }
+
+ private:
+    /// the emulator of each lane
+    std::vector<std::unique_ptr<Emulator>> emulators;
+    /// the state of each lane at the start of the frame
+    std::vector<State> states;
+    /// the hash of the state of each lane at the start of the frame
+    std::vector<uint64_t> hashes;
+    /// the first lane of the group of each lane for the frame
+    std::vector<std::size_t> leaders;
+    /// the number of frames the lanes stepped
+    uint64_t frames = 0;
+    /// the number of frames the lanes copied from another lane
+    uint64_t shared_frames = 0;
+};
+
+}  // namespace NES
+
+#endif  // LOCKSTEP_EMULATOR_HPP
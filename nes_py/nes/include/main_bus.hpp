@@ -8,10 +8,12 @@
 #ifndef MAIN_BUS_HPP
 #define MAIN_BUS_HPP
 
-#include <vector>
-#include <unordered_map>
+#include <array>
+#include <functional>
 #include "common.hpp"
+#include "counters.hpp"
 #include "mapper.hpp"
+#include "state.hpp"
 
 namespace NES {
 
@@ -30,21 +32,13 @@ enum IORegisters {
     JOY2 = 0x4017,
 };
 
-/// An enum functor object for calculating the hash of an enum class
-/// https://stackoverflow.com/questions/18837857/cant-use-enum-class-as-unordered-map-key
-struct EnumClassHash {
-    template <typename T>
-    std::size_t operator()(T t) const { return static_cast<std::size_t>(t); }
-};
+/// The number of IO registers with callbacks on the main bus
+const int IO_REGISTER_COUNT = 12;
 
 /// a type for write callback functions
 typedef std::function<void(NES_Byte)> WriteCallback;
-/// a map type from IORegsiters to WriteCallbacks
-typedef std::unordered_map<IORegisters, WriteCallback, EnumClassHash> IORegisterToWriteCallbackMap;
 /// a type for read callback functions
 typedef std::function<NES_Byte(void)> ReadCallback;
-/// a map type from IORegsiters to ReadCallbacks
-typedef std::unordered_map<IORegisters, ReadCallback, EnumClassHash> IORegisterToReadCallbackMap;
 
 /// The main bus for data to travel along the NES hardware
 class MainBus {
@@ -55,14 +49,66 @@ class MainBus {
     static_vector<NES_Byte, 0x2000> extended_ram;
     /// a pointer to the mapper on the cartridge
     Mapper* mapper;
-    /// a map of IO registers to callback methods for writes
-    IORegisterToWriteCallbackMap write_callbacks;
-    /// a map of IO registers to callback methods for reads
-    IORegisterToReadCallbackMap read_callbacks;
+    /// the pages of memory that reads access directly (null pages are IO
+    /// registers, unmapped, or handled by the mapper)
+    std::array<const NES_Byte*, 0x100> read_pages;
+    /// the pages of memory that writes access directly
+    std::array<NES_Byte*, 0x100> write_pages;
+    /// the callbacks for writes to IO registers
+    std::array<WriteCallback, IO_REGISTER_COUNT> write_callbacks;
+    /// the callbacks for reads from IO registers
+    std::array<ReadCallback, IO_REGISTER_COUNT> read_callbacks;
+    /// a callback for before writes are forwarded to the mapper
+    std::function<void(void)> mapper_write_callback;
+#if defined(NES_COUNTERS)
+    /// the counters to update (only in builds with counters)
+    Counters* counters = nullptr;
+#endif
+
+    /// Return the index of an IO register in the callback arrays.
+    ///
+    /// @param reg the IO register to return the index of
+    /// @return the index, PPU registers first and then $4014-$4017
+    ///
+    static inline int io_index(IORegisters reg) {
+        return reg < OAMDMA ? reg - PPUCTRL : reg - OAMDMA + 8;
+    }
+
+    /// Map the RAM and extended RAM into the page tables.
+    void map_pages();
+
+    /// Read a byte from an address that isn't mapped in the page table.
+    ///
+    /// @param address the 16-bit address of the byte to read
+    /// @return the byte from the IO register or mapper at the address
+    ///
+    NES_Byte read_unmapped(NES_Address address);
+
+    /// Write a byte to an address that isn't mapped in the page table.
+    ///
+    /// @param address the 16-bit address to write the byte to
+    /// @param value the byte to write to the IO register or mapper
+    ///
+    void write_unmapped(NES_Address address, NES_Byte value);
 
  public:
     /// Initialize a new main bus.
-    MainBus() : mapper(nullptr) { }
+    MainBus();
+
+    /// Initialize a copy of the memory on another main bus. The copy isn't
+    /// attached to the mapper or the callbacks of the other bus.
+    ///
+    /// @param other the main bus to copy the memory of
+    ///
+    MainBus(const MainBus& other);
+
+    /// Copy the memory of another main bus, keeping the mapper, callbacks,
+    /// and page tables of this bus.
+    ///
+    /// @param other the main bus to copy the memory of
+    /// @return this main bus
+    ///
+    MainBus& operator=(const MainBus& other);
 
     /// Return a 8-bit pointer to the RAM buffer's first address.
     ///
@@ -76,14 +122,36 @@ class MainBus {
     ///
     /// @return the byte located at the given address
     ///
-    NES_Byte read(NES_Address address);
+    inline NES_Byte read(NES_Address address) {
+        NES_COUNT(counters, reads[bus_region(address)]++);
+        const NES_Byte* page = read_pages[address >> 8];
+        if (page) return page[address & 0xff];
+        return read_unmapped(address);
+    }
 
     /// Write a byte to an address in the RAM.
     ///
     /// @param address the 16-bit address to write the byte to in RAM
     /// @param value the byte to write to the given address
     ///
-    void write(NES_Address address, NES_Byte value);
+    inline void write(NES_Address address, NES_Byte value) {
+        NES_COUNT(counters, writes[bus_region(address)]++);
+        NES_Byte* page = write_pages[address >> 8];
+        if (page) page[address & 0xff] = value;
+        else write_unmapped(address, value);
+    }
+
+    /// Save the memory of the bus.
+    ///
+    /// @param state the state to save the memory to
+    ///
+    void save(MainBusState& state) const;
+
+    /// Load the memory of the bus.
+    ///
+    /// @param state the state to load the memory from
+    ///
+    void load(const MainBusState& state);
 
     /// Set the mapper pointer to a new value.
     ///
@@ -93,16 +161,30 @@ class MainBus {
 
     /// Set a callback for when writes occur.
     inline void set_write_callback(IORegisters reg, WriteCallback callback) {
-        write_callbacks.insert({reg, callback});
+        write_callbacks[io_index(reg)] = callback;
     }
 
     /// Set a callback for when reads occur.
     inline void set_read_callback(IORegisters reg, ReadCallback callback) {
-        read_callbacks.insert({reg, callback});
+        read_callbacks[io_index(reg)] = callback;
+    }
+
+    /// Set a callback for before writes are forwarded to the mapper.
+    inline void set_mapper_write_callback(std::function<void(void)> callback) {
+        mapper_write_callback = callback;
     }
 
     /// Return a pointer to the page in memory.
     const NES_Byte* get_page_pointer(NES_Byte page);
+
+    /// Return the memory a page of the address space reads from, nullptr if
+    /// reads of the page go through callbacks or the mapper.
+    inline const NES_Byte* get_read_page(NES_Byte page) const { return read_pages[page]; }
+
+#if defined(NES_COUNTERS)
+    /// Set the counters for the bus to update.
+    inline void set_counters(Counters* counters_) { counters = counters_; }
+#endif
 };
 
 }  // namespace NES
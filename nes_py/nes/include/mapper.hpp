@@ -9,8 +9,11 @@
 #define MAPPER_HPP
 
 #include <functional>
+#include <vector>
 #include "common.hpp"
 #include "cartridge.hpp"
+#include "counters.hpp"
+#include "state.hpp"
 
 namespace NES {
 
@@ -23,18 +26,131 @@ enum NameTableMirroring {
     ONE_SCREEN_HIGHER,
 };
 
+/// The number of bytes in a page of the CHR page table of the PPU
+const std::size_t CHR_PAGE_SIZE = 0x400;
+/// The number of pages in the CHR page table of the PPU ($0000-$1FFF)
+const std::size_t CHR_PAGES = 0x2000 / CHR_PAGE_SIZE;
+
 /// An abstraction of a general hardware mapper for different NES cartridges
 class Mapper {
  protected:
     /// The cartridge this mapper associates with
     Cartridge* cartridge;
+    /// The page table of the CPU to map PRG banks into (null if unattached)
+    const NES_Byte** prg_pages;
+    /// The page table of the PPU to map CHR banks into (null if unattached)
+    const NES_Byte** chr_pages;
+#if defined(NES_COUNTERS)
+    /// the counters to update (only in builds with counters)
+    Counters* counters = nullptr;
+#endif
+
+    /// Map a bank of PRG ROM into the page table of the CPU.
+    ///
+    /// Pages past the end of the PRG ROM are left unmapped, so reads from
+    /// them fall back to readPRG.
+    ///
+    /// @param address the first address to map the bank to (page aligned)
+    /// @param offset the offset of the bank in the PRG ROM
+    /// @param size the number of bytes in the bank (page aligned)
+    ///
+    inline void map_prg(NES_Address address, std::size_t offset, std::size_t size) {
+        if (prg_pages == nullptr) return;
+        const auto& rom = cartridge->getROM();
+        for (std::size_t page = 0; page < size; page += 0x100) {
+            prg_pages[(address + page) >> 8] =
+                offset + page + 0x100 <= rom.size() ? &rom[offset + page] : nullptr;
+        }
+    }
+
+    /// Map a bank of CHR ROM into the page table of the PPU.
+    ///
+    /// Pages past the end of the CHR ROM are left unmapped, so reads from
+    /// them fall back to readCHR.
+    ///
+    /// @param address the first address to map the bank to (page aligned)
+    /// @param offset the offset of the bank in the CHR ROM
+    /// @param size the number of bytes in the bank (page aligned)
+    ///
+    inline void map_chr(NES_Address address, std::size_t offset, std::size_t size) {
+        if (chr_pages == nullptr) return;
+        const auto& rom = cartridge->getVROM();
+        for (std::size_t page = 0; page < size; page += CHR_PAGE_SIZE) {
+            chr_pages[(address + page) / CHR_PAGE_SIZE] =
+                offset + page + CHR_PAGE_SIZE <= rom.size() ? &rom[offset + page] : nullptr;
+        }
+    }
+
+    /// Map 8KB of CHR RAM into the whole page table of the PPU.
+    ///
+    /// @param ram the CHR RAM to map, reads see the writes to it
+    ///
+    inline void map_chr_ram(const std::vector<NES_Byte>& ram) {
+        if (chr_pages == nullptr) return;
+        for (std::size_t page = 0; page < CHR_PAGES; page++)
+            chr_pages[page] = &ram[page * CHR_PAGE_SIZE];
+    }
 
  public:
     /// Create a new mapper with a cartridge and given type.
     ///
     /// @param game a reference to a cartridge for the mapper to access
     ///
-    explicit Mapper(Cartridge* game) : cartridge(game) { }
+    explicit Mapper(Cartridge* game) :
+        cartridge(game),
+        prg_pages(nullptr),
+        chr_pages(nullptr) { }
+
+    /// Destroy the mapper, the emulator owns it through a base pointer.
+    virtual ~Mapper() = default;
+
+    /// Set the page table for the mapper to map PRG banks into.
+    ///
+    /// @param pages the 256 page pointers of the CPU address space
+    ///
+    inline void set_prg_pages(const NES_Byte** pages) {
+        prg_pages = pages;
+        map_prg_pages();
+    }
+
+#if defined(NES_COUNTERS)
+    /// Set the counters for the mapper to update.
+    inline void set_counters(Counters* counters_) { counters = counters_; }
+#endif
+
+    /// Map the current PRG banks into the page table (after bank switches).
+    virtual void map_prg_pages() = 0;
+
+    /// Set the page table for the mapper to map CHR banks into.
+    ///
+    /// @param pages the 8 page pointers of the PPU pattern tables
+    ///
+    inline void set_chr_pages(const NES_Byte** pages) {
+        chr_pages = pages;
+        map_chr_pages();
+    }
+
+    /// Map the current CHR banks into the page table (after bank switches).
+    virtual void map_chr_pages() = 0;
+
+    /// Save the registers and character RAM of the mapper.
+    ///
+    /// @param state the state to save the registers and character RAM to
+    ///
+    virtual void save(MapperState& state) const = 0;
+
+    /// Load the registers and character RAM of the mapper.
+    ///
+    /// @param state the state to load the registers and character RAM from
+    ///
+    virtual void load(const MapperState& state) = 0;
+
+    /// Return true if the registers of a state are in range for the mapper.
+    ///
+    /// @param state the state to check the registers of
+    /// @return true if the state can be loaded safely, false otherwise
+    ///
+    virtual bool is_valid(const MapperState& state) const = 0;
 
     /// Return the name table mirroring mode of this mapper.
     inline virtual NameTableMirroring getNameTableMirroring() {
@@ -8,6 +8,7 @@
 #ifndef MAPPER_FACTORY_HPP
 #define MAPPER_FACTORY_HPP
 
+#include <memory>
 #include "mapper.hpp"
 #include "mappers/mapper_NROM.hpp"
 #include "mappers/mapper_SxROM.hpp"
@@ -28,17 +29,18 @@ enum class MapperID : NES_Byte {
 ///
 /// @param game the cartridge to initialize a mapper for
 /// @param callback the callback function for the mapper (if necessary)
+/// @return the new mapper, null if the mapper ID isn't supported
 ///
-Mapper* MapperFactory(Cartridge* game, std::function<void(void)> callback) {
+std::unique_ptr<Mapper> MapperFactory(Cartridge* game, std::function<void(void)> callback) {
     switch (static_cast<MapperID>(game->getMapper())) {
         case MapperID::NROM:
-            return new MapperNROM(game);
+            return std::unique_ptr<Mapper>(new MapperNROM(game));
         case MapperID::SxROM:
-            return new MapperSxROM(game, callback);
+            return std::unique_ptr<Mapper>(new MapperSxROM(game, callback));
         case MapperID::UxROM:
-            return new MapperUxROM(game);
+            return std::unique_ptr<Mapper>(new MapperUxROM(game));
         case MapperID::CNROM:
-            return new MapperCNROM(game);
+            return std::unique_ptr<Mapper>(new MapperCNROM(game));
         default:
             return nullptr;
     }
@@ -100,6 +100,41 @@ class MapperSxROM : public Mapper {
 
     /// Return the name table mirroring mode of this mapper.
     inline NameTableMirroring getNameTableMirroring() { return mirroring; }
+
+    /// Map the current PRG banks into the page table.
+    inline void map_prg_pages() {
+        map_prg(0x8000, first_bank_prg, 0x4000);
+        map_prg(0xc000, second_bank_prg, 0x4000);
+    }
+
+    /// Map the current CHR banks into the page table.
+    inline void map_chr_pages() {
+        if (has_character_ram) {
+            map_chr_ram(character_ram);
+        } else {
+            map_chr(0x0000, first_bank_chr, 0x1000);
+            map_chr(0x1000, second_bank_chr, 0x1000);
+        }
+    }
+
+    /// Save the registers and character RAM of the mapper.
+    ///
+    /// @param state the state to save the registers and character RAM to
+    ///
+    void save(MapperState& state) const;
+
+    /// Load the registers and character RAM of the mapper.
+    ///
+    /// @param state the state to load the registers and character RAM from
+    ///
+    void load(const MapperState& state);
+
+    /// Return true if the registers of a state are in range for the mapper.
+    ///
+    /// @param state the state to check the registers of
+    /// @return true if the state can be loaded safely, false otherwise
+    ///
+    bool is_valid(const MapperState& state) const;
 };
 
 }  // namespace NES
@@ -46,6 +46,8 @@ class MapperUxROM : public Mapper {
     ///
     inline void writePRG(NES_Address address, NES_Byte value) {
         select_prg = value;
+        NES_COUNT(counters, bank_switches++);
+        map_prg_pages();
     }
 
     /// Read a byte from the CHR RAM.
@@ -61,6 +63,39 @@ class MapperUxROM : public Mapper {
     /// @param value the byte to write to the given address
     ///
     void writeCHR(NES_Address address, NES_Byte value);
+
+    /// Map the current PRG banks into the page table.
+    inline void map_prg_pages() {
+        map_prg(0x8000, select_prg << 14, 0x4000);
+        map_prg(0xc000, last_bank_pointer, 0x4000);
+    }
+
+    /// Map the current CHR banks into the page table.
+    inline void map_chr_pages() {
+        if (has_character_ram)
+            map_chr_ram(character_ram);
+        else
+            map_chr(0x0000, 0, 0x2000);
+    }
+
+    /// Save the registers and character RAM of the mapper.
+    ///
+    /// @param state the state to save the registers and character RAM to
+    ///
+    void save(MapperState& state) const;
+
+    /// Load the registers and character RAM of the mapper.
+    ///
+    /// @param state the state to load the registers and character RAM from
+    ///
+    void load(const MapperState& state);
+
+    /// Return true if the registers of a state are in range for the mapper.
+    ///
+    /// @param state the state to check the registers of
+    /// @return true if the state can be loaded safely, false otherwise
+    ///
+    bool is_valid(const MapperState& state) const;
 };
 
 }  // namespace NES
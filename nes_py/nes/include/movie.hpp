@@ -0,0 +1,201 @@
+//  Program:      nes-py
+//  File:         movie.hpp
+//  Description:  A movie of controller inputs with keyframes for fast seeking
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef MOVIE_HPP
+#define MOVIE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.hpp"
+#include "emulator.hpp"
+#include "snapshot_pool.hpp"
+#include "state.hpp"
+
+namespace NES {
+
+/// A movie of the controller inputs of every frame from a start state.
+///
+/// The inputs are stored as runs of frames that hold the same buttons, and
+/// the state after every keyframe_interval frames is stored as a delta to
+/// the previous keyframe in a snapshot pool. Seeking to a frame restores
+/// the last keyframe before it and fast-forwards the rest headless.
+///
+/// When the state of the recording emulator is replaced between frames (by
+/// a restore, reset, redraw, or rollout), the movie is cut: the new state
+/// is stored as a keyframe on the current frame and the frames after it
+/// continue from there. Seeking never replays frames across a cut.
+///
+/// A movie isn't thread safe, use one movie per thread.
+///
+class Movie {
+ public:
+    /// Initialize a new, empty movie.
+    ///
+    /// @param keyframe_interval the number of frames between keyframes
+    /// @throws std::invalid_argument if the interval isn't positive
+    ///
+    explicit Movie(int keyframe_interval = 120);
+
+    Movie(const Movie&) = delete;
+    Movie& operator=(const Movie&) = delete;
+    ~Movie();
+
+    /// Start recording the frames an emulator steps from its current state,
+    /// the movie is cleared first. The emulator appends a frame after every
+    /// step and cuts the movie when its state is replaced until stop is
+    /// called. The frames of rollouts aren't recorded, the state they end
+    /// in is a cut.
+    ///
+    /// @param emulator the emulator to record the frames of
+    ///
+    void record(Emulator& emulator);
+
+    /// Stop the emulator that records the movie from appending frames.
+    void stop();
+
+    /// Return whether an emulator is recording the movie.
+    inline bool is_recording() const { return recorder != nullptr; }
+
+    /// Append a frame to the movie, called by the recording emulator after
+    /// each frame with the buttons it held.
+    ///
+    /// @param emulator the emulator that stepped the frame
+    ///
+    void append(Emulator& emulator);
+
+    /// Cut the movie, called by the recording emulator after its state is
+    /// replaced between frames. The state is stored as the keyframe of the
+    /// current frame (replacing the keyframe already on it, if any), and
+    /// the next frame starts a new run.
+    ///
+    /// @param emulator the emulator whose state was replaced
+    ///
+    void cut(Emulator& emulator);
+
+    /// Rebuild a movie from a start state and the inputs of every frame.
+    /// The inputs don't hold the cuts of the movie they came from, so a
+    /// movie with cuts doesn't rebuild from its inputs.
+    ///
+    /// @param emulator the emulator to replay the inputs on headless
+    /// @param state the state the movie starts from
+    /// @param inputs the (count, 2) row-major controller bytes of each frame
+    /// @param count the number of frames of inputs
+    /// @throws std::invalid_argument if the state isn't compatible
+    ///
+    void load(Emulator& emulator, const State* const state, const NES_Byte* inputs, std::size_t count);
+
+    /// Put an emulator in the state after a number of frames of the movie.
+    ///
+    /// The last keyframe at or before the frame is restored and the frames
+    /// after it are replayed headless, except for the last which renders
+    /// the screen. Seeking to the frame of a cut puts the emulator in the
+    /// state after the cut. If the emulator is recording the movie, the
+    /// recording is rewound to the frame and continues from there, if it
+    /// records another movie, that movie is cut.
+    ///
+    /// @param emulator the emulator to seek, it must run the movie's ROM
+    /// @param frame the number of frames of the movie to be in the state
+    /// after, at most size()
+    /// @throws std::invalid_argument if the frame is past the end of the
+    /// movie or the emulator runs another ROM
+    ///
+    void seek(Emulator& emulator, std::size_t frame);
+
+    /// Return the controller bytes of a frame of the movie.
+    ///
+    /// @param frame the index of the frame, below size()
+    /// @param buttons the controller bytes of player 1 and 2 to write
+    /// @throws std::invalid_argument if the frame is past the end
+    ///
+    void get_input(std::size_t frame, NES_Byte* buttons) const;
+
+    /// Write the controller bytes of every frame of the movie.
+    ///
+    /// @param inputs the (size(), 2) row-major controller bytes to write
+    ///
+    void get_inputs(NES_Byte* inputs) const;
+
+    /// Return the number of frames in the movie.
+    inline std::size_t size() const { return frames; }
+
+    /// Return the number of runs of frames that hold the same buttons.
+    inline std::size_t num_runs() const { return runs.size(); }
+
+    /// Return the number of keyframe states in the movie.
+    inline std::size_t num_keyframes() const { return keyframes.size(); }
+
+    /// Return the number of bytes of the runs and keyframe pages.
+    inline std::size_t nbytes() const { return runs.size() * sizeof(Run) + pool.nbytes(); }
+
+    /// Return the number of frames between keyframes.
+    inline int get_keyframe_interval() const { return keyframe_interval; }
+
+ private:
+    /// The state after a number of frames, stored in the pool
+    struct Keyframe {
+        /// the number of frames before the state
+        uint64_t frame;
+        /// the snapshot of the state in the pool
+        SnapshotPool::Handle handle;
+    };
+
+    /// A run of consecutive frames that hold the same buttons
+    struct Run {
+        /// the index of the first frame of the run
+        uint64_t first;
+        /// the number of frames in the run
+        uint64_t length;
+        /// the controller bytes of player 1 and 2
+        NES_Byte buttons[2];
+    };
+
+    /// the number of frames between keyframes
+    int keyframe_interval;
+    /// the runs of the inputs in order of frame
+    std::vector<Run> runs;
+    /// the number of frames in the movie
+    std::size_t frames;
+    /// the keyframes in order of frame, one every keyframe_interval frames
+    /// after the start and after each cut
+    std::vector<Keyframe> keyframes;
+    /// the pool of keyframe states, each a delta to the previous keyframe
+    SnapshotPool pool;
+    /// the hash of the ROM the movie was recorded on
+    uint64_t rom_hash;
+    /// the emulator recording the movie, nullptr if not recording
+    Emulator* recorder;
+    /// whether the movie was cut since the last frame (ends the last run)
+    bool is_cut;
+
+    /// Remove every frame and keyframe from the movie.
+    void clear();
+
+    /// Remove the frames after a frame, and the keyframes after it.
+    ///
+    /// @param frame the number of frames to keep
+    ///
+    void truncate(std::size_t frame);
+
+    /// Return the index of the run that holds a frame.
+    ///
+    /// @param frame the index of the frame, below size()
+    /// @return the index of the run of the frame
+    ///
+    std::size_t find_run(std::size_t frame) const;
+
+    /// Return the index of the last keyframe at or before a frame.
+    ///
+    /// @param frame the number of frames, at most size()
+    /// @return the index of the keyframe to replay the frame from
+    ///
+    std::size_t find_keyframe(std::size_t frame) const;
+};
+
+}  // namespace NES
+
+#endif  // MOVIE_HPP
@@ -0,0 +1,160 @@
+//  Program:      nes-py
+//  File:         observation.hpp
+//  Description:  A pipeline that preprocesses screens into stacked frames
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef OBSERVATION_HPP
+#define OBSERVATION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.hpp"
+#include "ppu.hpp"
+
+namespace NES {
+
+/// The configuration of an observation pipeline
+struct ObservationConfig {
+    /// the first row of the screen to keep
+    int crop_top = 0;
+    /// the first column of the screen to keep
+    int crop_left = 0;
+    /// the number of rows of the screen to keep
+    int crop_height = VISIBLE_SCANLINES;
+    /// the number of columns of the screen to keep
+    int crop_width = SCANLINE_VISIBLE_DOTS;
+    /// the number of rows in an output frame
+    int height = 84;
+    /// the number of columns in an output frame
+    int width = 84;
+    /// the number of frames to stack
+    int frames = 4;
+};
+
+/// A pipeline that converts screens to grayscale, crops them, resizes them
+/// by area averaging, and stacks the last frames.
+///
+/// The stack is kept in a ring of 2 x frames slots where each frame is
+/// written to slot i and i + frames, so the last frames are always
+/// contiguous from oldest to newest and are read without a copy.
+///
+class ObservationPipeline {
+ public:
+    /// Initialize a new observation pipeline.
+    ///
+    /// @param config the crop, size, and number of frames of the pipeline
+    /// @throws std::invalid_argument if the crop isn't inside the screen or
+    /// a size is not positive
+    ///
+    explicit ObservationPipeline(const ObservationConfig& config);
+
+    /// Initialize a new observation pipeline that writes to external memory.
+    ///
+    /// @param config the crop, size, and number of frames of the pipeline
+    /// @param ring the memory of 2 x stack_size() bytes to keep the ring of
+    /// frames in, it must outlive the pipeline
+    /// @throws std::invalid_argument if the crop isn't inside the screen or
+    /// a size is not positive
+    ///
+    ObservationPipeline(const ObservationConfig& config, NES_Byte* ring);
+
+    ObservationPipeline(const ObservationPipeline&) = delete;
+    ObservationPipeline& operator=(const ObservationPipeline&) = delete;
+    ObservationPipeline(ObservationPipeline&&) = default;
+    ObservationPipeline& operator=(ObservationPipeline&&) = default;
+
+    /// Return the configuration of the pipeline.
+    inline const ObservationConfig& get_config() const { return config; }
+
+    /// Return the number of bytes in a single output frame.
+    inline std::size_t frame_size() const { return config.height * config.width; }
+
+    /// Return the number of bytes in the stack of frames.
+    inline std::size_t stack_size() const { return config.frames * frame_size(); }
+
+    /// Return the (frames, height, width) stack from oldest to newest frame.
+    inline const NES_Byte* get_stack() const {
+        return ring + (head + 1) * frame_size();
+    }
+
+    /// Fill every frame of the stack with a screen, e.g., after a reset.
+    /// The slot of the newest frame doesn't change, so pipelines that push
+    /// in lockstep keep their stacks at the same offset in their rings.
+    ///
+    /// @param screen the screen to fill the stack with
+    ///
+    void reset(const NESFrameBufferT& screen);
+
+    /// Fill every frame of the stack with a screen of palette indexes.
+    ///
+    /// @param screen the screen of palette indexes to fill the stack with
+    ///
+    void reset(const NESIndexBufferT& screen);
+
+    /// Push a screen onto the stack and drop the oldest frame.
+    ///
+    /// @param screen the screen to push onto the stack
+    ///
+    void push(const NESFrameBufferT& screen);
+
+    /// Push a screen of palette indexes onto the stack and drop the oldest
+    /// frame, the grayscale of each index comes from a lookup table.
+    ///
+    /// @param screen the screen of palette indexes to push onto the stack
+    ///
+    void push(const NESIndexBufferT& screen);
+
+ private:
+    /// The overlap of a source row or column with an output row or column
+    struct Tap {
+        /// the index of the source row or column
+        int source;
+        /// the overlap in units of 1 / (output size) source pixels
+        uint32_t weight;
+    };
+
+    /// the configuration of the pipeline
+    ObservationConfig config;
+    /// the taps of each output column, indexed by tap_begin_x
+    std::vector<Tap> taps_x;
+    /// the first tap of each output column (and one past the last)
+    std::vector<int> tap_begin_x;
+    /// the taps of each output row, indexed by tap_begin_y
+    std::vector<Tap> taps_y;
+    /// the first tap of each output row (and one past the last)
+    std::vector<int> tap_begin_y;
+    /// the grayscale pixels of a cropped source row
+    std::vector<uint16_t> luma;
+    /// the weighted sum of the source rows of an output row
+    std::vector<uint32_t> sum;
+    /// the memory of the ring if the pipeline owns it
+    std::vector<NES_Byte> storage;
+    /// the ring of 2 x frames slots of output frames
+    NES_Byte* ring;
+    /// the slot of the newest frame in the lower half of the ring
+    int head;
+
+    /// Convert a screen to an output frame.
+    ///
+    /// @tparam Pixel the type of the pixels of the screen (RGB or index)
+    /// @param screen the screen to convert
+    /// @param frame the output frame to write
+    ///
+    template <typename Pixel>
+    void convert(const Pixel (&screen)[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS], NES_Byte* frame);
+
+    /// Fill every frame of the stack with a screen.
+    template <typename Pixel>
+    void fill(const Pixel (&screen)[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS]);
+
+    /// Push a screen onto the stack and drop the oldest frame.
+    template <typename Pixel>
+    void advance(const Pixel (&screen)[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS]);
+};
+
+}  // namespace NES
+
+#endif  // OBSERVATION_HPP
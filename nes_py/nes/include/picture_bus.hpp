@@ -8,10 +8,12 @@
 #ifndef PICTURE_BUS_HPP
 #define PICTURE_BUS_HPP
 
+#include <array>
 #include <vector>
 #include <cstdlib>
 #include "common.hpp"
 #include "mapper.hpp"
+#include "state.hpp"
 
 namespace NES {
 
@@ -26,10 +28,20 @@ class PictureBus {
     static_vector<NES_Byte, 0x20> palette;
     /// a pointer to the mapper on the cartridge
     Mapper* mapper;
+    /// the 1KB pages of the pattern tables that reads access directly (null
+    /// pages are handled by the mapper)
+    std::array<const NES_Byte*, CHR_PAGES> chr_pages;
+
+    /// Read a byte from the name tables or palette.
+    ///
+    /// @param address the 16-bit address of the byte to read, above $1FFF
+    /// @return the byte located at the given address
+    ///
+    NES_Byte read_unmapped(NES_Address address);
 
  public:
     /// Initialize a new picture bus.
-    PictureBus() : mapper(nullptr) { }
+    PictureBus() : mapper(nullptr) { chr_pages.fill(nullptr); }
 
     /// Read a byte from an address on the VRAM.
     ///
@@ -37,7 +49,14 @@ class PictureBus {
     ///
     /// @return the byte located at the given address
     ///
-    NES_Byte read(NES_Address address);
+    inline NES_Byte read(NES_Address address) {
+        if (address < 0x2000) {
+            const NES_Byte* page = chr_pages[address / CHR_PAGE_SIZE];
+            if (page) return page[address % CHR_PAGE_SIZE];
+            return mapper->readCHR(address);
+        }
+        return read_unmapped(address);
+    }
 
     /// Write a byte to an address in the VRAM.
     ///
@@ -46,12 +65,27 @@ class PictureBus {
     ///
     void write(NES_Address address, NES_Byte value);
 
+    /// Save the memory of the bus.
+    ///
+    /// @param state the state to save the memory to
+    ///
+    void save(PictureBusState& state) const;
+
+    /// Load the memory of the bus.
+    ///
+    /// @param state the state to load the memory from
+    ///
+    void load(const PictureBusState& state);
+
     /// Set the mapper pointer to a new value.
     ///
     /// @param mapper the new mapper pointer for the bus to use
     ///
     inline void set_mapper(Mapper *mapper) {
-        this->mapper = mapper; update_mirroring();
+        this->mapper = mapper;
+        update_mirroring();
+        // the mapper patches the page table on bank switches
+        mapper->set_chr_pages(chr_pages.data());
     }
 
     /// Read a color index from the palette.
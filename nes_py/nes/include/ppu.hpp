@@ -9,7 +9,10 @@
 #define PPU_HPP
 
 #include "common.hpp"
+#include "counters.hpp"
+#include "palette.hpp"
 #include "picture_bus.hpp"
+#include "state.hpp"
 #include <array>
 
 namespace NES {
@@ -26,16 +29,51 @@ const int SCANLINE_END_CYCLE = 341;
 const int FRAME_END_SCANLINE = 261;
 
 typedef NES_Pixel NESFrameBufferT[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS];
+/// A screen of 6-bit palette indexes (i.e., NES colors) instead of pixels
+typedef NES_Byte NESIndexBufferT[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS];
+
+/// Convert a screen of palette indexes to RGB pixels.
+///
+/// @param indexes the screen of palette indexes to convert
+/// @param screen the screen to write the RGB pixels to
+///
+void convert_indexes(const NESIndexBufferT& indexes, NESFrameBufferT& screen);
 
 /// The Picture Processing Unit (PPU) for the NES
 class PPU {
+ public:
+    /// The modes for rendering pixels to the screen
+    enum RenderMode {
+        /// render each pixel on the dot that outputs it (reference mode)
+        RENDER_DOT,
+        /// render the pixels of a scanline in batches when they're observed
+        RENDER_SCANLINE,
+    };
+
+    /// The formats for writing pixels to the screen
+    enum PixelFormat {
+        /// write the RGB pixel of each dot to the screen
+        PIXEL_RGB,
+        /// write the palette index of each dot to an index screen
+        PIXEL_INDEXED,
+    };
+
  private:
     /// The callback to fire when entering vertical blanking mode
     std::function<void(void)> vblank_callback;
     /// The OAM memory (sprites)
     static_vector<NES_Byte, 64 * 4> sprite_memory;
-    /// OAM memory (sprites) for the next scanline
-    static_vector<NES_Byte, 8> scanline_sprites;
+    /// The sprites on each scanline in OAM order (at most 8 each), evaluated
+    /// once per change of the OAM memory instead of on every scanline
+    NES_Byte sprite_table[VISIBLE_SCANLINES][8];
+    /// the number of sprites on each scanline of the sprite table
+    NES_Byte sprite_table_sizes[VISIBLE_SCANLINES];
+    /// whether the OAM memory changed since the sprite table was built
+    bool is_sprite_table_stale = true;
+    /// the first sprite the sprite table was evaluated from
+    NES_Byte sprite_table_first = 0;
+    /// whether the sprite table was evaluated for 8 x 16 sprites
+    bool is_sprite_table_long = false;
 
     /// The current pipeline state of the PPU
     enum State {
@@ -101,16 +139,238 @@ class PPU {
     /// The value to increment the data address by
     NES_Address data_address_increment;
 
+    // Rendering
+
+    /// the mode for rendering pixels to the screen
+    RenderMode render_mode;
+    /// the x coordinate of the next pixel to render on the current scanline
+    int render_x;
+    /// the screen to write palette indexes to, null to write RGB pixels
+    NESIndexBufferT* index_screen;
+    /// whether to skip composing pixels in scanline mode (headless frames)
+    bool is_skipping_pixels;
+#if defined(NES_COUNTERS)
+    /// the counters to update (only in builds with counters)
+    Counters* counters = nullptr;
+#endif
+
+    /// Count dots of the current scanline as rendering or vertical blank.
+    ///
+    /// @param dots the number of dots to count
+    ///
+#if defined(NES_COUNTERS)
+    inline void count_dots(int dots) {
+        if (pipeline_state == PRE_RENDER || pipeline_state == RENDER)
+            NES_COUNT(counters, rendering_dots += dots);
+        else
+            NES_COUNT(counters, vblank_dots += dots);
+    }
+#else
+    inline void count_dots(int) { }
+#endif
+
+    /// Write the color of a pixel to the screen in the pixel format.
+    ///
+    /// @param screen the screen to write RGB pixels to
+    /// @param y the y coordinate of the pixel
+    /// @param x the x coordinate of the pixel
+    /// @param color the palette index of the color of the pixel
+    ///
+    inline void write_pixel(NESFrameBufferT* const screen, int y, int x, NES_Byte color) {
+        if (index_screen != nullptr)
+            (*index_screen)[y][x] = color & 0x3f;
+        else
+            (*screen)[y][x] = PALETTE[color & 0x3f];
+    }
+
+    /// Render the pixel for the current dot.
+    ///
+    /// @param bus the picture bus to read tiles and sprites from
+    /// @param screen the screen to render the pixel to
+    ///
+    void render_dot(PictureBus& bus, NESFrameBufferT* const screen);
+
+    /// Render the pending pixels of the current scanline in one batch.
+    ///
+    /// Each tile row is fetched and decoded once and the sprites are
+    /// composed into a line buffer, the output (including sprite-0 hits and
+    /// coarse X increments) matches rendering the pixels dot by dot.
+    ///
+    /// @param bus the picture bus to read tiles and sprites from
+    /// @param screen the screen to render the pixels to
+    /// @param end the x coordinate to render the pixels up to (exclusive)
+    ///
+    void render_scanline(PictureBus& bus, NESFrameBufferT* const screen, int end);
+
+    /// Advance over the pending pixels of the current scanline without
+    /// composing them.
+    ///
+    /// Only the coarse X increments and the sprite-0 hit of the pixels are
+    /// computed, the background of a tile is only fetched if sprite 0 can
+    /// hit it. The state after matches render_scanline.
+    ///
+    /// @param bus the picture bus to read tiles and sprites from
+    /// @param end the x coordinate to skip the pixels up to (exclusive)
+    ///
+    void skip_scanline(PictureBus& bus, int end);
+
+    /// Evaluate the sprites on every scanline into the sprite table.
+    ///
+    /// Each sprite is binned into the scanlines it covers, which matches
+    /// scanning the OAM memory from the first sprite at the end of every
+    /// scanline, until the OAM memory, OAM address, or sprite height
+    /// changes.
+    ///
+    void build_sprite_table();
+
+    /// Return the number of sprites on the current scanline. They are the
+    /// row of the scanline above in the sprite table, as sprites are drawn
+    /// a scanline below their Y coordinate, so the first has none.
+    ///
+    /// @return the number of sprites in sprite_table[scanline - 1]
+    ///
+    inline int get_scanline_sprite_count() const {
+        return scanline > 0 ? sprite_table_sizes[scanline - 1] : 0;
+    }
+
+    /// Fetch the pattern of a sprite on the current scanline.
+    ///
+    /// @param bus the picture bus to read the pattern from
+    /// @param index the index of the sprite in the OAM memory
+    /// @param low the low bit plane of the pattern row to write
+    /// @param high the high bit plane of the pattern row to write
+    ///
+    void fetch_sprite_pattern(PictureBus& bus, NES_Byte index, NES_Byte& low, NES_Byte& high);
+
+    /// Return the number of upcoming cycles that only advance the dot.
+    ///
+    /// @return the number of calls to cycle before one changes the state
+    ///
+    int idle_cycles() const;
+
  public:
     /// Initialize a new PPU.
-    PPU() { }
+    PPU() :
+        render_mode(RENDER_SCANLINE),
+        render_x(0),
+        index_screen(nullptr),
+        is_skipping_pixels(false) { }
 
     /// Perform a single cycle on the PPU.
     void cycle(PictureBus& bus, NESFrameBufferT* const screen);
 
+    /// Perform a number of cycles on the PPU.
+    ///
+    /// The dots between the ones that change the state of the PPU are
+    /// skipped at once, the result matches calling cycle for each dot.
+    ///
+    /// @param bus the picture bus to read tiles and sprites from
+    /// @param screen the screen to render pixels to
+    /// @param count the number of cycles to perform
+    ///
+    void run(PictureBus& bus, NESFrameBufferT* const screen, int count);
+
+    /// Return the number of cycles until the PPU interrupts the CPU.
+    ///
+    /// The result holds until the registers of the PPU change.
+    ///
+    /// @return the number of calls to cycle up to and including the one that
+    /// fires the vertical blank interrupt, or -1 if interrupts are disabled
+    ///
+    int cycles_until_interrupt() const;
+
+    /// Return the number of cycles the status register keeps its value for.
+    ///
+    /// The status changes when its flags clear on the pre-render line, when
+    /// vertical blank starts, and when sprite 0 hits on the scanlines it
+    /// covers. The result is a lower bound that holds until the registers or
+    /// the OAM memory of the PPU change.
+    ///
+    /// @param elapsed the number of past cycles the status must have kept its
+    /// value for
+    /// @return the number of upcoming calls to cycle the status keeps its
+    /// value for, or -1 if it can have changed in the elapsed cycles
+    ///
+    int cycles_until_status_change(int elapsed) const;
+
     /// Reset the PPU.
     void reset();
 
+    /// Render the pixels pending up to the current dot.
+    ///
+    /// In scanline mode this must be called before anything that changes or
+    /// observes the rendering state, i.e., PPU register accesses, OAM DMA,
+    /// and mapper writes.
+    ///
+    /// @param bus the picture bus to read tiles and sprites from
+    /// @param screen the screen to render the pixels to
+    ///
+    void sync(PictureBus& bus, NESFrameBufferT* const screen);
+
+    /// Return the mode for rendering pixels to the screen.
+    inline RenderMode get_render_mode() const { return render_mode; }
+
+    /// Set the mode for rendering pixels to the screen.
+    ///
+    /// @param mode the new mode to render pixels with
+    /// @param bus the picture bus to read tiles and sprites from
+    /// @param screen the screen to render pending pixels to
+    ///
+    void set_render_mode(RenderMode mode, PictureBus& bus, NESFrameBufferT* const screen);
+
+    /// Return true if the PPU skips composing pixels in scanline mode.
+    inline bool get_is_skipping_pixels() const { return is_skipping_pixels; }
+
+    /// Set whether the PPU skips composing pixels in scanline mode.
+    ///
+    /// While skipping, the screen isn't written but the scroll, sprite
+    /// evaluation, and sprite-0 hits match rendering. Dot mode (the
+    /// reference) always renders.
+    ///
+    /// @param is_skipping whether to skip composing pixels
+    /// @param bus the picture bus to read tiles and sprites from
+    /// @param screen the screen to render pending pixels to
+    ///
+    void set_is_skipping_pixels(bool is_skipping, PictureBus& bus, NESFrameBufferT* const screen);
+
+    /// Return the format the PPU writes pixels in.
+    inline PixelFormat get_pixel_format() const {
+        return index_screen == nullptr ? PIXEL_RGB : PIXEL_INDEXED;
+    }
+
+    /// Set the format the PPU writes pixels in.
+    ///
+    /// @param indexes the screen to write palette indexes to, null to write
+    /// RGB pixels to the screen passed to cycle, run, and sync
+    /// @param bus the picture bus to read tiles and sprites from
+    /// @param screen the screen to render pending pixels to
+    ///
+    void set_index_screen(NESIndexBufferT* const indexes, PictureBus& bus, NESFrameBufferT* const screen);
+
+    /// Save the registers and sprite memory of the PPU.
+    ///
+    /// @param state the state to save the registers to
+    ///
+    void save(PPUState& state) const;
+
+    /// Load the registers and sprite memory of the PPU.
+    ///
+    /// @param state the state to load the registers from
+    ///
+    void load(const PPUState& state);
+
+    /// Return true if the registers of a state are in range for the PPU.
+    ///
+    /// @param state the state to check the registers of
+    /// @return true if the state can be loaded safely, false otherwise
+    ///
+    static bool is_valid(const PPUState& state);
+
+#if defined(NES_COUNTERS)
+    /// Set the counters for the PPU to update.
+    inline void set_counters(Counters* counters_) { counters = counters_; }
+#endif
+
     /// Set the interrupt callback for the CPU.
     inline void set_interrupt_callback(std::function<void(void)> cb) {
         vblank_callback = cb;
@@ -176,6 +436,7 @@ class PPU {
     ///
     inline void set_OAM_data(NES_Byte value) {
         sprite_memory[sprite_data_address++] = value;
+        is_sprite_table_stale = true;
     }
 };
 
@@ -0,0 +1,188 @@
+//  Program:      nes-py
+//  File:         reward.hpp
+//  Description:  A compiled program of rewards and terminations over RAM
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef REWARD_HPP
+#define REWARD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "common.hpp"
+
+namespace NES {
+
+/// The encodings of numbers stored across RAM bytes
+enum class RAMEncoding : int {
+    /// each byte is a base 256 digit, i.e., little-endian binary
+    BINARY = 0,
+    /// each byte is a base 10 digit, e.g., the score digits of a game
+    DIGITS = 1,
+    /// each byte is 2 base 10 digits in its nibbles, i.e., packed BCD
+    BCD = 2,
+};
+
+/// The comparisons of a condition
+enum class Comparison : int {
+    EQUAL = 0,
+    NOT_EQUAL = 1,
+    LESS = 2,
+    LESS_EQUAL = 3,
+    GREATER = 4,
+    GREATER_EQUAL = 5,
+};
+
+/// A declarative specification of the reward, termination, and info of a
+/// game over its RAM, built with the add functions that return the index
+/// of what they add.
+struct RewardSpec {
+    /// A number decoded from RAM bytes
+    struct Value {
+        /// the addresses of the bytes from the least significant digit
+        std::vector<NES_Address> addresses;
+        /// the encoding of the bytes
+        RAMEncoding encoding;
+    };
+
+    /// A comparison of a value (or its change since the last frame) with a
+    /// constant
+    struct Condition {
+        /// the index of the value to compare
+        std::size_t value;
+        /// whether to compare the change of the value since the last frame
+        bool is_delta;
+        /// the comparison to apply
+        Comparison comparison;
+        /// the constant to compare with
+        int64_t operand;
+    };
+
+    /// A weighted and clipped term of the reward
+    struct Term {
+        /// whether the term is a condition (1 if true, 0 otherwise) instead
+        /// of a value
+        bool is_condition;
+        /// the index of the value or condition
+        std::size_t index;
+        /// whether the term is the change of the value since the last frame
+        bool is_delta;
+        /// the weight to multiply the term by
+        double weight;
+        /// the least weighted term
+        double low;
+        /// the greatest weighted term
+        double high;
+    };
+
+    /// the values, in the order of the info of each frame
+    std::vector<Value> values;
+    /// the conditions of the terms and terminations
+    std::vector<Condition> conditions;
+    /// the terms whose sum is the reward
+    std::vector<Term> terms;
+    /// the conditions that terminate the episode if any is true
+    std::vector<std::size_t> terminations;
+    /// the least reward
+    double low = -std::numeric_limits<double>::infinity();
+    /// the greatest reward
+    double high = std::numeric_limits<double>::infinity();
+
+    /// Add a value decoded from RAM bytes and return its index.
+    inline std::size_t add_value(const std::vector<NES_Address>& addresses, RAMEncoding encoding) {
+        values.push_back({addresses, encoding});
+        return values.size() - 1;
+    }
+
+    /// Add a condition over a value and return its index.
+    inline std::size_t add_condition(std::size_t value, bool is_delta, Comparison comparison, int64_t operand) {
+        conditions.push_back({value, is_delta, comparison, operand});
+        return conditions.size() - 1;
+    }
+
+    /// Add a term of the reward.
+    inline void add_term(bool is_condition, std::size_t index, bool is_delta, double weight, double low, double high) {
+        terms.push_back({is_condition, index, is_delta, weight, low, high});
+    }
+
+    /// Add a condition that terminates the episode.
+    inline void add_termination(std::size_t condition) {
+        terminations.push_back(condition);
+    }
+};
+
+/// A reward specification compiled to a flat program over the RAM that
+/// evaluates the reward, termination, and info of a frame. The program
+/// keeps the values of the last frame for the deltas, so each emulator
+/// needs its own program.
+class RewardProgram {
+ public:
+    /// The most bytes of a value
+    static const std::size_t MAX_VALUE_BYTES = 8;
+
+    /// Compile a reward specification.
+    ///
+    /// @param spec the specification to compile
+    /// @throws std::invalid_argument if an address is outside the RAM, a
+    /// value has no bytes or too many, or an index or clip is invalid
+    ///
+    explicit RewardProgram(const RewardSpec& spec);
+
+    /// Return the specification of the program.
+    inline const RewardSpec& get_spec() const { return spec; }
+
+    /// Return the number of values in the info of each frame.
+    inline std::size_t num_values() const { return spec.values.size(); }
+
+    /// Start an episode from the RAM, the deltas of the next frame are
+    /// relative to it.
+    ///
+    /// @param ram the 0x800 bytes of RAM to read
+    /// @param info the num_values() values to write
+    ///
+    void reset(const NES_Byte* ram, int64_t* info);
+
+    /// Evaluate a frame from the RAM after it.
+    ///
+    /// @param ram the 0x800 bytes of RAM to read
+    /// @param reward the reward to write
+    /// @param done the termination to write (1 if terminated, 0 otherwise)
+    /// @param info the num_values() values to write
+    ///
+    void evaluate(const NES_Byte* ram, float* reward, NES_Byte* done, int64_t* info);
+
+ private:
+    /// A load of a RAM byte into a value
+    struct Load {
+        /// the address of the byte
+        NES_Address address;
+        /// whether the byte is packed BCD
+        bool is_bcd;
+        /// the place value of the byte in the value
+        int64_t scale;
+    };
+
+    /// the specification of the program
+    RewardSpec spec;
+    /// the loads of every value, in order of value
+    std::vector<Load> loads;
+    /// the index of the first load of each value (and one past the last)
+    std::vector<std::size_t> load_begin;
+    /// the values of the current frame
+    std::vector<int64_t> current;
+    /// the values of the last frame
+    std::vector<int64_t> previous;
+
+    /// Decode the values from the RAM into current.
+    void decode(const NES_Byte* ram);
+
+    /// Return whether a condition holds for the current values.
+    bool test(const RewardSpec::Condition& condition) const;
+};
+
+}  // namespace NES
+
+#endif  // REWARD_HPP
@@ -0,0 +1,82 @@
+//  Program:      nes-py
+//  File:         rom_image.hpp
+//  Description:  A read-only ROM file image shared between emulators
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef ROM_IMAGE_HPP
+#define ROM_IMAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "common.hpp"
+
+namespace NES {
+
+/// The read-only bytes of an iNES ROM file.
+///
+/// Images are shared: every emulator that opens the same file (or the same
+/// bytes) references one image, which is memory mapped where the platform
+/// supports it. An image is released when the last reference to it is.
+///
+class ROMImage {
+ private:
+    /// the bytes of the ROM file
+    const NES_Byte* bytes;
+    /// the number of bytes in the ROM file
+    std::size_t length;
+    /// the 64-bit FNV-1a hash of the bytes
+    uint64_t hash;
+    /// the bytes of images that aren't memory mapped
+    std::vector<NES_Byte> buffer;
+    /// whether the bytes are a memory mapping of the file
+    bool is_mapped;
+
+    /// Initialize an empty image, use open or from_buffer to create images.
+    ROMImage() : bytes(nullptr), length(0), hash(0), is_mapped(false) { }
+
+ public:
+    ROMImage(const ROMImage&) = delete;
+    ROMImage& operator=(const ROMImage&) = delete;
+
+    /// Unmap or free the bytes of the image.
+    ~ROMImage();
+
+    /// Return the shared image of a ROM file, loading it if no emulator
+    /// references the current contents of the file.
+    ///
+    /// @param path the path to the ROM file
+    /// @return the image of the ROM file
+    /// @throws std::invalid_argument if the file can't be read
+    ///
+    static std::shared_ptr<const ROMImage> open(const std::string& path);
+
+    /// Return the shared image of a ROM held in memory, copying the bytes
+    /// if no emulator references an image with the same bytes.
+    ///
+    /// @param data the bytes of the ROM file
+    /// @param size the number of bytes of the ROM file
+    /// @return the image of the ROM bytes
+    ///
+    static std::shared_ptr<const ROMImage> from_buffer(const NES_Byte* data, std::size_t size);
+
+    /// Return the bytes of the ROM file.
+    inline const NES_Byte* data() const { return bytes; }
+
+    /// Return the number of bytes of the ROM file.
+    inline std::size_t size() const { return length; }
+
+    /// Return the 64-bit FNV-1a hash of the ROM file.
+    inline uint64_t get_hash() const { return hash; }
+
+    /// Return true if the image is a memory mapping of the ROM file.
+    inline bool get_is_mapped() const { return is_mapped; }
+};
+
+}  // namespace NES
+
+#endif  // ROM_IMAGE_HPP
@@ -0,0 +1,318 @@
+//  Program:      nes-py
+//  File:         shared_batch.hpp
+//  Description:  A batch of emulator outputs in shared memory for workers
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef SHARED_BATCH_HPP
+#define SHARED_BATCH_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "common.hpp"
+#include "vec_emulator.hpp"
+
+namespace NES {
+
+/// Whether shared memory batches are supported (POSIX only)
+#if defined(__unix__) || defined(__APPLE__)
+const bool SHARED_MEMORY_ENABLED = true;
+#else
+const bool SHARED_MEMORY_ENABLED = false;
+#endif
+
+// the queues live in memory mapped by several processes, so their atomics
+// must not fall back to locks that live in one process
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64-bit atomics must be lock-free");
+
+/// A lock-free queue of 64-bit messages between a single producer and a
+/// single consumer, laid out to live in shared memory.
+struct SharedQueue {
+    /// The number of messages the queue holds
+    static const std::size_t CAPACITY = 64;
+
+    /// the number of messages popped, written by the consumer only
+    alignas(64) std::atomic<uint64_t> head;
+    /// the number of messages pushed, written by the producer only
+    alignas(64) std::atomic<uint64_t> tail;
+    /// the ring of messages
+    alignas(64) uint64_t messages[CAPACITY];
+
+    /// Push a message unless the queue is full.
+    ///
+    /// @param message the message to push
+    /// @return true if the message was pushed
+    ///
+    inline bool try_push(uint64_t message) {
+        const uint64_t index = tail.load(std::memory_order_relaxed);
+        if (index - head.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+        messages[index % CAPACITY] = message;
+        tail.store(index + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Pop a message unless the queue is empty.
+    ///
+    /// @param message the message to write
+    /// @return true if a message was popped
+    ///
+    inline bool try_pop(uint64_t& message) {
+        const uint64_t index = head.load(std::memory_order_relaxed);
+        if (index == tail.load(std::memory_order_acquire))
+            return false;
+        message = messages[index % CAPACITY];
+        head.store(index + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/// A batch of emulator outputs in a POSIX shared memory segment that worker
+/// processes step into and a client reads without copies.
+///
+/// The segment holds a ring of slots. Each slot has the actions, the
+/// observations (RGB screens or stacks of frames), the RAM, and the
+/// rewards, terminations, and info of the whole batch. Each worker hosts a
+/// contiguous range of the emulators of the batch in a VecEmulator and has
+/// a channel of two SPSC queues: the client pushes requests (reset or step
+/// into a slot) and the worker pushes completions when its range of the
+/// slot is written. A slot stays intact until the client requests it
+/// again, so the client reads a slot while the workers step into another.
+///
+class SharedBatch {
+ public:
+    /// The commands of the requests to a worker
+    enum Command : uint64_t {
+        /// reset every emulator of the worker into a slot
+        RESET = 0,
+        /// reset a single emulator into a slot
+        RESET_ONE = 1,
+        /// step every emulator of the worker into a slot
+        STEP = 2,
+        /// stop serving
+        STOP = 3,
+    };
+
+    /// The states of a worker
+    enum Status : uint32_t {
+        /// the worker hasn't attached
+        STARTING = 0,
+        /// the worker is serving requests
+        READY = 1,
+        /// the worker failed to start, the channel has the error message
+        FAILED = 2,
+        /// the worker stopped serving
+        STOPPED = 3,
+    };
+
+    /// The number of bytes of the error message of a channel
+    static const std::size_t ERROR_SIZE = 256;
+
+    /// Create a new shared memory segment for a batch.
+    ///
+    /// @param name the name of the segment, starting with a slash
+    /// @param num_emulators the number of emulators in the batch
+    /// @param observation_size the number of bytes in the observation of
+    /// an emulator
+    /// @param num_info_values the number of info values of an emulator
+    /// @param num_workers the number of worker processes
+    /// @param slots the number of slots in the ring
+    /// @throws std::invalid_argument if a size is zero or the segment can't
+    /// be created
+    ///
+    static std::unique_ptr<SharedBatch> create(
+        const std::string& name,
+        std::size_t num_emulators,
+        std::size_t observation_size,
+        std::size_t num_info_values,
+        std::size_t num_workers,
+        std::size_t slots
+    );
+
+    /// Attach to the shared memory segment of a batch.
+    ///
+    /// @param name the name of the segment, starting with a slash
+    /// @throws std::invalid_argument if the segment doesn't exist or isn't
+    /// a batch
+    ///
+    static std::unique_ptr<SharedBatch> attach(const std::string& name);
+
+    SharedBatch(const SharedBatch&) = delete;
+    SharedBatch& operator=(const SharedBatch&) = delete;
+
+    /// Unmap the segment (and unlink it if created and not unlinked yet).
+    ~SharedBatch();
+
+    /// Remove the name of the segment, the memory stays mapped until every
+    /// process unmaps it.
+    void unlink();
+
+    /// Return the name of the segment.
+    inline const std::string& get_name() const { return name; }
+
+    /// Return the number of emulators in the batch.
+    inline std::size_t size() const { return header->num_emulators; }
+
+    /// Return the number of bytes in the observation of an emulator.
+    inline std::size_t observation_size() const { return header->observation_size; }
+
+    /// Return the number of info values of an emulator.
+    inline std::size_t num_info_values() const { return header->num_info_values; }
+
+    /// Return the number of worker processes.
+    inline std::size_t num_workers() const { return header->num_workers; }
+
+    /// Return the number of slots in the ring.
+    inline std::size_t num_slots() const { return header->slots; }
+
+    /// Return the index of the first emulator of a worker in the batch.
+    inline std::size_t worker_begin(std::size_t worker) const {
+        return worker * size() / num_workers();
+    }
+
+    /// Return one past the index of the last emulator of a worker.
+    inline std::size_t worker_end(std::size_t worker) const {
+        return worker_begin(worker + 1);
+    }
+
+    /// Return a pointer to the (N, 2) actions of a slot.
+    inline NES_Byte* get_actions(std::size_t slot) { return region(slot, 0); }
+
+    /// Return a pointer to the (N, observation_size()) observations of a slot.
+    inline NES_Byte* get_observations(std::size_t slot) { return region(slot, 1); }
+
+    /// Return a pointer to the (N, 0x800) RAM buffers of a slot.
+    inline NES_Byte* get_memory(std::size_t slot) { return region(slot, 2); }
+
+    /// Return a pointer to the (N,) rewards of a slot.
+    inline float* get_rewards(std::size_t slot) {
+        return reinterpret_cast<float*>(region(slot, 3));
+    }
+
+    /// Return a pointer to the (N,) terminations of a slot.
+    inline NES_Byte* get_dones(std::size_t slot) { return region(slot, 4); }
+
+    /// Return a pointer to the (N, num_info_values()) info values of a slot.
+    inline int64_t* get_infos(std::size_t slot) {
+        return reinterpret_cast<int64_t*>(region(slot, 5));
+    }
+
+    /// Return the status of a worker.
+    inline Status get_status(std::size_t worker) const {
+        return static_cast<Status>(channels[worker].status.load(std::memory_order_acquire));
+    }
+
+    /// Return the error message of the last failed request of a worker.
+    inline std::string get_error(std::size_t worker) const {
+        return std::string(channels[worker].error);
+    }
+
+    /// Push a request to a worker, waiting while its queue is full.
+    ///
+    /// @param worker the index of the worker
+    /// @param command the command to run
+    /// @param slot the slot to read the actions from and write the outputs to
+    /// @param index the index of the emulator in the batch for RESET_ONE
+    ///
+    void request(std::size_t worker, Command command, std::size_t slot, std::size_t index = 0);
+
+    /// Wait for the completion of the oldest request to a worker.
+    ///
+    /// @param worker the index of the worker
+    /// @param timeout the number of milliseconds to wait for
+    /// @return the slot of the request, or -1 if the wait timed out
+    /// @throws std::runtime_error with the error of the worker if the
+    /// request failed
+    ///
+    int64_t wait(std::size_t worker, int64_t timeout);
+
+    /// Serve the requests of a worker until a STOP request or until the
+    /// process that started the worker exits. The batch of emulators must
+    /// match the range of the worker and the observation and info sizes of
+    /// the segment.
+    ///
+    /// @param vec the emulators of the worker
+    /// @param worker the index of the worker
+    /// @throws std::invalid_argument if the emulators don't match the segment
+    ///
+    void serve(VecEmulator& vec, std::size_t worker);
+
+ private:
+    /// The 64-bit word identifying a batch segment ("NESBATCH")
+    static const uint64_t MAGIC = 0x484354414253454eULL;
+    /// The number of regions of a slot
+    static const std::size_t REGIONS = 6;
+
+    /// The header at the start of the segment
+    struct Header {
+        /// the MAGIC word, written last by the creator
+        std::atomic<uint64_t> magic;
+        /// the number of bytes in the segment
+        uint64_t bytes;
+        /// the number of emulators in the batch
+        uint64_t num_emulators;
+        /// the number of bytes in the observation of an emulator
+        uint64_t observation_size;
+        /// the number of info values of an emulator
+        uint64_t num_info_values;
+        /// the number of worker processes
+        uint64_t num_workers;
+        /// the number of slots in the ring
+        uint64_t slots;
+        /// the byte offset of every region of slot 0 from the segment start
+        uint64_t offsets[REGIONS];
+        /// the number of bytes between adjacent slots
+        uint64_t slot_size;
+    };
+
+    /// The queues and status of a worker
+    struct Channel {
+        /// the requests from the client to the worker
+        SharedQueue requests;
+        /// the completions from the worker to the client
+        SharedQueue completions;
+        /// the Status of the worker
+        alignas(64) std::atomic<uint32_t> status;
+        /// the error message of the last failed request
+        char error[ERROR_SIZE];
+    };
+
+    /// the name of the segment
+    std::string name;
+    /// whether this process created the segment and hasn't unlinked it
+    bool is_owner;
+    /// the start of the mapped segment
+    void* base;
+    /// the number of bytes mapped
+    std::size_t bytes;
+    /// the header of the segment
+    Header* header;
+    /// the channels of the workers
+    Channel* channels;
+
+    /// Initialize a new mapping of a segment.
+    SharedBatch(const std::string& name, bool is_owner, void* base, std::size_t bytes);
+
+    /// Return a pointer to a region of a slot.
+    inline NES_Byte* region(std::size_t slot, std::size_t region) {
+        return static_cast<NES_Byte*>(base) + header->offsets[region] + slot * header->slot_size;
+    }
+
+    /// Copy the outputs of emulators of a worker into a slot.
+    ///
+    /// @param vec the emulators of the worker
+    /// @param begin the index of the first emulator of the worker in the batch
+    /// @param first the index of the first emulator in vec to copy
+    /// @param count the number of emulators to copy
+    /// @param slot the slot to copy the outputs to
+    ///
+    void write_outputs(VecEmulator& vec, std::size_t begin, std::size_t first, std::size_t count, std::size_t slot);
+};
+
+}  // namespace NES
+
+#endif  // SHARED_BATCH_HPP
@@ -0,0 +1,158 @@
+//  Program:      nes-py
+//  File:         snapshot_pool.hpp
+//  Description:  A pool of emulator snapshots stored as page-level deltas
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef SNAPSHOT_POOL_HPP
+#define SNAPSHOT_POOL_HPP
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.hpp"
+#include "emulator.hpp"
+#include "state.hpp"
+
+namespace NES {
+
+/// A pool of emulator states for tree search that shares unchanged memory.
+///
+/// The state of an emulator is split into pages (the RAM, VRAM, OAM,
+/// character RAM, etc. each span whole pages). A snapshot saved with a
+/// parent only stores the pages that differ from the parent, and restoring
+/// walks up the chain of parents until every page is found. Every
+/// keyframe_interval levels a snapshot stores all of its pages to bound the
+/// length of the chains. Pages of zeros are never stored.
+///
+/// A pool isn't thread safe, use one pool per thread.
+///
+class SnapshotPool {
+ public:
+    /// The type of the opaque handles to snapshots in the pool
+    typedef int64_t Handle;
+    /// The handle for no snapshot (i.e., the parent of a keyframe)
+    static const Handle NONE = -1;
+    /// The number of bytes in a page of state
+    static const std::size_t PAGE_SIZE = 256;
+    /// The number of pages in a state
+    static const std::size_t PAGES = (sizeof(State) + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    /// Initialize a new snapshot pool.
+    ///
+    /// @param keyframe_interval the maximal number of deltas between a
+    /// snapshot and the keyframe it is rebuilt from
+    ///
+    explicit SnapshotPool(int keyframe_interval = 32);
+
+    SnapshotPool(const SnapshotPool&) = delete;
+    SnapshotPool& operator=(const SnapshotPool&) = delete;
+
+    /// Save the state of an emulator to the pool.
+    ///
+    /// @param emulator the emulator to save the state of
+    /// @param parent the snapshot to store the difference to, NONE to
+    /// store a keyframe
+    /// @return the handle of the new snapshot
+    ///
+    Handle save(Emulator& emulator, Handle parent = NONE);
+
+    /// Restore a snapshot in the pool on an emulator.
+    ///
+    /// The screen isn't part of the snapshot, it updates on the next step.
+    ///
+    /// @param handle the handle of the snapshot to restore
+    /// @param emulator the emulator to restore the snapshot on
+    ///
+    void restore(Handle handle, Emulator& emulator);
+
+    /// Release a snapshot, the handle is invalid afterward. The pages of
+    /// the snapshot are kept as long as snapshots derived from it are alive.
+    ///
+    /// @param handle the handle of the snapshot to release
+    ///
+    void release(Handle handle);
+
+    /// Return the number of snapshots that haven't been released.
+    inline std::size_t size() const { return live; }
+
+    /// Return the number of bytes of pages stored in the pool.
+    inline std::size_t nbytes() const { return stored_bytes; }
+
+    /// Return the maximal number of deltas between a snapshot and its keyframe.
+    inline int get_keyframe_interval() const { return keyframe_interval; }
+
+ private:
+    /// A state padded to a whole number of pages
+    struct alignas(State) Buffer {
+        /// the bytes of the state and padding
+        NES_Byte bytes[PAGES * PAGE_SIZE];
+
+        /// Return the state in the buffer.
+        inline State* state() { return reinterpret_cast<State*>(bytes); }
+    };
+
+    /// A snapshot stored in the pool
+    struct Snapshot {
+        /// the snapshot this snapshot stores the difference to
+        Handle parent;
+        /// the number of deltas to the keyframe, 0 for keyframes
+        int depth;
+        /// the number of references (the user and derived snapshots)
+        int references;
+        /// whether the user still holds the handle to this snapshot
+        bool is_live;
+        /// the pages stored by this snapshot
+        std::bitset<PAGES> stored;
+        /// the pages of zeros in this snapshot
+        std::bitset<PAGES> zero;
+        /// the bytes of the stored pages in the order of the page index
+        std::vector<NES_Byte> pages;
+    };
+
+    /// the number of deltas after which a snapshot is stored as keyframe
+    int keyframe_interval;
+    /// the snapshots in the pool, indexed by handle
+    std::vector<Snapshot> snapshots;
+    /// the handles of released snapshots that can be reused
+    std::vector<Handle> free_handles;
+    /// the number of snapshots that haven't been released
+    std::size_t live;
+    /// the number of bytes of pages stored in the pool
+    std::size_t stored_bytes;
+    /// the buffers for the cache and scratch states
+    std::vector<Buffer> buffers;
+    /// the most recently saved or restored state
+    Buffer* cache;
+    /// the handle of the state in the cache
+    Handle cached;
+    /// the buffer for saving new states
+    Buffer* scratch;
+
+    /// Return a snapshot that the user holds the handle of.
+    ///
+    /// @param handle the handle of the snapshot
+    /// @return the snapshot with the given handle
+    ///
+    Snapshot& at(Handle handle);
+
+    /// Rebuild the state of a snapshot from its chain of deltas.
+    ///
+    /// @param handle the handle of the snapshot to rebuild
+    /// @param buffer the buffer to rebuild the state in
+    ///
+    void build(Handle handle, Buffer& buffer) const;
+
+    /// Drop a reference to a snapshot and free it (and its unreferenced
+    /// parents) when no references are left.
+    ///
+    /// @param handle the handle of the snapshot to drop the reference to
+    ///
+    void unreference(Handle handle);
+};
+
+}  // namespace NES
+
+#endif  // SNAPSHOT_POOL_HPP
@@ -0,0 +1,163 @@
+//  Program:      nes-py
+//  File:         state.hpp
+//  Description:  This file defines the fixed-size save state of an emulator
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef STATE_HPP
+#define STATE_HPP
+
+#include <type_traits>
+#include "common.hpp"
+
+namespace NES {
+
+/// The magic number at the start of every save state ("NESS")
+const uint32_t STATE_MAGIC = 0x5353454e;
+/// The version of the save state layout, bumped whenever the layout changes
+const uint32_t STATE_VERSION = 3;
+
+/// The registers of the CPU
+struct CPUState {
+    /// the program counter register
+    NES_Address register_PC;
+    /// the stack pointer register
+    NES_Byte register_SP;
+    /// the A register
+    NES_Byte register_A;
+    /// the X register
+    NES_Byte register_X;
+    /// the Y register
+    NES_Byte register_Y;
+    /// the flags register
+    NES_Byte flags;
+    /// padding to align the cycle counters
+    NES_Byte padding;
+    /// the number of cycles to skip
+    int32_t skip_cycles;
+    /// the number of cycles the CPU has run
+    int32_t cycles;
+};
+
+/// The registers, pipeline, and sprite memory of the PPU
+struct PPUState {
+    /// the OAM memory (sprites)
+    NES_Byte sprite_memory[64 * 4];
+    /// the pipeline state of the PPU
+    NES_Byte pipeline_state;
+    /// whether the PPU is on an even frame
+    NES_Byte is_even_frame;
+    /// whether the PPU is in vertical blanking mode
+    NES_Byte is_vblank;
+    /// whether sprite 0 has been hit
+    NES_Byte is_sprite_zero_hit;
+    /// whether the next write to the address / scroll registers is the first
+    NES_Byte is_first_write;
+    /// the read buffer for data reads
+    NES_Byte data_buffer;
+    /// the read / write address for the OAM memory
+    NES_Byte sprite_data_address;
+    /// the fine scrolling position
+    NES_Byte fine_x_scroll;
+    /// whether the PPU is showing sprites
+    NES_Byte is_showing_sprites;
+    /// whether the PPU is showing background pixels
+    NES_Byte is_showing_background;
+    /// whether the PPU is hiding sprites along the edges
+    NES_Byte is_hiding_edge_sprites;
+    /// whether the PPU is hiding the background along the edges
+    NES_Byte is_hiding_edge_background;
+    /// whether the sprites are 8x16
+    NES_Byte is_long_sprites;
+    /// whether the PPU interrupts the CPU on vertical blank
+    NES_Byte is_interrupting;
+    /// the pattern table page of the background
+    NES_Byte background_page;
+    /// the pattern table page of the sprites
+    NES_Byte sprite_page;
+    /// padding to align the addresses and the cycle counters
+    NES_Byte padding[2];
+    /// the current data address
+    NES_Address data_address;
+    /// the temporary address register
+    NES_Address temp_address;
+    /// the value to increment the data address by
+    NES_Address data_address_increment;
+    /// the cycle of the current scanline
+    int32_t cycles;
+    /// the current scanline of the frame
+    int32_t scanline;
+    /// the x coordinate of the next pixel to render on the scanline
+    int32_t render_x;
+};
+
+/// The memory of the main bus
+struct MainBusState {
+    /// the RAM on the main bus
+    NES_Byte ram[0x800];
+    /// the extended RAM on the cartridge (zero if the mapper has none)
+    NES_Byte extended_ram[0x2000];
+};
+
+/// The memory of the picture bus
+struct PictureBusState {
+    /// the VRAM on the picture bus
+    NES_Byte ram[0x800];
+    /// the palette for decoding RGB tuples
+    NES_Byte palette[0x20];
+};
+
+/// The registers and character RAM of a mapper
+struct MapperState {
+    /// the registers of the mapper, the layout is up to each mapper
+    uint32_t registers[16];
+    /// the character RAM on the cartridge (zero if the mapper has none)
+    NES_Byte character_ram[0x2000];
+};
+
+/// The latches of a controller
+struct ControllerState {
+    /// whether strobe is on
+    NES_Byte is_strobe;
+    /// the buttons pressed on the controller
+    NES_Byte joypad_buttons;
+    /// the buttons left to shift out to the CPU
+    NES_Byte joypad_bits;
+    /// padding to align the state
+    NES_Byte padding;
+};
+
+/// The complete, fixed-size state of an emulator that saves and restores as
+/// plain bytes (the screen isn't part of the state)
+struct State {
+    /// the magic number of the state, STATE_MAGIC
+    uint32_t magic;
+    /// the version of the state layout, STATE_VERSION
+    uint32_t version;
+    /// the size of the state in bytes
+    uint32_t size;
+    /// the ID of the mapper the state was saved from
+    uint32_t mapper;
+    /// the hash of the ROM the state was saved from
+    uint64_t rom;
+    /// the state of the CPU
+    CPUState cpu;
+    /// the state of the PPU
+    PPUState ppu;
+    /// the state of the main bus
+    MainBusState bus;
+    /// the state of the picture bus
+    PictureBusState picture_bus;
+    /// the state of the mapper
+    MapperState cartridge;
+    /// the state of the 2 controllers
+    ControllerState controllers[2];
+};
+
+static_assert(std::is_trivially_copyable<State>::value, "State must be trivially copyable");
+static_assert(std::is_standard_layout<State>::value, "State must have a standard layout");
+
+}  // namespace NES
+
+#endif  // STATE_HPP
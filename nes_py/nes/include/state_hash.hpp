@@ -0,0 +1,69 @@
+//  Program:      nes-py
+//  File:         state_hash.hpp
+//  Description:  Fast 64-bit hashes of emulator states for determinism checks
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef STATE_HASH_HPP
+#define STATE_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "common.hpp"
+#include "state.hpp"
+
+namespace NES {
+
+/// Return the 64-bit XXH64 hash of a buffer.
+///
+/// @param data the bytes to hash
+/// @param size the number of bytes to hash
+/// @param seed the seed of the hash
+/// @return the hash of the bytes
+///
+uint64_t xxhash64(const void* data, std::size_t size, uint64_t seed = 0);
+
+/// Return the hash of a state: the CPU registers, RAM, VRAM, OAM, palette,
+/// mapper registers and character RAM, and controllers.
+///
+/// The state is hashed in pages of STATE_HASH_PAGE_SIZE bytes and the hash
+/// is the hash of the page hashes, so StateHasher can update it one page at
+/// a time. The hash only depends on the bytes of the state.
+///
+/// @param state the state to hash
+/// @return the 64-bit hash of the state
+///
+uint64_t hash_state(const State& state);
+
+/// The number of bytes in a page of a hashed state
+const std::size_t STATE_HASH_PAGE_SIZE = 256;
+/// The number of pages in a hashed state
+const std::size_t STATE_HASH_PAGES = (sizeof(State) + STATE_HASH_PAGE_SIZE - 1) / STATE_HASH_PAGE_SIZE;
+
+/// A hasher of a sequence of states that only rehashes the pages that
+/// changed since the last state, most of a state doesn't change between
+/// consecutive frames (the character RAM, the extended RAM, and most VRAM).
+class StateHasher {
+ public:
+    /// Initialize a new state hasher.
+    StateHasher();
+
+    /// Return the hash of a state, the same as hash_state(state).
+    ///
+    /// @param state the state to hash
+    /// @return the 64-bit hash of the state
+    ///
+    uint64_t hash(const State& state);
+
+ private:
+    /// the last state hashed (zero before the first state)
+    std::unique_ptr<State> previous;
+    /// the hash of each page of the last state
+    uint64_t page_hashes[STATE_HASH_PAGES];
+};
+
+}  // namespace NES
+
+#endif  // STATE_HASH_HPP
@@ -0,0 +1,117 @@
+//  Program:      nes-py
+//  File:         thread_pool.hpp
+//  Description:  A persistent work-stealing thread pool for batched emulation
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NES {
+
+/// A pool of persistent worker threads that execute index-parallel loops.
+///
+/// Each call to parallel_for splits the index range into one contiguous
+/// block per participant (the calling thread participates as well). A
+/// participant that drains its own block steals the remaining indices of
+/// the other blocks, so a single slow index doesn't stall the whole batch.
+///
+class ThreadPool {
+ public:
+    /// The type of the task executed for each index in a parallel loop
+    typedef std::function<void(std::size_t)> Task;
+
+    /// Initialize a new thread pool.
+    ///
+    /// @param num_threads the number of threads including the caller, 0 to
+    /// use the number of hardware threads
+    /// @param pin_threads whether to pin each worker thread to a CPU core
+    ///
+    explicit ThreadPool(std::size_t num_threads = 0, bool pin_threads = false);
+
+    /// Stop and join the worker threads.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// Return the number of threads participating in a parallel loop.
+    inline std::size_t size() const { return workers.size() + 1; }
+
+    /// Execute a task for every index in [0, count) and block until done.
+    ///
+    /// If the task throws on any participant, the remaining indices are
+    /// skipped and the first exception is rethrown on the calling thread
+    /// once every worker has left the loop.
+    ///
+    /// @param count the number of indices to execute the task for
+    /// @param task the task to execute for each index
+    ///
+    void parallel_for(std::size_t count, const Task& task);
+
+ private:
+    /// the size of a cache line to align the blocks to
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    /// A block of indices owned by one participant, aligned to a cache line
+    /// so that stealing from one block doesn't contend with its neighbors
+    struct alignas(CACHE_LINE) Block {
+        /// the next index to execute in this block
+        std::atomic<std::size_t> next;
+        /// one past the last index in this block
+        std::size_t end;
+    };
+
+    /// the worker threads (the caller is participant 0)
+    std::vector<std::thread> workers;
+    /// the storage of the blocks (operator new[] doesn't honor the
+    /// alignment of over-aligned types before C++17)
+    std::unique_ptr<unsigned char[]> block_storage;
+    /// the index blocks for each participant, aligned into block_storage
+    Block* blocks;
+    /// the task of the active parallel loop
+    const Task* task;
+    /// the mutex guarding the start / stop state
+    std::mutex mutex;
+    /// the condition signaled when a new loop starts (or the pool stops)
+    std::condition_variable start_condition;
+    /// the condition signaled when the last worker finishes a loop
+    std::condition_variable done_condition;
+    /// the number of parallel loops started so far
+    std::size_t generation;
+    /// the number of workers still executing the active loop
+    std::size_t active;
+    /// whether the pool is shutting down
+    bool is_stopping;
+    /// whether a task of the active loop threw (skips the remaining indices)
+    std::atomic<bool> is_failed;
+    /// the first exception thrown by a task of the active loop
+    std::exception_ptr error;
+
+    /// Wait for loops and execute them until the pool stops.
+    ///
+    /// @param id the participant ID of the worker
+    ///
+    void work(std::size_t id);
+
+    /// Execute indices from the participant's block, then steal from others.
+    ///
+    /// @param id the participant ID of the executing thread
+    ///
+    void drain(std::size_t id);
+};
+
+}  // namespace NES
+
+#endif  // THREAD_POOL_HPP
@@ -0,0 +1,378 @@
+//  Program:      nes-py
+//  File:         vec_emulator.hpp
+//  Description:  This class houses a batch of NES emulators stepped together
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#ifndef VEC_EMULATOR_HPP
+#define VEC_EMULATOR_HPP
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common.hpp"
+#include "emulator.hpp"
+#include "observation.hpp"
+#include "reward.hpp"
+#include "thread_pool.hpp"
+
+namespace NES {
+
+/// The layouts of the observations written to an observation buffer
+enum class ObservationLayout : int {
+    /// (N, height, width, channels), i.e., packed RGB pixels or the frames
+    /// of a stack interleaved per pixel
+    NHWC = 0,
+    /// (N, channels, height, width), i.e., planar RGB or the frames of a
+    /// stack one after the other
+    NCHW = 1,
+};
+
+/// A batch of NES emulators running the same ROM that step in lockstep
+class VecEmulator {
+ public:
+    /// The number of bytes in the RGB observation of a single emulator
+    static const std::size_t OBSERVATION_SIZE = Emulator::HEIGHT * Emulator::WIDTH * 3;
+    /// The number of bytes in the RAM of a single emulator
+    static const std::size_t MEMORY_SIZE = 0x800;
+
+    /// Initialize a new batch of emulators with a path to a ROM file.
+    ///
+    /// @param rom_path the path to the ROM for the emulators to run
+    /// @param num_emulators the number of emulators in the batch
+    /// @param num_threads the number of threads to step with, 0 for one per
+    /// hardware thread
+    /// @param pin_threads whether to pin the worker threads to CPU cores
+    ///
+    VecEmulator(
+        const std::string& rom_path,
+        std::size_t num_emulators,
+        std::size_t num_threads = 0,
+        bool pin_threads = false
+    );
+
+    /// Initialize a new batch of emulators that share a ROM image.
+    ///
+    /// @param rom the image of the ROM for the emulators to run
+    /// @param num_emulators the number of emulators in the batch
+    /// @param num_threads the number of threads to step with, 0 for one per
+    /// hardware thread
+    /// @param pin_threads whether to pin the worker threads to CPU cores
+    ///
+    VecEmulator(
+        std::shared_ptr<const ROMImage> rom,
+        std::size_t num_emulators,
+        std::size_t num_threads = 0,
+        bool pin_threads = false
+    );
+
+    /// Wait for a pending step and join the thread of step_async.
+    ~VecEmulator();
+
+    VecEmulator(const VecEmulator&) = delete;
+    VecEmulator& operator=(const VecEmulator&) = delete;
+
+    /// Return the number of emulators in the batch.
+    inline std::size_t size() const { return emulators.size(); }
+
+    /// Return the number of threads stepping the batch.
+    inline std::size_t num_threads() const { return pool.size(); }
+
+    /// Return the emulator at the given index in the batch (its PPU writes
+    /// pixels in the indexed format).
+    inline Emulator& operator[](std::size_t index) { return *emulators[index]; }
+
+    /// Return a pointer to the (N, HEIGHT, WIDTH, 3) RGB observations.
+    inline NES_Byte* get_observations() { return observations.data(); }
+
+    /// Return a pointer to the (N, 0x800) RAM buffers.
+    inline NES_Byte* get_memory() { return memory.data(); }
+
+    /// Preprocess the screens of the batch into stacks of frames instead of
+    /// RGB observations. Every stack is filled with the current screen.
+    ///
+    /// @param config the crop, size, and number of frames of the stacks
+    /// @throws std::invalid_argument if the configuration is invalid
+    ///
+    void set_observation_config(const ObservationConfig& config);
+
+    /// Return true if the batch preprocesses screens into stacks of frames.
+    inline bool has_frame_stacks() const { return !pipelines.empty(); }
+
+    /// Return the configuration of the stacks of frames.
+    inline const ObservationConfig& get_observation_config() const {
+        return pipelines.front().get_config();
+    }
+
+    /// Return a pointer to the (frames, height, width) stack of the first
+    /// emulator, the stack of emulator i is get_frame_stack_stride() * i
+    /// bytes after it.
+    inline const NES_Byte* get_frame_stacks() const {
+        // the rings change in place, double-buffered stacks are copied out
+        return is_double_buffered ? stacks.data() : pipelines.front().get_stack();
+    }
+
+    /// Return the number of bytes between the stacks of adjacent emulators.
+    inline std::size_t get_frame_stack_stride() const {
+        return (is_double_buffered ? 1 : 2) * pipelines.front().stack_size();
+    }
+
+    /// Return the number of bytes in the observation of a single emulator,
+    /// i.e., an RGB screen or a stack of frames.
+    inline std::size_t observation_size() const {
+        return has_frame_stacks() ? pipelines.front().stack_size() : OBSERVATION_SIZE;
+    }
+
+    /// Write the observations of every reset and step to a buffer of the
+    /// caller, e.g., page-locked memory to upload to a GPU from, instead of
+    /// the buffers of the batch. With a back buffer, the buffers alternate
+    /// on every step_async like the buffers of the batch, so the buffer of
+    /// the last wait stays intact during the next step. Without one, a
+    /// step_async writes over the buffer of the last wait. Setting an
+    /// observation config clears the buffers.
+    ///
+    /// @param buffer the N x observation_size() bytes to write to, which
+    /// must outlive the batch or the next call, null to clear the buffers
+    /// @param layout the layout to write the observations in
+    /// @param back_buffer another N x observation_size() bytes for the
+    /// steps of step_async to alternate with, or null
+    /// @throws std::invalid_argument if the back buffer is set without a
+    /// buffer or overlaps it
+    ///
+    void set_observation_buffer(NES_Byte* buffer, ObservationLayout layout, NES_Byte* back_buffer = nullptr);
+
+    /// Return the buffer of the caller the observations are written to, or
+    /// null if they're written to the buffers of the batch.
+    inline NES_Byte* get_observation_buffer() const { return observation_buffer; }
+
+    /// Return the layout of the observations in the observation buffer.
+    inline ObservationLayout get_observation_layout() const { return observation_layout; }
+
+    /// Evaluate a reward specification over the RAM of every emulator after
+    /// each reset and step, into the reward, termination, and info arrays.
+    ///
+    /// @param spec the specification of the reward, termination, and info
+    /// @throws std::invalid_argument if the specification is invalid
+    ///
+    void set_reward_spec(const RewardSpec& spec);
+
+    /// Return true if the batch evaluates a reward specification.
+    inline bool has_rewards() const { return !programs.empty(); }
+
+    /// Return the number of values in the info of each emulator.
+    inline std::size_t num_info_values() const {
+        return programs.empty() ? 0 : programs.front().num_values();
+    }
+
+    /// Return a pointer to the (N,) rewards of the last step.
+    inline float* get_rewards() { return rewards.data(); }
+
+    /// Return a pointer to the (N,) terminations of the last step.
+    inline NES_Byte* get_dones() { return dones.data(); }
+
+    /// Return a pointer to the (N, num_info_values()) values of the last
+    /// reset or step.
+    inline int64_t* get_infos() { return infos.data(); }
+
+    /// Reset every emulator in the batch.
+    void reset();
+
+    /// Reset a single emulator in the batch.
+    ///
+    /// @param index the index of the emulator in the batch to reset
+    ///
+    void reset(std::size_t index);
+
+    /// Perform a step on every emulator in the batch, i.e., a single frame.
+    ///
+    /// @param actions the (N, players) row-major array of controller bytes
+    /// @param players the number of controller bytes per emulator (1 or 2)
+    ///
+    void step(const NES_Byte* actions, std::size_t players);
+
+    /// Start a step of every emulator in the batch on a background thread
+    /// and return without waiting for it, e.g., to run inference on the
+    /// outputs of the last step meanwhile. The thread is started by the
+    /// first call and steps through the worker pool until the batch is
+    /// destroyed.
+    ///
+    /// The first call double-buffers the outputs (observations or stacks,
+    /// RAM, and rewards): the step writes to the back buffers while the
+    /// front buffers keep the outputs of the last step, and the buffers
+    /// swap for the getters. So the outputs the getters point to after a
+    /// wait stay intact during the next step and are overwritten by the
+    /// one after it. Every other call waits for the pending step first.
+    ///
+    /// @param actions the (N, players) row-major array of controller bytes,
+    /// which is copied
+    /// @param players the number of controller bytes per emulator (1 or 2)
+    ///
+    void step_async(const NES_Byte* actions, std::size_t players);
+
+    /// Wait for the step started by step_async, if any.
+    ///
+    /// @throws the exception of the step if it failed
+    ///
+    void wait();
+
+    /// Return true if a step started by step_async hasn't been waited for.
+    inline bool is_stepping() const { return is_pending; }
+
+    /// Run a batch of action sequences headless from states and trace RAM
+    /// bytes, in parallel over the emulators of the batch. Each emulator
+    /// returns to its own state afterward.
+    ///
+    /// @param states the states to start each rollout from
+    /// @param rollouts the number of rollouts to run
+    /// @param actions the (rollouts, frames, players) row-major array of
+    /// controller bytes
+    /// @param players the number of controller bytes per frame (1 or 2)
+    /// @param frames the number of frames to step each rollout for
+    /// @param addresses the RAM addresses to trace, each below 0x800
+    /// @param count the number of RAM addresses to trace
+    /// @param traces the (rollouts, frames, count) row-major array of RAM
+    /// bytes to write
+    /// @throws std::invalid_argument if a state isn't compatible or an
+    /// address is outside the RAM
+    ///
+    void rollout(
+        const State* states,
+        std::size_t rollouts,
+        const NES_Byte* actions,
+        std::size_t players,
+        int frames,
+        const NES_Address* addresses,
+        std::size_t count,
+        NES_Byte* traces
+    );
+
+ private:
+    /// the emulators in the batch (heap allocated because the bus callbacks
+    /// capture the address of the emulator)
+    std::vector<std::unique_ptr<Emulator>> emulators;
+    /// the worker pool that steps the emulators
+    ThreadPool pool;
+    /// the contiguous RGB observations of the batch
+    std::vector<NES_Byte> observations;
+    /// the contiguous RAM buffers of the batch
+    std::vector<NES_Byte> memory;
+    /// the observation pipelines of the emulators (empty for RGB screens)
+    std::vector<ObservationPipeline> pipelines;
+    /// the contiguous rings of frames of the observation pipelines
+    std::vector<NES_Byte> frame_stacks;
+
+    /// the reward programs of the emulators (empty without a specification)
+    std::vector<RewardProgram> programs;
+    /// the contiguous rewards of the batch
+    std::vector<float> rewards;
+    /// the contiguous terminations of the batch
+    std::vector<NES_Byte> dones;
+    /// the contiguous info values of the batch
+    std::vector<int64_t> infos;
+
+    /// the buffer of the caller to write the observations to, if any
+    NES_Byte* observation_buffer = nullptr;
+    /// the buffer of the caller to alternate with on step_async, if any
+    NES_Byte* back_observation_buffer = nullptr;
+    /// the layout of the observations in the observation buffer
+    ObservationLayout observation_layout = ObservationLayout::NHWC;
+
+    /// the contiguous stacks copied out of the rings when double-buffered
+    std::vector<NES_Byte> stacks;
+    /// whether step_async double-buffers the outputs
+    bool is_double_buffered = false;
+    /// the back buffer of the RGB observations when double-buffered
+    std::vector<NES_Byte> back_observations;
+    /// the back buffer of the RAM buffers when double-buffered
+    std::vector<NES_Byte> back_memory;
+    /// the back buffer of the stacks when double-buffered
+    std::vector<NES_Byte> back_stacks;
+    /// the back buffer of the rewards when double-buffered
+    std::vector<float> back_rewards;
+    /// the back buffer of the terminations when double-buffered
+    std::vector<NES_Byte> back_dones;
+    /// the back buffer of the info values when double-buffered
+    std::vector<int64_t> back_infos;
+    /// the storage of outputs replaced by a reconfiguration, kept until the
+    /// batch is destroyed since arrays returned to Python may still view it
+    std::vector<std::shared_ptr<void>> retired;
+    /// the copy of the actions of the pending step
+    std::vector<NES_Byte> async_actions;
+    /// the number of controller bytes per emulator of the pending step
+    std::size_t async_players = 1;
+    /// whether a step started by step_async hasn't been waited for
+    bool is_pending = false;
+
+    /// the thread that runs the steps of step_async
+    std::thread stepper;
+    /// the mutex guarding the state of the stepper
+    std::mutex step_mutex;
+    /// the condition signaled when a step starts (or the stepper stops)
+    std::condition_variable start_condition;
+    /// the condition signaled when the stepper finishes a step
+    std::condition_variable done_condition;
+    /// whether the stepper has a step to run
+    bool is_step_started = false;
+    /// whether the stepper finished the pending step
+    bool is_step_done = false;
+    /// whether the stepper is shutting down
+    bool is_stopping = false;
+    /// the exception thrown by the pending step, if any
+    std::exception_ptr step_error;
+
+    /// Wait for steps and run them until the batch is destroyed.
+    void run_stepper();
+
+    /// Reset an emulator and write its outputs.
+    ///
+    /// @param index the index of the emulator in the batch to reset
+    ///
+    void reset_emulator(std::size_t index);
+
+    /// Step every emulator and write their outputs.
+    ///
+    /// @param actions the (N, players) row-major array of controller bytes
+    /// @param players the number of controller bytes per emulator (1 or 2)
+    ///
+    void step_emulators(const NES_Byte* actions, std::size_t players);
+
+    /// Swap the front and back buffers of the outputs.
+    void swap_buffers();
+
+    /// Stop double-buffering the outputs, e.g., when their sizes change. The
+    /// back buffers are kept for views of them and reused by the next call
+    /// to step_async.
+    void stop_double_buffering();
+
+    /// Move the storage of an output to the retired storage and leave the
+    /// output empty.
+    ///
+    /// @param buffer the output to retire the storage of
+    ///
+    template <typename T>
+    void retire(std::vector<T>& buffer);
+
+    /// Write the observation of an emulator to the observation buffer.
+    ///
+    /// @param index the index of the emulator to write the observation of
+    ///
+    void write_observation_buffer(std::size_t index);
+
+    /// Copy the screen and RAM of an emulator into the batch buffers and
+    /// evaluate its reward program.
+    ///
+    /// @param index the index of the emulator to copy the outputs of
+    /// @param is_reset whether the emulator was reset, which refills the
+    /// stack of frames instead of pushing a frame
+    ///
+    void write_outputs(std::size_t index, bool is_reset);
+};
+
+}  // namespace NES
+
+#endif  // VEC_EMULATOR_HPP
@@ -0,0 +1,131 @@
+//  Program:      nes-py
+//  File:         replay.cpp
+//  Description:  Replay an input log and find the first frame that diverges
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "emulator.hpp"
+#include "state_hash.hpp"
+
+using namespace NES;
+
+/// Return the bytes of a file.
+///
+/// @param path the path to the file to read
+/// @return the bytes of the file
+/// @throws std::invalid_argument if the file can't be opened
+///
+static std::vector<NES_Byte> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios_base::binary | std::ios_base::in);
+    if (!file)
+        throw std::invalid_argument("failed to open " + path);
+    return std::vector<NES_Byte>(
+        (std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>()
+    );
+}
+
+/// Print the usage of the replay tool.
+///
+/// @param program the name of the replay program
+///
+static void usage(const char* program) {
+    std::fprintf(stderr,
+        "usage: %s ROM INPUTS [--state STATE] [--record HASHES | --verify HASHES]\n"
+        "\n"
+        "  INPUTS  the controller bytes of player 1 and 2 for each frame\n"
+        "  STATE   a state from dump_state to start from instead of a reset\n"
+        "  HASHES  the 64-bit state hash after each frame, e.g., a hash ring\n"
+        "          saved with numpy.ndarray.tofile\n",
+        program);
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> paths;
+    std::string state_path, record_path, verify_path;
+    for (int index = 1; index < argc; index++) {
+        const std::string argument = argv[index];
+        if (argument == "--state" && index + 1 < argc) {
+            state_path = argv[++index];
+        } else if (argument == "--record" && index + 1 < argc) {
+            record_path = argv[++index];
+        } else if (argument == "--verify" && index + 1 < argc) {
+            verify_path = argv[++index];
+        } else if (argument.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 2;
+        } else {
+            paths.push_back(argument);
+        }
+    }
+    if (paths.size() != 2 || (!record_path.empty() && !verify_path.empty())) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    try {
+        Emulator emulator(paths[0]);
+        emulator.reset();
+        if (!state_path.empty()) {
+            const std::vector<NES_Byte> bytes = read_file(state_path);
+            if (bytes.size() != sizeof(State))
+                throw std::invalid_argument("state must be " + std::to_string(sizeof(State)) + " bytes");
+            std::unique_ptr<State> state(new State);
+            std::memcpy(state.get(), bytes.data(), sizeof(State));
+            if (!emulator.is_compatible(state.get()))
+                throw std::invalid_argument("state is from another version or ROM, or is corrupted");
+            emulator.restore(state.get());
+        }
+        const std::vector<NES_Byte> inputs = read_file(paths[1]);
+        if (inputs.size() % 2 != 0)
+            throw std::invalid_argument("inputs must hold 2 controller bytes per frame");
+        const std::size_t frames = inputs.size() / 2;
+        std::vector<uint64_t> expected;
+        if (!verify_path.empty()) {
+            const std::vector<NES_Byte> bytes = read_file(verify_path);
+            expected.resize(bytes.size() / sizeof(uint64_t));
+            std::memcpy(expected.data(), bytes.data(), expected.size() * sizeof(uint64_t));
+            if (expected.size() < frames)
+                std::fprintf(stderr, "only the first %zu of %zu frames have hashes\n", expected.size(), frames);
+        }
+
+        std::vector<uint64_t> hashes(frames);
+        emulator.set_hash_ring(hashes.data(), hashes.size() ? hashes.size() : 1);
+        for (std::size_t frame = 0; frame < frames; frame++) {
+            *emulator.get_controller(0) = inputs[2 * frame];
+            *emulator.get_controller(1) = inputs[2 * frame + 1];
+            // the pixels don't change the state, skip them
+            emulator.step(false);
+            if (frame < expected.size() && hashes[frame] != expected[frame]) {
+                std::printf("diverged at frame %zu: expected %016" PRIx64 ", replayed %016" PRIx64 "\n",
+                    frame, expected[frame], hashes[frame]);
+                return 1;
+            }
+        }
+
+        if (!record_path.empty()) {
+            std::ofstream file(record_path, std::ios_base::binary | std::ios_base::out);
+            file.write(reinterpret_cast<const char*>(hashes.data()), hashes.size() * sizeof(uint64_t));
+            if (!file)
+                throw std::invalid_argument("failed to write " + record_path);
+        }
+        if (verify_path.empty())
+            std::printf("replayed %zu frames, final hash %016" PRIx64 "\n", frames, frames ? hashes.back() : emulator.hash());
+        else
+            std::printf("replayed %zu frames without divergence\n", frames);
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "%s: %s\n", argv[0], error.what());
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+//  Program:      nes-py
+//  File:         block_cache.cpp
+//  Description:  A cache of decoded blocks of instructions in PRG ROM
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "block_cache.hpp"
+
+namespace NES {
+
+/// Return true if an instruction may not continue at the next address.
+static inline bool is_jump(NES_Byte opcode) {
+    switch (opcode) {
+        case JSR:
+        case RTI:
+        case JMP:
+        case RTS:
+        case JMPI:
+            return true;
+    }
+    return (opcode & BRANCH_INSTRUCTION_MASK) == BRANCH_INSTRUCTION_MASK_RESULT;
+}
+
+void BlockCache::decode(Block& block, NES_Address address, const NES_Byte* page, const NES_Byte* next) {
+    block.pages = {{page, next}};
+    block.address = address;
+    block.count = 0;
+    block.max_cycles = 0;
+    if (page == nullptr)
+        return;
+    // the operands of the last instruction of the page are on the next page,
+    // which is only ROM if the address isn't on the last page
+    const bool has_next = next != nullptr && (address >> 8) != 0xff;
+    int offset = address & 0xff;
+    while (block.count < MAX_INSTRUCTIONS && offset < 0x100) {
+        const NES_Byte opcode = page[offset];
+        const int length = CPU::instruction_length(opcode);
+        // BRK pushes the address after it, leave it to the interpreter
+        if (length == 0 || opcode == BRK)
+            break;
+        if (offset + length > 0x100 && !has_next)
+            break;
+        NES_Address operand = 0;
+        for (int index = length - 1; index > 0; index--) {
+            const int byte = offset + index;
+            operand = operand << 8 | (byte < 0x100 ? page[byte] : next[byte - 0x100]);
+        }
+        block.instructions[block.count++] = CPU::decode(opcode, operand);
+        // page crossings add a cycle, taken branches up to 3
+        block.max_cycles += OPERATION_CYCLES[opcode] + (is_jump(opcode) ? 3 : 1);
+        offset += length;
+        if (is_jump(opcode))
+            break;
+    }
+}
+
+}  // namespace NES
@@ -4,37 +4,36 @@
 //
 //  Copyright (c) 2019 Christian Kauten. All rights reserved.
 //
-#include <fstream>
+#include <stdexcept>
+#include <utility>
 #include "cartridge.hpp"
 #include "log.hpp"
 
 namespace NES {
 
 void Cartridge::loadFromFile(std::string path) {
-    // create a stream to load the ROM file
-    std::ifstream romFile(path, std::ios_base::binary | std::ios_base::in);
-    
-    // create a byte vector for the iNES header
-    std::vector<NES_Byte> header;
-    header.resize(0x10);    
-    romFile.read(reinterpret_cast<char*>(&header[0]), 0x10);
-    
+    loadFromImage(ROMImage::open(path));
+}
+
+void Cartridge::loadFromImage(std::shared_ptr<const ROMImage> rom) {
+    // the iNES header (16 bytes) leads the PRG-ROM and CHR-ROM banks
+    const NES_Byte* header = rom->data();
+    if (rom->size() < 0x10)
+        throw std::invalid_argument("ROM is missing the iNES header");
+
     // read internal data
     name_table_mirroring = header[6] & 0xB;
     mapper_number = ((header[6] >> 4) & 0xf) | (header[7] & 0xf0);
     has_extended_ram = header[6] & 0x2;
 
-    // read PRG-ROM 16KB banks
-    NES_Byte banks = header[4];
-    prg_rom.resize(0x4000 * banks);
-    romFile.read(reinterpret_cast<char*>(&prg_rom[0]), 0x4000 * banks);
-    
-    // read CHR-ROM 8KB banks
-    NES_Byte vbanks = header[5];
-    if (!vbanks)
-        return;
-    chr_rom.resize(0x2000 * vbanks);
-    romFile.read(reinterpret_cast<char*>(&chr_rom[0]), 0x2000 * vbanks);
+    // reference PRG-ROM 16KB banks and CHR-ROM 8KB banks
+    const std::size_t prg_size = 0x4000 * header[4];
+    const std::size_t chr_size = 0x2000 * header[5];
+    if (rom->size() < 0x10 + prg_size + chr_size)
+        throw std::invalid_argument("ROM is shorter than its iNES header claims");
+    prg_rom = ROMBlock(header + 0x10, prg_size);
+    chr_rom = ROMBlock(header + 0x10 + prg_size, chr_size);
+    image = std::move(rom);
 }
 
 }  // namespace NES
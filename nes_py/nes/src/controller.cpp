@@ -20,4 +20,17 @@ NES_Byte Controller::read() {
     return ret | 0x40;
 }
 
+void Controller::save(ControllerState& state) const {
+    state.is_strobe = is_strobe;
+    state.joypad_buttons = joypad_buttons;
+    state.joypad_bits = joypad_bits;
+    state.padding = 0;
+}
+
+void Controller::load(const ControllerState& state) {
+    is_strobe = state.is_strobe;
+    joypad_buttons = state.joypad_buttons;
+    joypad_bits = state.joypad_bits;
+}
+
 }  // namespace NES
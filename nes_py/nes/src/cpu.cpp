@@ -6,11 +6,13 @@
 //
 
 #include "cpu.hpp"
+#include <algorithm>
 #include "log.hpp"
 
 namespace NES {
 
-bool CPU::implied(MainBus &bus, NES_Byte opcode) {
+template <NES_Byte opcode, bool is_decoded>
+inline bool CPU::implied(MainBus &bus, NES_Address operand) {
     switch (static_cast<OperationImplied>(opcode)) {
         case BRK: {
             interrupt(bus, BRK_INTERRUPT);
@@ -30,7 +32,7 @@ bool CPU::implied(MainBus &bus, NES_Byte opcode) {
             // register_PC + 1 are address of subroutine
             push_stack(bus, static_cast<NES_Byte>((register_PC + 1) >> 8));
             push_stack(bus, static_cast<NES_Byte>(register_PC + 1));
-            register_PC = read_address(bus, register_PC);
+            register_PC = fetch_address<is_decoded>(bus, operand);
             break;
         }
         case PLP: {
@@ -52,7 +54,7 @@ bool CPU::implied(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case JMP: {
-            register_PC = read_address(bus, register_PC);
+            register_PC = fetch_address<is_decoded>(bus, operand);
             break;
         }
         case CLI: {
@@ -71,7 +73,7 @@ bool CPU::implied(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case JMPI: {
-            NES_Address location = read_address(bus, register_PC);
+            NES_Address location = fetch_address<is_decoded>(bus, operand);
             // 6502 has a bug such that the when the vector of an indirect
             // address begins at the last byte of a page, the second byte
             // is fetched from the beginning of that page rather than the
@@ -154,7 +156,8 @@ bool CPU::implied(MainBus &bus, NES_Byte opcode) {
     return true;
 }
 
-bool CPU::branch(MainBus &bus, NES_Byte opcode) {
+template <NES_Byte opcode, bool is_decoded>
+inline bool CPU::branch(MainBus &bus, NES_Address operand) {
     if ((opcode & BRANCH_INSTRUCTION_MASK) != BRANCH_INSTRUCTION_MASK_RESULT)
         return false;
 
@@ -186,7 +189,7 @@ bool CPU::branch(MainBus &bus, NES_Byte opcode) {
     }
 
     if (branch) {
-        int8_t offset = bus.read(register_PC++);
+        int8_t offset = fetch_byte<is_decoded>(bus, operand);
         ++skip_cycles;
         auto newPC = static_cast<NES_Address>(register_PC + offset);
         set_page_crossed(register_PC, newPC, 2);
@@ -197,9 +200,15 @@ bool CPU::branch(MainBus &bus, NES_Byte opcode) {
     return true;
 }
 
-bool CPU::type0(MainBus &bus, NES_Byte opcode) {
+template <NES_Byte opcode, bool is_decoded>
+inline bool CPU::type0(MainBus &bus, NES_Address operand) {
     if ((opcode & INSTRUCTION_MODE_MASK) != 0x0)
         return false;
+    // the immediate operand of a decoded instruction is the decoded operand
+    constexpr bool is_immediate = is_decoded && ((opcode & ADRESS_MODE_MASK) >> ADDRESS_MODE_SHIFT) == M2_IMMEDIATE;
+    auto read = [&](NES_Address address) -> NES_Byte {
+        return is_immediate ? static_cast<NES_Byte>(operand) : bus.read(address);
+    };
 
     NES_Address location = 0;
     switch (static_cast<AddrMode2>((opcode & ADRESS_MODE_MASK) >> ADDRESS_MODE_SHIFT)) {
@@ -208,21 +217,21 @@ bool CPU::type0(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case M2_ZERO_PAGE: {
-            location = bus.read(register_PC++);
+            location = fetch_byte<is_decoded>(bus, operand);
             break;
         }
         case M2_ABSOLUTE: {
-            location = read_address(bus, register_PC);
+            location = fetch_address<is_decoded>(bus, operand);
             register_PC += 2;
             break;
         }
         case M2_INDEXED: {
             // Address wraps around in the zero page
-            location = (bus.read(register_PC++) + register_X) & 0xff;
+            location = (fetch_byte<is_decoded>(bus, operand) + register_X) & 0xff;
             break;
         }
         case M2_ABSOLUTE_INDEXED: {
-            location = read_address(bus, register_PC);
+            location = fetch_address<is_decoded>(bus, operand);
             register_PC += 2;
             set_page_crossed(location, location + register_X);
             location += register_X;
@@ -232,10 +241,10 @@ bool CPU::type0(MainBus &bus, NES_Byte opcode) {
     }
     switch (static_cast<Operation0>((opcode & OPERATION_MASK) >> OPERATION_SHIFT)) {
         case BIT: {
-            NES_Address operand = bus.read(location);
-            flags.bits.Z = !(register_A & operand);
-            flags.bits.V = operand & 0x40;
-            flags.bits.N = operand & 0x80;
+            NES_Byte value = read(location);
+            flags.bits.Z = !(register_A & value);
+            flags.bits.V = value & 0x40;
+            flags.bits.N = value & 0x80;
             break;
         }
         case STY: {
@@ -243,18 +252,18 @@ bool CPU::type0(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case LDY: {
-            register_Y = bus.read(location);
+            register_Y = read(location);
             set_ZN(register_Y);
             break;
         }
         case CPY: {
-            NES_Address diff = register_Y - bus.read(location);
+            NES_Address diff = register_Y - read(location);
             flags.bits.C = !(diff & 0x100);
             set_ZN(diff);
             break;
         }
         case CPX: {
-            NES_Address diff = register_X - bus.read(location);
+            NES_Address diff = register_X - read(location);
             flags.bits.C = !(diff & 0x100);
             set_ZN(diff);
             break;
@@ -264,21 +273,27 @@ bool CPU::type0(MainBus &bus, NES_Byte opcode) {
     return true;
 }
 
-bool CPU::type1(MainBus &bus, NES_Byte opcode) {
+template <NES_Byte opcode, bool is_decoded>
+inline bool CPU::type1(MainBus &bus, NES_Address operand) {
     if ((opcode & INSTRUCTION_MODE_MASK) != 0x1)
         return false;
+    // the immediate operand of a decoded instruction is the decoded operand
+    constexpr bool is_immediate = is_decoded && ((opcode & ADRESS_MODE_MASK) >> ADDRESS_MODE_SHIFT) == M1_IMMEDIATE;
+    auto read = [&](NES_Address address) -> NES_Byte {
+        return is_immediate ? static_cast<NES_Byte>(operand) : bus.read(address);
+    };
     // Location of the operand, could be in RAM
     NES_Address location = 0;
     auto op = static_cast<Operation1>((opcode & OPERATION_MASK) >> OPERATION_SHIFT);
     switch (static_cast<AddrMode1>((opcode & ADRESS_MODE_MASK) >> ADDRESS_MODE_SHIFT)) {
         case M1_INDEXED_INDIRECT_X: {
-            NES_Byte zero_address = register_X + bus.read(register_PC++);
+            NES_Byte zero_address = register_X + fetch_byte<is_decoded>(bus, operand);
             // Addresses wrap in zero page mode, thus pass through a mask
             location = bus.read(zero_address & 0xff) | bus.read((zero_address + 1) & 0xff) << 8;
             break;
         }
         case M1_ZERO_PAGE: {
-            location = bus.read(register_PC++);
+            location = fetch_byte<is_decoded>(bus, operand);
             break;
         }
         case M1_IMMEDIATE: {
@@ -286,12 +301,12 @@ bool CPU::type1(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case M1_ABSOLUTE: {
-            location = read_address(bus, register_PC);
+            location = fetch_address<is_decoded>(bus, operand);
             register_PC += 2;
             break;
         }
         case M1_INDIRECT_Y: {
-            NES_Byte zero_address = bus.read(register_PC++);
+            NES_Byte zero_address = fetch_byte<is_decoded>(bus, operand);
             location = bus.read(zero_address & 0xff) | bus.read((zero_address + 1) & 0xff) << 8;
             if (op != STA)
                 set_page_crossed(location, location + register_Y);
@@ -300,11 +315,11 @@ bool CPU::type1(MainBus &bus, NES_Byte opcode) {
         }
         case M1_INDEXED_X: {
             // Address wraps around in the zero page
-            location = (bus.read(register_PC++) + register_X) & 0xff;
+            location = (fetch_byte<is_decoded>(bus, operand) + register_X) & 0xff;
             break;
         }
         case M1_ABSOLUTE_Y: {
-            location = read_address(bus, register_PC);
+            location = fetch_address<is_decoded>(bus, operand);
             register_PC += 2;
             if (op != STA)
                 set_page_crossed(location, location + register_Y);
@@ -312,7 +327,7 @@ bool CPU::type1(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case M1_ABSOLUTE_X: {
-            location = read_address(bus, register_PC);
+            location = fetch_address<is_decoded>(bus, operand);
             register_PC += 2;
             if (op != STA)
                 set_page_crossed(location, location + register_X);
@@ -324,28 +339,28 @@ bool CPU::type1(MainBus &bus, NES_Byte opcode) {
 
     switch (op) {
         case ORA: {
-            register_A |= bus.read(location);
+            register_A |= read(location);
             set_ZN(register_A);
             break;
         }
         case AND: {
-            register_A &= bus.read(location);
+            register_A &= read(location);
             set_ZN(register_A);
             break;
         }
         case EOR: {
-            register_A ^= bus.read(location);
+            register_A ^= read(location);
             set_ZN(register_A);
             break;
         }
         case ADC: {
-            NES_Byte operand = bus.read(location);
-            NES_Address sum = register_A + operand + flags.bits.C;
+            NES_Byte value = read(location);
+            NES_Address sum = register_A + value + flags.bits.C;
             //Carry forward or UNSIGNED overflow
             flags.bits.C = sum & 0x100;
             //SIGNED overflow, would only happen if the sign of sum is
             //different from BOTH the operands
-            flags.bits.V = (register_A ^ sum) & (operand ^ sum) & 0x80;
+            flags.bits.V = (register_A ^ sum) & (value ^ sum) & 0x80;
             register_A = static_cast<NES_Byte>(sum);
             set_ZN(register_A);
             break;
@@ -355,19 +370,19 @@ bool CPU::type1(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case LDA: {
-            register_A = bus.read(location);
+            register_A = read(location);
             set_ZN(register_A);
             break;
         }
         case CMP: {
-            NES_Address diff = register_A - bus.read(location);
+            NES_Address diff = register_A - read(location);
             flags.bits.C = !(diff & 0x100);
             set_ZN(diff);
             break;
         }
         case SBC: {
             //High carry means "no borrow", thus negate and subtract
-            NES_Address subtrahend = bus.read(location),
+            NES_Address subtrahend = read(location),
                      diff = register_A - subtrahend - !flags.bits.C;
             //if the ninth bit is 1, the resulting number is negative => borrow => low carry
             flags.bits.C = !(diff & 0x100);
@@ -383,9 +398,15 @@ bool CPU::type1(MainBus &bus, NES_Byte opcode) {
     return true;
 }
 
-bool CPU::type2(MainBus &bus, NES_Byte opcode) {
+template <NES_Byte opcode, bool is_decoded>
+inline bool CPU::type2(MainBus &bus, NES_Address operand) {
     if ((opcode & INSTRUCTION_MODE_MASK) != 2)
         return false;
+    // the immediate operand of a decoded instruction is the decoded operand
+    constexpr bool is_immediate = is_decoded && ((opcode & ADRESS_MODE_MASK) >> ADDRESS_MODE_SHIFT) == M2_IMMEDIATE;
+    auto read = [&](NES_Address address) -> NES_Byte {
+        return is_immediate ? static_cast<NES_Byte>(operand) : bus.read(address);
+    };
 
     NES_Address location = 0;
     auto op = static_cast<Operation2>((opcode & OPERATION_MASK) >> OPERATION_SHIFT);
@@ -396,19 +417,19 @@ bool CPU::type2(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case M2_ZERO_PAGE: {
-            location = bus.read(register_PC++);
+            location = fetch_byte<is_decoded>(bus, operand);
             break;
         }
         case M2_ACCUMULATOR: {
             break;
         }
         case M2_ABSOLUTE: {
-            location = read_address(bus, register_PC);
+            location = fetch_address<is_decoded>(bus, operand);
             register_PC += 2;
             break;
         }
         case M2_INDEXED: {
-            location = bus.read(register_PC++);
+            location = fetch_byte<is_decoded>(bus, operand);
             NES_Byte index;
             if (op == LDX || op == STX)
                 index = register_Y;
@@ -419,7 +440,7 @@ bool CPU::type2(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case M2_ABSOLUTE_INDEXED: {
-            location = read_address(bus, register_PC);
+            location = fetch_address<is_decoded>(bus, operand);
             register_PC += 2;
             NES_Byte index;
             if (op == LDX || op == STX)
@@ -433,7 +454,7 @@ bool CPU::type2(MainBus &bus, NES_Byte opcode) {
         default: return false;
     }
 
-    NES_Address operand = 0;
+    NES_Address value = 0;
     switch (op) {
         case ASL:
         case ROL:
@@ -446,11 +467,11 @@ bool CPU::type2(MainBus &bus, NES_Byte opcode) {
                 set_ZN(register_A);
             } else {
                 auto prev_C = flags.bits.C;
-                operand = bus.read(location);
-                flags.bits.C = operand & 0x80;
-                operand = operand << 1 | (prev_C && (op == ROL));
-                set_ZN(operand);
-                bus.write(location, operand);
+                value = read(location);
+                flags.bits.C = value & 0x80;
+                value = value << 1 | (prev_C && (op == ROL));
+                set_ZN(value);
+                bus.write(location, value);
             }
             break;
         case LSR:
@@ -464,11 +485,11 @@ bool CPU::type2(MainBus &bus, NES_Byte opcode) {
                 set_ZN(register_A);
             } else {
                 auto prev_C = flags.bits.C;
-                operand = bus.read(location);
-                flags.bits.C = operand & 1;
-                operand = operand >> 1 | (prev_C && (op == ROR)) << 7;
-                set_ZN(operand);
-                bus.write(location, operand);
+                value = read(location);
+                flags.bits.C = value & 1;
+                value = value >> 1 | (prev_C && (op == ROR)) << 7;
+                set_ZN(value);
+                bus.write(location, value);
             }
             break;
         case STX: {
@@ -476,18 +497,18 @@ bool CPU::type2(MainBus &bus, NES_Byte opcode) {
             break;
         }
         case LDX: {
-            register_X = bus.read(location);
+            register_X = read(location);
             set_ZN(register_X);
             break;
         }
         case DEC: {
-            auto tmp = bus.read(location) - 1;
+            auto tmp = read(location) - 1;
             set_ZN(tmp);
             bus.write(location, tmp);
             break;
         }
         case INC: {
-            auto tmp = bus.read(location) + 1;
+            auto tmp = read(location) + 1;
             set_ZN(tmp);
             bus.write(location, tmp);
             break;
@@ -513,6 +534,37 @@ void CPU::reset(NES_Address start_address) {
     register_PC = start_address;
     // documented startup state
     register_SP = 0xfd;
+    spin_loop.is_entered = false;
+}
+
+void CPU::save(CPUState& state) const {
+    state.register_PC = register_PC;
+    state.register_SP = register_SP;
+    state.register_A = register_A;
+    state.register_X = register_X;
+    state.register_Y = register_Y;
+    state.flags = flags.byte;
+    state.padding = 0;
+    state.skip_cycles = skip_cycles;
+    state.cycles = cycles;
+}
+
+void CPU::load(const CPUState& state) {
+    register_PC = state.register_PC;
+    register_SP = state.register_SP;
+    register_A = state.register_A;
+    register_X = state.register_X;
+    register_Y = state.register_Y;
+    flags.byte = state.flags;
+    skip_cycles = state.skip_cycles;
+    cycles = state.cycles;
+    spin_loop.is_entered = false;
+}
+
+bool CPU::is_valid(const CPUState& state) {
+    // the longest stall is an OAM DMA (514 cycles) during an instruction
+    // and an interrupt, well below this bound
+    return state.skip_cycles >= 0 && state.skip_cycles <= 0x400;
 }
 
 void CPU::interrupt(MainBus &bus, InterruptType type) {
@@ -537,27 +589,225 @@ void CPU::interrupt(MainBus &bus, InterruptType type) {
             register_PC = read_address(bus, NMI_VECTOR);
             break;
     }
+    // the handler runs between two entries of an idle loop
+    spin_loop.is_entered = false;
     // add the number of cycles to handle the interrupt
     skip_cycles += 7;
+    if (type == NMI_INTERRUPT)
+        NES_COUNT(counters, nmis++);
 }
 
-void CPU::cycle(MainBus &bus) {
-    // increment the number of cycles
-    ++cycles;
-    // if in a skip cycle, return
-    if (skip_cycles-- > 1)
-        return;
-    // reset the number of skip cycles to 0
-    skip_cycles = 0;
-    // read the opcode from the bus and lookup the number of cycles
-    NES_Byte op = bus.read(register_PC++);
+template <NES_Byte opcode, bool is_decoded>
+void CPU::execute(CPU &cpu, MainBus &bus, NES_Address operand) {
     // Using short-circuit evaluation, call the other function only if the
     // first failed. ExecuteImplied must be called first and ExecuteBranch
-    // must be before ExecuteType0
-    if (implied(bus, op) || branch(bus, op) || type1(bus, op) || type2(bus, op) || type0(bus, op))
-        skip_cycles += OPERATION_CYCLES[op];
+    // must be before ExecuteType0 (the checks fold away for a constant
+    // opcode, leaving only the code of its addressing mode and operation)
+    if (cpu.implied<opcode, is_decoded>(bus, operand) ||
+        cpu.branch<opcode, is_decoded>(bus, operand) ||
+        cpu.type1<opcode, is_decoded>(bus, operand) ||
+        cpu.type2<opcode, is_decoded>(bus, operand) ||
+        cpu.type0<opcode, is_decoded>(bus, operand))
+        cpu.skip_cycles += OPERATION_CYCLES[opcode];
     else
-        std::cout << "failed to execute opcode: " << std::hex << +op << std::endl;
+        std::cout << "failed to execute opcode: " << std::hex << +opcode << std::endl;
+}
+
+template <bool is_decoded, std::size_t... opcodes>
+constexpr std::array<CPU::Instruction, 0x100> CPU::make_instructions(std::index_sequence<opcodes...>) {
+    return {{ &CPU::execute<opcodes, is_decoded>... }};
+}
+
+const std::array<CPU::Instruction, 0x100> CPU::instructions =
+    CPU::make_instructions<false>(std::make_index_sequence<0x100>());
+
+const std::array<CPU::Instruction, 0x100> CPU::decoded_instructions =
+    CPU::make_instructions<true>(std::make_index_sequence<0x100>());
+
+CPU::DecodedInstruction CPU::decode(NES_Byte opcode, NES_Address operand) {
+    return {decoded_instructions[opcode], operand, opcode, static_cast<NES_Byte>(instruction_length(opcode))};
+}
+
+int CPU::instruction_length(NES_Byte opcode) {
+    // unused opcodes take no cycles in the table
+    if (OPERATION_CYCLES[opcode] == 0)
+        return 0;
+    switch (opcode) {
+        case JSR:
+        case JMP:
+        case JMPI:
+            return 3;
+        case BRK: case PHP: case CLC: case PLP: case SEC: case RTI: case PHA:
+        case CLI: case RTS: case PLA: case SEI: case DEY: case TXA: case TYA:
+        case TXS: case TAY: case TAX: case CLV: case TSX: case INY: case DEX:
+        case CLD: case INX: case NOP: case SED:
+            return 1;
+    }
+    if ((opcode & BRANCH_INSTRUCTION_MASK) == BRANCH_INSTRUCTION_MASK_RESULT)
+        return 2;
+    const int mode = (opcode & ADRESS_MODE_MASK) >> ADDRESS_MODE_SHIFT;
+    switch (opcode & INSTRUCTION_MODE_MASK) {
+        case 0x1:
+            switch (static_cast<AddrMode1>(mode)) {
+                case M1_ABSOLUTE:
+                case M1_ABSOLUTE_Y:
+                case M1_ABSOLUTE_X:
+                    return 3;
+                default:
+                    return 2;
+            }
+        case 0x0:
+        case 0x2:
+            switch (static_cast<AddrMode2>(mode)) {
+                case M2_ACCUMULATOR:
+                    return 1;
+                case M2_ABSOLUTE:
+                case M2_ABSOLUTE_INDEXED:
+                    return 3;
+                default:
+                    return 2;
+            }
+        default:
+            return 0;
+    }
+}
+
+/// Return true if repeating an instruction with the same registers repeats
+/// its result, i.e., it only sets registers and reads memory.
+///
+/// @param opcode the opcode of the instruction
+/// @param operand the operand of the instruction
+/// @param read the address the instruction reads to write, -1 if none
+/// @return true if the instruction can be part of an idle loop
+///
+static bool is_spin_instruction(NES_Byte opcode, NES_Address operand, int& read) {
+    read = -1;
+    switch (opcode) {
+        case CLC: case SEC: case CLV: case CLD: case SED: case NOP:
+        case TAX: case TAY: case TXA: case TYA: case TSX: case TXS:
+        case INX: case INY: case DEX: case DEY:
+            return true;
+    }
+    if (CPU::instruction_length(opcode) == 1)
+        // stack, interrupt, and accumulator instructions
+        return (opcode & INSTRUCTION_MODE_MASK) == 0x2 && ((opcode & OPERATION_MASK) >> OPERATION_SHIFT) <= ROR;
+    const int operation = (opcode & OPERATION_MASK) >> OPERATION_SHIFT;
+    const int mode = (opcode & ADRESS_MODE_MASK) >> ADDRESS_MODE_SHIFT;
+    switch (opcode & INSTRUCTION_MODE_MASK) {
+        case 0x1:  // ORA, AND, EOR, ADC, LDA, CMP, SBC, but not STA
+            if (operation == STA)
+                return false;
+            if (mode == M1_ZERO_PAGE || mode == M1_ABSOLUTE)
+                read = operand;
+            return mode == M1_IMMEDIATE || read >= 0;
+        case 0x2:  // LDX, the others write memory
+            if (operation != LDX)
+                return false;
+            if (mode == M2_ZERO_PAGE || mode == M2_ABSOLUTE)
+                read = operand;
+            return mode == M2_IMMEDIATE || read >= 0;
+        case 0x0:  // BIT, LDY, CPY, CPX
+            if (operation != BIT && operation != LDY && operation != CPY && operation != CPX)
+                return false;
+            if (mode == M2_ZERO_PAGE || mode == M2_ABSOLUTE)
+                read = operand;
+            return (mode == M2_IMMEDIATE && operation != BIT) || read >= 0;
+    }
+    return false;
+}
+
+int CPU::enter_spin_loop(NES_Address branch, const MainBus& bus) {
+    const NES_Address address = register_PC;
+    const NES_Address end = branch + instruction_length(last_opcode) - 1;
+    const NES_Byte* first = bus.get_read_page(address >> 8);
+    const NES_Byte* last = bus.get_read_page(end >> 8);
+    if (spin_loop.address != address || spin_loop.branch != branch ||
+        spin_loop.pages[0] != first || spin_loop.pages[1] != last) {
+        // decode the loop (again after a bank switch)
+        spin_loop = SpinLoop();
+        spin_loop.address = address;
+        spin_loop.branch = branch;
+        spin_loop.pages[0] = first;
+        spin_loop.pages[1] = last;
+        // code outside PRG ROM can change while the loop is cached
+        if (address < 0x8000 || end < address || first == nullptr || last == nullptr)
+            return 0;
+        auto code = [&](NES_Address byte) {
+            return (byte >> 8 == address >> 8 ? first : last)[byte & 0xff];
+        };
+        int instructions = 0;
+        NES_Address pc = address;
+        while (pc != branch) {
+            const NES_Byte opcode = code(pc);
+            const int length = instruction_length(opcode);
+            if (length == 0 || pc + length > branch)
+                return 0;
+            NES_Address operand = 0;
+            if (length > 1)
+                operand = code(pc + 1);
+            if (length > 2)
+                operand |= code(pc + 2) << 8;
+            int read;
+            if (!is_spin_instruction(opcode, operand, read))
+                return 0;
+            // RAM and PRG reads have no side effects, PPU status reads only
+            // clear flags the first time
+            if (read >= 0x2000 && read < 0x6000) {
+                if (read >= 0x4000 || (read & 0x2007) != PPUSTATUS)
+                    return 0;
+                spin_loop.is_reading_ppu = true;
+            }
+#if defined(NES_COUNTERS)
+            spin_loop.reads[bus_region(pc)] += length;
+            if (read >= 0)
+                spin_loop.reads[bus_region(read)]++;
+#endif
+            pc += length;
+            instructions++;
+        }
+#if defined(NES_COUNTERS)
+        spin_loop.reads[BUS_PRG] += instruction_length(last_opcode);
+#endif
+        spin_loop.instructions = instructions + 1;
+        // a DEX, DEY, INX, or INY and a BNE back to it count to 0
+        const NES_Byte opcode = code(address);
+        if (instructions == 1 && last_opcode == (ZERO_ << BRANCH_ON_FLAG_SHIFT | BRANCH_INSTRUCTION_MASK_RESULT)) {
+            spin_loop.step = opcode == INX || opcode == INY ? 1 : opcode == DEX || opcode == DEY ? -1 : 0;
+            spin_loop.is_counting_x = opcode == INX || opcode == DEX;
+        }
+    }
+    if (spin_loop.instructions == 0)
+        return 0;
+    // the negative and zero flags follow the counter of a counting loop
+    CPU_Flags loop_flags = flags;
+    if (spin_loop.step != 0)
+        loop_flags.bits.N = loop_flags.bits.Z = false;
+    const NES_Byte registers[5] = {register_A, register_X, register_Y, register_SP, loop_flags.byte};
+    NES_Byte expected[5];
+    std::copy(spin_loop.registers, spin_loop.registers + 5, expected);
+    expected[spin_loop.is_counting_x ? 1 : 2] += spin_loop.step;
+    // a repeat of the loop from its last entry, with no interrupt or other
+    // code in between
+    const bool is_repeat = spin_loop.is_entered &&
+        steps - spin_loop.steps == static_cast<unsigned>(spin_loop.instructions) &&
+        std::equal(registers, registers + 5, expected);
+    spin_loop.length = cycles - spin_loop.cycles;
+    spin_loop.is_entered = true;
+    std::copy(registers, registers + 5, spin_loop.registers);
+    spin_loop.cycles = cycles;
+    spin_loop.steps = steps;
+    return is_repeat ? spin_loop.length : 0;
+}
+
+void CPU::cycle(MainBus &bus) {
+    // if in a skip cycle, count it down and return
+    if (skip_cycles > 1) {
+        ++cycles;
+        --skip_cycles;
+        NES_COUNT(counters, cycles++);
+        return;
+    }
+    step(bus);
 }
 
 }  // namespace NES
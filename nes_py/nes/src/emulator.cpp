@@ -7,108 +7,344 @@
 
 #include "emulator.hpp"
 #include "mapper_factory.hpp"
+#include "movie.hpp"
 #include "log.hpp"
 
 #include <cstring>
+#include <stdexcept>
+#include <utility>
 
 namespace NES {
 
-void Core::initialize(Controller* const controllers) 
-{
-    // set the read callbacks
-    bus.set_read_callback(PPUSTATUS, [&](void) { return ppu.get_status();          });
-    bus.set_read_callback(PPUDATA,   [&](void) { return ppu.get_data(picture_bus); });
-    bus.set_read_callback(JOY1,      [&](void) { return controllers[0].read();     });
-    bus.set_read_callback(JOY2,      [&](void) { return controllers[1].read();     });
-    bus.set_read_callback(OAMDATA,   [&](void) { return ppu.get_OAM_data();        });
-
-    // set the write callbacks
-    bus.set_write_callback(PPUCTRL,  [&](NES_Byte b) { ppu.control(b);                                             });
-    bus.set_write_callback(PPUMASK,  [&](NES_Byte b) { ppu.set_mask(b);                                            });
-    bus.set_write_callback(OAMADDR,  [&](NES_Byte b) { ppu.set_OAM_address(b);                                     });
-    bus.set_write_callback(PPUADDR,  [&](NES_Byte b) { ppu.set_data_address(b);                                    });
-    bus.set_write_callback(PPUSCROL, [&](NES_Byte b) { ppu.set_scroll(b);                                          });
-    bus.set_write_callback(PPUDATA,  [&](NES_Byte b) { ppu.set_data(picture_bus, b);                               });
-    bus.set_write_callback(OAMDMA,   [&](NES_Byte b) { cpu.skip_DMA_cycles(); ppu.do_DMA(bus.get_page_pointer(b)); });
-    bus.set_write_callback(JOY1,     [&](NES_Byte b) { controllers[0].strobe(b); controllers[1].strobe(b);         });
-    bus.set_write_callback(OAMDATA,  [&](NES_Byte b) { ppu.set_OAM_data(b);                                        });
-
-    // set the interrupt callback for the PPU
-    ppu.set_interrupt_callback([&]() { cpu.interrupt(bus, CPU::NMI_INTERRUPT); });
-}
-
 void Core::reset() {
     cpu.reset(bus);
     ppu.reset();
 }
 
 void Core::set_mapper(Mapper *mapper) {
+#if defined(NES_COUNTERS)
+    mapper->set_counters(&counters);
+#endif
     bus.set_mapper(mapper);
     picture_bus.set_mapper(mapper);
 }
 
-void Core::ppu_step(NESFrameBufferT* const framebuffer) {
-    // 3 PPU steps per CPU step
-    ppu.cycle(picture_bus, framebuffer);
-    ppu.cycle(picture_bus, framebuffer);
-    ppu.cycle(picture_bus, framebuffer);
+void Core::run(NESFrameBufferT* const framebuffer, int cycles) {
+    if (blocks)
+        run<true>(framebuffer, cycles);
+    else
+        run<false>(framebuffer, cycles);
+}
+
+template <bool is_caching>
+void Core::run(NESFrameBufferT* const framebuffer, int cycles) {
+#if defined(NES_COUNTERS)
+    ++counters.frames;
+#endif
+    clock = ppu_clock = 0;
+    is_interrupt_stale = true;
+    // the CPU cycle the PPU fires the next vertical blank interrupt on
+    int interrupt_clock = 0;
+    while (clock < cycles) {
+        // the PPU only changes when caught up, so the deadline holds until then
+        if (is_interrupt_stale) {
+            int dots = ppu.cycles_until_interrupt();
+            interrupt_clock = dots < 0 ? cycles + 1 : ppu_clock + (dots + 2) / 3;
+            is_interrupt_stale = false;
+        }
+        // the CPU cycle that executes the next instruction
+        int next = clock + cpu.get_idle_cycles() + 1;
+        if (interrupt_clock <= next && interrupt_clock <= cycles) {
+            // the PPU interrupts the CPU before the CPU cycle of this clock
+            cpu.idle(interrupt_clock - 1 - clock);
+            clock = interrupt_clock;
+            catch_up(framebuffer);
+            cpu.cycle(bus);
+        } else if (next <= cycles) {
+            cpu.idle(next - 1 - clock);
+            clock = next;
+            NES_Address address = cpu.get_PC();
+            const BlockCache::Block* block = is_caching ? blocks->find(address, bus) : nullptr;
+            if (block != nullptr && clock + block->max_cycles <= std::min(interrupt_clock, cycles + 1)) {
+                // neither the deadline nor the end pass within the block
+                for (int index = 0; ; index++) {
+                    const CPU::DecodedInstruction& instruction = block->instructions[index];
+                    cpu.step(bus, instruction);
+                    if (index + 1 == block->count || is_interrupt_stale)
+                        break;
+                    address += instruction.length;
+                    const int idle = cpu.get_idle_cycles();
+                    cpu.idle(idle);
+                    clock += idle + 1;
+                }
+            } else {
+                cpu.step(bus);
+            }
+            // an idle loop repeats until the interrupt (or the end of the
+            // cycles), skip to its last repeat before then
+            const int length = cpu.get_spin_cycles(address, bus);
+            if (length > 0) {
+                int last = interrupt_clock <= cycles ? interrupt_clock - 1 : cycles;
+                if (cpu.is_spinning_on_ppu()) {
+                    // or until the status it polls can change, the repeats
+                    // after the last one read the status again
+                    catch_up(framebuffer);
+                    last = std::min(last, clock + ppu.cycles_until_status_change(3 * length) / 3);
+                }
+                const int repeats = cpu.spin(last > clock ? (last - clock) / length : 0);
+                clock += repeats * length;
+            }
+        } else {
+            cpu.idle(cycles - clock);
+            clock = cycles;
+        }
+    }
+    catch_up(framebuffer);
+    clock = ppu_clock = 0;
 }
 
-void Core::step(NESFrameBufferT* const framebuffer) {
+void Core::catch_up(NESFrameBufferT* const framebuffer) {
     // 3 PPU steps per CPU step
-    ppu_step(framebuffer);
-    cpu.cycle(bus);
+    ppu.run(picture_bus, framebuffer, 3 * (clock - ppu_clock));
+    ppu_clock = clock;
+    ppu.sync(picture_bus, framebuffer);
+    is_interrupt_stale = true;
 }
 
-Emulator::Emulator(std::string rom_path) 
+Emulator::Emulator(std::string rom_path) : Emulator(ROMImage::open(rom_path)) { }
+
+Emulator::Emulator(std::shared_ptr<const ROMImage> rom)
 {
-    // set the read callbacks
-    core.bus.set_read_callback(PPUSTATUS, [&](void) { return core.ppu.get_status();          });
-    core.bus.set_read_callback(PPUDATA,   [&](void) { return core.ppu.get_data(core.picture_bus); });
+    // set the read callbacks (the PPU renders pending pixels before any
+    // access that observes or changes its state)
+    core.bus.set_read_callback(PPUSTATUS, [&](void) { sync_ppu(); return core.ppu.get_status();          });
+    core.bus.set_read_callback(PPUDATA,   [&](void) { sync_ppu(); return core.ppu.get_data(core.picture_bus); });
     core.bus.set_read_callback(JOY1,      [&](void) { return controllers[0].read();     });
     core.bus.set_read_callback(JOY2,      [&](void) { return controllers[1].read();     });
     core.bus.set_read_callback(OAMDATA,   [&](void) { return core.ppu.get_OAM_data();        });
 
     // set the write callbacks
-    core.bus.set_write_callback(PPUCTRL,  [&](NES_Byte b) { core.ppu.control(b);                                             });
-    core.bus.set_write_callback(PPUMASK,  [&](NES_Byte b) { core.ppu.set_mask(b);                                            });
-    core.bus.set_write_callback(OAMADDR,  [&](NES_Byte b) { core.ppu.set_OAM_address(b);                                     });
-    core.bus.set_write_callback(PPUADDR,  [&](NES_Byte b) { core.ppu.set_data_address(b);                                    });
-    core.bus.set_write_callback(PPUSCROL, [&](NES_Byte b) { core.ppu.set_scroll(b);                                          });
-    core.bus.set_write_callback(PPUDATA,  [&](NES_Byte b) { core.ppu.set_data(core.picture_bus, b);                               });
-    core.bus.set_write_callback(OAMDMA,   [&](NES_Byte b) { core.cpu.skip_DMA_cycles(); core.ppu.do_DMA(core.bus.get_page_pointer(b)); });
+    core.bus.set_write_callback(PPUCTRL,  [&](NES_Byte b) { sync_ppu(); core.ppu.control(b);                                             });
+    core.bus.set_write_callback(PPUMASK,  [&](NES_Byte b) { sync_ppu(); core.ppu.set_mask(b);                                            });
+    core.bus.set_write_callback(OAMADDR,  [&](NES_Byte b) { sync_ppu(); core.ppu.set_OAM_address(b);                                     });
+    core.bus.set_write_callback(PPUADDR,  [&](NES_Byte b) { sync_ppu(); core.ppu.set_data_address(b);                                    });
+    core.bus.set_write_callback(PPUSCROL, [&](NES_Byte b) { sync_ppu(); core.ppu.set_scroll(b);                                          });
+    core.bus.set_write_callback(PPUDATA,  [&](NES_Byte b) { sync_ppu(); core.ppu.set_data(core.picture_bus, b);                               });
+    core.bus.set_write_callback(OAMDMA,   [&](NES_Byte b) { sync_ppu(); core.cpu.skip_DMA_cycles(); core.ppu.do_DMA(core.bus.get_page_pointer(b)); });
     core.bus.set_write_callback(JOY1,     [&](NES_Byte b) { controllers[0].strobe(b); controllers[1].strobe(b);         });
-    core.bus.set_write_callback(OAMDATA,  [&](NES_Byte b) { core.ppu.set_OAM_data(b);                                        });
+    core.bus.set_write_callback(OAMDATA,  [&](NES_Byte b) { sync_ppu(); core.ppu.set_OAM_data(b);                                        });
+
+    // mapper writes can switch CHR banks and mirroring underneath the PPU
+    core.bus.set_mapper_write_callback([&]() { sync_ppu(); });
 
     // set the interrupt callback for the PPU
     core.ppu.set_interrupt_callback([&]() { core.cpu.interrupt(core.bus, CPU::NMI_INTERRUPT); });
 
-    // initialize the framebuffer to all black
+#if defined(NES_COUNTERS)
+    // count the work of the hot paths (the mapper is attached in set_mapper)
+    core.cpu.set_counters(&core.counters);
+    core.ppu.set_counters(&core.counters);
+    core.bus.set_counters(&core.counters);
+#endif
+
+    // initialize the framebuffer to all black (0x0F is black in the palette)
     std::memset(&framebuffer, 0, sizeof(framebuffer));
+    std::memset(&index_buffer, 0x0F, sizeof(index_buffer));
 
-    // load the ROM from disk, expect that the Python code has validated it
-    cartridge.loadFromFile(rom_path);
+    // reference the ROM image, expect that the Python code has validated it
+    cartridge.loadFromImage(std::move(rom));
 
     // create the mapper based on the mapper ID in the iNES header of the ROM
-    auto mapper = MapperFactory(&cartridge, [&](){ core.picture_bus.update_mirroring(); });
+    mapper = MapperFactory(&cartridge, [&](){ core.picture_bus.update_mirroring(); });
 
     // give the IO buses a pointer to the mapper
-    core.set_mapper(mapper);
+    core.set_mapper(mapper.get());
 }
 
 
-void Emulator::step() {
-    // render a single frame on the emulator
-    for (int i = 0; i < CYCLES_PER_FRAME; i++) {
-        core.step(&framebuffer);
+std::unique_ptr<Emulator> Emulator::clone() {
+    std::unique_ptr<Emulator> emulator(new Emulator(get_rom()));
+    emulator->copy_from(*this);
+    return emulator;
+}
+
+void Emulator::copy_from(Emulator& other) {
+    if (&other == this) return;
+    if (other.get_rom()->get_hash() != get_rom()->get_hash())
+        throw std::invalid_argument("the emulator runs another ROM");
+    set_render_mode(other.get_render_mode());
+    set_pixel_format(other.get_pixel_format());
+    set_cpu_engine(other.get_cpu_engine());
+    // the scratch state of the hasher holds the snapshot
+    if (!hashed_state)
+        hashed_state.reset(new State());
+    other.snapshot(hashed_state.get());
+    restore(hashed_state.get());
+    std::memcpy(&framebuffer, &other.framebuffer, sizeof(framebuffer));
+    std::memcpy(&index_buffer, &other.index_buffer, sizeof(index_buffer));
+}
+
+void Emulator::reset() {
+    core.reset();
+    cut_movie();
+}
+
+void Emulator::step() { step(true); }
+
+void Emulator::step(bool is_rendering) {
+    if (is_rendering) {
+        // render a single frame on the emulator
+        core.run(&framebuffer, CYCLES_PER_FRAME);
+        end_frame();
+        return;
     }
+    // emulate a single frame without composing its pixels, the pixels left
+    // pending by the last step are rendered before skipping
+    core.ppu.set_is_skipping_pixels(true, core.picture_bus, &framebuffer);
+    core.run(&framebuffer, CYCLES_PER_FRAME);
+    core.ppu.set_is_skipping_pixels(false, core.picture_bus, &framebuffer);
+    end_frame();
+}
+
+void Emulator::step(NES_Byte player_1, NES_Byte player_2, int frames) {
+    // set the controllers once, the game latches them every frame
+    controllers[0].write_buttons(player_1);
+    controllers[1].write_buttons(player_2);
+    // nobody observes the frames before the last, skip their pixels
+    for (int frame = 0; frame < frames; frame++)
+        step(frame == frames - 1);
+}
+
+void Emulator::snapshot(State* const state) {
+    state->magic = STATE_MAGIC;
+    state->version = STATE_VERSION;
+    state->size = sizeof(State);
+    state->mapper = cartridge.getMapper();
+    state->rom = get_rom()->get_hash();
+    core.cpu.save(state->cpu);
+    core.ppu.save(state->ppu);
+    core.bus.save(state->bus);
+    core.picture_bus.save(state->picture_bus);
+    mapper->save(state->cartridge);
+    controllers[0].save(state->controllers[0]);
+    controllers[1].save(state->controllers[1]);
+}
+
+bool Emulator::is_compatible(const State* const state) {
+    return state->magic == STATE_MAGIC &&
+        state->version == STATE_VERSION &&
+        state->size == sizeof(State) &&
+        state->mapper == cartridge.getMapper() &&
+        state->rom == get_rom()->get_hash() &&
+        // the registers index tables, screens, and banks when applied
+        CPU::is_valid(state->cpu) &&
+        PPU::is_valid(state->ppu) &&
+        mapper->is_valid(state->cartridge);
+}
+
+void Emulator::restore(const State* const state) {
+    if (!is_compatible(state))
+        throw std::invalid_argument("state is from another version or ROM, or is corrupted");
+    load(state);
+    cut_movie();
+}
+
+void Emulator::load(const State* const state) {
+    core.cpu.load(state->cpu);
+    core.ppu.load(state->ppu);
+    core.bus.load(state->bus);
+    core.picture_bus.load(state->picture_bus);
+    mapper->load(state->cartridge);
+    controllers[0].load(state->controllers[0]);
+    controllers[1].load(state->controllers[1]);
+}
+
+void Emulator::set_hash_ring(uint64_t* ring, std::size_t size) {
+    if (ring != nullptr && size == 0)
+        throw std::invalid_argument("the hash ring must hold at least one hash");
+    hash_ring = ring;
+    hash_ring_size = size;
+    hash_count = 0;
+}
+
+uint64_t Emulator::hash() {
+    if (!hasher) {
+        hasher.reset(new StateHasher);
+        hashed_state.reset(new State());
+    }
+    snapshot(hashed_state.get());
+    return hasher->hash(*hashed_state);
+}
+
+void Emulator::end_frame() {
+    record_hash();
+    if (movie != nullptr)
+        movie->append(*this);
+}
+
+void Emulator::cut_movie() {
+    if (movie != nullptr)
+        movie->cut(*this);
+}
+
+void Emulator::rollout(
+    const State* const state,
+    const NES_Byte* actions,
+    std::size_t players,
+    int frames,
+    const NES_Address* addresses,
+    std::size_t count,
+    NES_Byte* trace
+) {
+    if (!is_compatible(state))
+        throw std::invalid_argument("state is from another version or ROM, or is corrupted");
+    for (std::size_t index = 0; index < count; index++)
+        if (addresses[index] >= 0x800)
+            throw std::invalid_argument("rollout addresses must be below 0x800");
+    // skip the pixels left pending before restoring, the screen keeps the
+    // last rendered frame
+    core.ppu.set_is_skipping_pixels(true, core.picture_bus, &framebuffer);
+    load(state);
+    const NES_Byte* ram = get_memory_buffer();
+    for (int frame = 0; frame < frames; frame++) {
+        controllers[0].write_buttons(actions[0]);
+        if (players > 1)
+            controllers[1].write_buttons(actions[1]);
+        actions += players;
+        core.run(&framebuffer, CYCLES_PER_FRAME);
+        record_hash();
+        for (std::size_t index = 0; index < count; index++)
+            trace[index] = ram[addresses[index]];
+        trace += count;
+    }
+    core.ppu.set_is_skipping_pixels(false, core.picture_bus, &framebuffer);
+    cut_movie();
+}
+
+void Emulator::set_cpu_engine(CPU::Engine engine) {
+    if (engine == get_cpu_engine()) return;
+    core.blocks.reset(engine == CPU::ENGINE_BLOCK_CACHE ? new BlockCache() : nullptr);
+}
+
+void Emulator::set_pixel_format(PPU::PixelFormat format) {
+    if (format == get_pixel_format()) return;
+    NESIndexBufferT* const indexes = format == PPU::PIXEL_INDEXED ? &index_buffer : nullptr;
+    core.ppu.set_index_screen(indexes, core.picture_bus, &framebuffer);
+    // the screen buffer shows the last frame written in the indexed format
+    if (format == PPU::PIXEL_RGB)
+        convert_indexes(index_buffer, framebuffer);
+}
+
+void Emulator::convert_screen() {
+    if (get_pixel_format() == PPU::PIXEL_INDEXED)
+        convert_indexes(index_buffer, framebuffer);
 }
 
 void Emulator::ppu_step() {
     // render a single frame on the emulator
-    for (int i = 0; i < CYCLES_PER_FRAME; i++) {
-        core.ppu_step(&framebuffer);
-    }
+    core.ppu.run(core.picture_bus, &framebuffer, 3 * CYCLES_PER_FRAME);
+    sync_ppu();
+    cut_movie();
 }
 
 }  // namespace NES
@@ -7,30 +7,672 @@
 //  Copyright (c) 2019 Christian Kauten. All rights reserved.
 //
 #include "common.hpp"
+#include "counters.hpp"
 #include "emulator.hpp"
+#include "movie.hpp"
+#include "vec_emulator.hpp"
+#include "snapshot_pool.hpp"
+#include "observation.hpp"
+#include "reward.hpp"
+#include "rom_image.hpp"
+#include "shared_batch.hpp"
+#include "state_hash.hpp"
 
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
+#include <pybind11/stl.h>
 
 namespace py = pybind11;
 
+/// Return a view of the RGB screens of a batch of emulators.
+///
+/// @param self the Python batch of emulators to return the screens of, which
+/// the view keeps alive
+/// @return an N x HEIGHT x WIDTH x 3 array of RGB screens
+///
+static py::array_t<uint8_t> vec_screen_buffer(const py::object& self) {
+    NES::VecEmulator& vec = self.cast<NES::VecEmulator&>();
+    if (vec.has_frame_stacks())
+        throw py::value_error("the screens are preprocessed, use frame_stacks instead");
+    if (vec.get_observation_buffer() != nullptr)
+        throw py::value_error("the screens are written to the observation buffer, use observations instead");
+    const py::ssize_t N = vec.size();
+    const py::ssize_t HEIGHT = NES::Emulator::HEIGHT;
+    const py::ssize_t WIDTH = NES::Emulator::WIDTH;
+    return py::array_t<uint8_t>(
+        {N, HEIGHT, WIDTH, py::ssize_t(3)},                     // shape (3 channels)
+        {HEIGHT * WIDTH * 3, WIDTH * 3, py::ssize_t(3), py::ssize_t(1)},  // packed RGB
+        vec.get_observations(),                                 // pointer to data
+        self                                                    // base owning the data
+    );
+}
+
+/// Return a view of the RAM of a batch of emulators.
+///
+/// @param self the Python batch of emulators to return the RAM of, which the
+/// view keeps alive
+/// @return an N x 0x800 array of RAM copied after the last step
+///
+static py::array_t<uint8_t> vec_memory_buffer(const py::object& self) {
+    NES::VecEmulator& vec = self.cast<NES::VecEmulator&>();
+    const py::ssize_t N = vec.size();
+    const py::ssize_t SIZE = NES::VecEmulator::MEMORY_SIZE;
+    return py::array_t<uint8_t>(
+        {N, SIZE},                                              // shape (2048 bytes each)
+        {SIZE, py::ssize_t(1)},                                 // stride (1 byte)
+        vec.get_memory(),                                       // pointer to data
+        self                                                    // base owning the data
+    );
+}
+
+/// Return the batch of emulators if it evaluates a reward specification.
+///
+/// @param vec the batch of emulators to check
+/// @return the batch of emulators
+/// @throws py::value_error if the batch has no reward specification
+///
+static NES::VecEmulator& with_rewards(NES::VecEmulator& vec) {
+    if (!vec.has_rewards())
+        throw py::value_error("the batch has no reward spec");
+    return vec;
+}
+
+/// Return a view of a (frames, height, width) stack of frames.
+///
+/// @param self the Python observation pipeline to return the stack of, which
+/// the view keeps alive
+/// @return a frames x height x width array from oldest to newest frame
+///
+static py::array_t<uint8_t> frame_stack(const py::object& self) {
+    NES::ObservationPipeline& pipeline = self.cast<NES::ObservationPipeline&>();
+    const NES::ObservationConfig& config = pipeline.get_config();
+    return py::array_t<uint8_t>(
+        {py::ssize_t(config.frames), py::ssize_t(config.height), py::ssize_t(config.width)},
+        pipeline.get_stack(),                                   // pointer to data
+        self                                                    // base owning the data
+    );
+}
+
+/// Return a view of the stacks of frames of a batch of emulators.
+///
+/// @param self the Python batch of emulators to return the stacks of, which
+/// the view keeps alive
+/// @return an N x frames x height x width array from oldest to newest frame
+///
+static py::array_t<uint8_t> vec_frame_stacks(const py::object& self) {
+    NES::VecEmulator& vec = self.cast<NES::VecEmulator&>();
+    if (!vec.has_frame_stacks())
+        throw py::value_error("the batch has no observation config");
+    const NES::ObservationConfig& config = vec.get_observation_config();
+    const py::ssize_t N = vec.size();
+    const py::ssize_t HEIGHT = config.height;
+    const py::ssize_t WIDTH = config.width;
+    return py::array_t<uint8_t>(
+        {N, py::ssize_t(config.frames), HEIGHT, WIDTH},         // shape
+        {py::ssize_t(vec.get_frame_stack_stride()), HEIGHT * WIDTH, WIDTH, py::ssize_t(1)},  // rings of 2 x frames
+        vec.get_frame_stacks(),                                 // pointer to data
+        self                                                    // base owning the data
+    );
+}
+
+/// Return a view of the observations of a batch of emulators.
+///
+/// @param self the Python batch of emulators to return the observations of,
+/// which the view keeps alive
+/// @return the observation buffer in its layout if the batch has one, and
+/// otherwise the stacks of frames or the RGB screens
+///
+static py::array_t<uint8_t> vec_observations(const py::object& self) {
+    NES::VecEmulator& vec = self.cast<NES::VecEmulator&>();
+    NES::NES_Byte* buffer = vec.get_observation_buffer();
+    if (buffer == nullptr)
+        return vec.has_frame_stacks() ? vec_frame_stacks(self) : vec_screen_buffer(self);
+    const py::ssize_t N = vec.size();
+    py::ssize_t channels = 3, height = NES::Emulator::HEIGHT, width = NES::Emulator::WIDTH;
+    if (vec.has_frame_stacks()) {
+        const NES::ObservationConfig& config = vec.get_observation_config();
+        channels = config.frames;
+        height = config.height;
+        width = config.width;
+    }
+    std::vector<py::ssize_t> shape = {N, height, width, channels};
+    if (vec.get_observation_layout() == NES::ObservationLayout::NCHW)
+        shape = {N, channels, height, width};
+    // the caller owns the buffer, the batch keeps it alive
+    return py::array_t<uint8_t>(shape, buffer, self);
+}
+
+/// Return the validated view of a buffer to write the observations of a
+/// batch of emulators to.
+///
+/// @param buffer the buffer of bytes to view
+/// @param size the number of bytes of the observations of the batch
+/// @return the writable view of the buffer
+/// @throws py::value_error if the buffer isn't C-contiguous bytes of the size
+///
+static py::buffer_info observation_buffer(const py::buffer& buffer, std::size_t size) {
+    py::buffer_info info = buffer.request(true);
+    bool is_contiguous = info.itemsize == 1;
+    py::ssize_t stride = 1;
+    for (py::ssize_t dim = info.ndim - 1; dim >= 0; dim--) {
+        if (info.shape[dim] != 1 && info.strides[dim] != stride)
+            is_contiguous = false;
+        stride *= info.shape[dim];
+    }
+    if (!is_contiguous || static_cast<std::size_t>(info.size) != size)
+        throw py::value_error("the observation buffer must be a C-contiguous buffer of " + std::to_string(size) + " bytes");
+    return info;
+}
+
+/// Return the slot of a shared batch if it is in range.
+///
+/// @param batch the shared batch to check the slot of
+/// @param slot the index of the slot
+/// @return the index of the slot
+/// @throws py::index_error if the slot is out of range
+///
+static std::size_t shared_slot(const NES::SharedBatch& batch, std::size_t slot) {
+    if (slot >= batch.num_slots())
+        throw py::index_error("slot index out of range");
+    return slot;
+}
+
+/// Return the worker of a shared batch if it is in range.
+///
+/// @param batch the shared batch to check the worker of
+/// @param worker the index of the worker
+/// @return the index of the worker
+/// @throws py::index_error if the worker is out of range
+///
+static std::size_t shared_worker(const NES::SharedBatch& batch, std::size_t worker) {
+    if (worker >= batch.num_workers())
+        throw py::index_error("worker index out of range");
+    return worker;
+}
+
+/// Return a view of a region of a shared batch.
+///
+/// @param self the Python shared batch, which the view keeps alive so the
+/// segment stays mapped while the view exists
+/// @param data the start of the region
+/// @param shape the shape of the region
+/// @return a C-contiguous view of the region
+///
+template <typename T>
+static py::array_t<T> shared_view(const py::object& self, T* data, const std::vector<py::ssize_t>& shape) {
+    return py::array_t<T>(shape, data, self);
+}
+
+/// Return the counts of each region of the CPU bus as a dictionary.
+///
+/// @param counts the count of each region of the CPU bus
+/// @return a dictionary of the counts keyed by the name of the region
+///
+static py::dict bus_regions(const uint64_t (&counts)[NES::BUS_REGIONS]) {
+    py::dict regions;
+    regions["ram"] = counts[NES::BUS_RAM];
+    regions["ppu"] = counts[NES::BUS_PPU];
+    regions["io"] = counts[NES::BUS_IO];
+    regions["extended_ram"] = counts[NES::BUS_EXTENDED_RAM];
+    regions["prg"] = counts[NES::BUS_PRG];
+    return regions;
+}
+
+/// Return a pointer to the states packed in an array of bytes.
+///
+/// @param data the first byte of the states
+/// @param count the number of states in the array
+/// @param aligned the storage to copy the states to if the array isn't
+/// aligned for the fields of a state
+/// @return a pointer to the first state
+///
+static const NES::State* as_states(const uint8_t* data, std::size_t count, std::vector<NES::State>& aligned) {
+    if (reinterpret_cast<std::uintptr_t>(data) % alignof(NES::State) == 0)
+        return reinterpret_cast<const NES::State*>(data);
+    aligned.resize(count);
+    std::memcpy(aligned.data(), data, count * sizeof(NES::State));
+    return aligned.data();
+}
+
+/// Return the validated view of a buffer that holds a single state.
+///
+/// @param buffer the buffer of bytes to view
+/// @param writable whether to request a writable view of the buffer
+/// @return the view of the buffer, which keeps the buffer locked
+/// @throws py::value_error if the buffer isn't a contiguous state of bytes
+///
+static py::buffer_info state_buffer(const py::buffer& buffer, bool writable) {
+    py::buffer_info info = buffer.request(writable);
+    if (info.ndim != 1 || info.itemsize != 1 || info.strides[0] != 1 ||
+        static_cast<std::size_t>(info.size) != sizeof(NES::State))
+        throw py::value_error("state must be a contiguous buffer of " + std::to_string(sizeof(NES::State)) + " bytes");
+    return info;
+}
+
+/// Return the state of the calling thread to stage unaligned buffers in.
+static NES::State& scratch_state() {
+    static thread_local NES::State state;
+    return state;
+}
+
+/// Return the number of controller bytes per frame of an array of actions.
+///
+/// @param actions the actions with shape (..., frames) for player 1 only or
+/// (..., frames, 2) for both players
+/// @param ndim the number of dimensions of the actions for player 1 only
+/// @return the number of controller bytes per frame (1 or 2)
+///
+static std::size_t action_players(const py::array& actions, py::ssize_t ndim) {
+    if (actions.ndim() == ndim)
+        return 1;
+    if (actions.ndim() == ndim + 1 && actions.shape(ndim) == 2)
+        return 2;
+    throw py::value_error("actions must have one or two controller bytes per frame");
+}
+
 PYBIND11_MODULE(emulator, m) {   
+    py::enum_<NES::PPU::PixelFormat>(m, "PixelFormat")
+        .value("RGB", NES::PPU::PIXEL_RGB)
+        .value("INDEXED", NES::PPU::PIXEL_INDEXED)
+    ;
+
+    py::enum_<NES::PPU::RenderMode>(m, "RenderMode")
+        .value("DOT", NES::PPU::RENDER_DOT)
+        .value("SCANLINE", NES::PPU::RENDER_SCANLINE)
+    ;
+
+    py::enum_<NES::CPU::Engine>(m, "CPUEngine")
+        .value("INTERPRETER", NES::CPU::ENGINE_INTERPRETER)
+        .value("BLOCK_CACHE", NES::CPU::ENGINE_BLOCK_CACHE)
+    ;
+
+    py::enum_<NES::RAMEncoding>(m, "RAMEncoding")
+        .value("BINARY", NES::RAMEncoding::BINARY)
+        .value("DIGITS", NES::RAMEncoding::DIGITS)
+        .value("BCD", NES::RAMEncoding::BCD)
+    ;
+
+    py::enum_<NES::ObservationLayout>(m, "ObservationLayout")
+        .value("NHWC", NES::ObservationLayout::NHWC)
+        .value("NCHW", NES::ObservationLayout::NCHW)
+    ;
+
+    py::enum_<NES::Comparison>(m, "Comparison")
+        .value("EQUAL", NES::Comparison::EQUAL)
+        .value("NOT_EQUAL", NES::Comparison::NOT_EQUAL)
+        .value("LESS", NES::Comparison::LESS)
+        .value("LESS_EQUAL", NES::Comparison::LESS_EQUAL)
+        .value("GREATER", NES::Comparison::GREATER)
+        .value("GREATER_EQUAL", NES::Comparison::GREATER_EQUAL)
+    ;
+
+    m.attr("COUNTERS_ENABLED") = NES::COUNTERS_ENABLED;
+    m.attr("STATE_SIZE") = sizeof(NES::State);
+    m.attr("SHARED_MEMORY_ENABLED") = NES::SHARED_MEMORY_ENABLED;
+
+    m.def(
+        "hash_state",
+        [](const py::buffer& buffer) {
+            const py::buffer_info info = state_buffer(buffer, false);
+            if (reinterpret_cast<std::uintptr_t>(info.ptr) % alignof(NES::State) == 0)
+                return NES::hash_state(*static_cast<const NES::State*>(info.ptr));
+            std::memcpy(&scratch_state(), info.ptr, sizeof(NES::State));
+            return NES::hash_state(scratch_state());
+        },
+        py::arg("state"),
+        "Return the 64-bit hash of a state from dump_state, the same as the hash of the emulator in that state"
+    );
+
+    py::class_<NES::Counters>(m, "NESCounters")
+        .def_readonly("instructions", &NES::Counters::instructions, "The number of CPU instructions retired")
+        .def_readonly("cycles", &NES::Counters::cycles, "The number of CPU cycles run")
+        .def_property_readonly("reads", [](const NES::Counters& counters) { return bus_regions(counters.reads); }, "The number of CPU bus reads in each region")
+        .def_property_readonly("writes", [](const NES::Counters& counters) { return bus_regions(counters.writes); }, "The number of CPU bus writes in each region")
+        .def_readonly("bank_switches", &NES::Counters::bank_switches, "The number of writes to the bank registers of the mapper")
+        .def_readonly("nmis", &NES::Counters::nmis, "The number of non-maskable interrupts fired by the PPU")
+        .def_readonly("rendering_dots", &NES::Counters::rendering_dots, "The number of PPU dots on the pre-render and visible scanlines")
+        .def_readonly("vblank_dots", &NES::Counters::vblank_dots, "The number of PPU dots on the post-render and vertical blank scanlines")
+        .def_readonly("frames", &NES::Counters::frames, "The number of frames stepped")
+    ;
+
+    py::class_<NES::ObservationConfig>(m, "NESObservationConfig")
+        .def(
+            py::init([](std::tuple<int, int, int, int> crop, int height, int width, int frames) {
+                NES::ObservationConfig config;
+                std::tie(config.crop_top, config.crop_left, config.crop_height, config.crop_width) = crop;
+                config.height = height;
+                config.width = width;
+                config.frames = frames;
+                return config;
+            }),
+            py::arg("crop") = std::make_tuple(0, 0, NES::Emulator::HEIGHT, NES::Emulator::WIDTH),
+            py::arg("height") = 84,
+            py::arg("width") = 84,
+            py::arg("frames") = 4,
+            "Configure grayscale frames cropped to (top, left, height, width), resized, and stacked"
+        )
+        .def_readwrite("crop_top", &NES::ObservationConfig::crop_top)
+        .def_readwrite("crop_left", &NES::ObservationConfig::crop_left)
+        .def_readwrite("crop_height", &NES::ObservationConfig::crop_height)
+        .def_readwrite("crop_width", &NES::ObservationConfig::crop_width)
+        .def_readwrite("height", &NES::ObservationConfig::height)
+        .def_readwrite("width", &NES::ObservationConfig::width)
+        .def_readwrite("frames", &NES::ObservationConfig::frames)
+
+        .def(py::pickle(
+            [](const NES::ObservationConfig& config) {
+                return py::make_tuple(
+                    config.crop_top,
+                    config.crop_left,
+                    config.crop_height,
+                    config.crop_width,
+                    config.height,
+                    config.width,
+                    config.frames
+                );
+            },
+            [](const py::tuple& state) {
+                if (state.size() != 7)
+                    throw std::runtime_error("invalid observation config state");
+                NES::ObservationConfig config;
+                config.crop_top = state[0].cast<int>();
+                config.crop_left = state[1].cast<int>();
+                config.crop_height = state[2].cast<int>();
+                config.crop_width = state[3].cast<int>();
+                config.height = state[4].cast<int>();
+                config.width = state[5].cast<int>();
+                config.frames = state[6].cast<int>();
+                return config;
+            }
+        ))
+    ;
+
+    py::class_<NES::ObservationPipeline>(m, "NESObservationPipeline")
+        .def(py::init<const NES::ObservationConfig&>(), py::arg("config"))
+
+        .def_property_readonly("config", &NES::ObservationPipeline::get_config)
+
+        .def(
+            "reset",
+            [](const py::object& self, NES::Emulator& emu) {
+                NES::ObservationPipeline& pipeline = self.cast<NES::ObservationPipeline&>();
+                {
+                    py::gil_scoped_release release;
+                    if (emu.get_pixel_format() == NES::PPU::PIXEL_INDEXED)
+                        pipeline.reset(*emu.get_index_buffer());
+                    else
+                        pipeline.reset(*emu.get_screen_buffer());
+                }
+                return frame_stack(self);
+            },
+            py::arg("emulator"),
+            "Fill the stack with the screen of an emulator and return the stack"
+        )
+
+        .def(
+            "push",
+            [](const py::object& self, NES::Emulator& emu) {
+                NES::ObservationPipeline& pipeline = self.cast<NES::ObservationPipeline&>();
+                {
+                    py::gil_scoped_release release;
+                    if (emu.get_pixel_format() == NES::PPU::PIXEL_INDEXED)
+                        pipeline.push(*emu.get_index_buffer());
+                    else
+                        pipeline.push(*emu.get_screen_buffer());
+                }
+                return frame_stack(self);
+            },
+            py::arg("emulator"),
+            "Push the screen of an emulator onto the stack and return the stack"
+        )
+
+        .def("stack", &frame_stack, "Get the frames x height x width stack from oldest to newest frame")
+    ;
+
+    py::class_<NES::RewardSpec>(m, "NESRewardSpec")
+        .def(py::init<>())
+
+        .def_property_readonly("num_values", [](const NES::RewardSpec& spec) { return spec.values.size(); })
+        .def_readwrite("low", &NES::RewardSpec::low, "The least reward")
+        .def_readwrite("high", &NES::RewardSpec::high, "The greatest reward")
+
+        .def(
+            "value",
+            &NES::RewardSpec::add_value,
+            py::arg("addresses"),
+            py::arg("encoding") = NES::RAMEncoding::BINARY,
+            "Add a value decoded from RAM addresses listed from the least significant and return its index"
+        )
+
+        .def(
+            "condition",
+            [](NES::RewardSpec& spec, std::size_t value, NES::Comparison comparison, int64_t operand, bool delta) {
+                return spec.add_condition(value, delta, comparison, operand);
+            },
+            py::arg("value"),
+            py::arg("comparison"),
+            py::arg("operand"),
+            py::arg("delta") = false,
+            "Add a comparison of a value (or its change since the last frame if delta) with a constant and return its index"
+        )
+
+        .def(
+            "reward",
+            [](NES::RewardSpec& spec, std::size_t value, double weight, bool delta, double low, double high) {
+                spec.add_term(false, value, delta, weight, low, high);
+            },
+            py::arg("value"),
+            py::arg("weight") = 1.0,
+            py::arg("delta") = false,
+            py::arg("low") = -std::numeric_limits<double>::infinity(),
+            py::arg("high") = std::numeric_limits<double>::infinity(),
+            "Add a value (or its change since the last frame if delta) times a weight clipped to [low, high] to the reward"
+        )
+
+        .def(
+            "reward_if",
+            [](NES::RewardSpec& spec, std::size_t condition, double weight) {
+                spec.add_term(true, condition, false, weight, -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity());
+            },
+            py::arg("condition"),
+            py::arg("weight"),
+            "Add a weight to the reward of the frames a condition holds on"
+        )
+
+        .def("done_if", &NES::RewardSpec::add_termination, py::arg("condition"), "Terminate the episode on the frames a condition holds on")
+
+        // specs pickle so that worker processes can evaluate them
+        .def(py::pickle(
+            [](const NES::RewardSpec& spec) {
+                py::list values, conditions, terms;
+                for (const NES::RewardSpec::Value& value : spec.values)
+                    values.append(py::make_tuple(value.addresses, value.encoding));
+                for (const NES::RewardSpec::Condition& condition : spec.conditions)
+                    conditions.append(py::make_tuple(condition.value, condition.is_delta, condition.comparison, condition.operand));
+                for (const NES::RewardSpec::Term& term : spec.terms)
+                    terms.append(py::make_tuple(term.is_condition, term.index, term.is_delta, term.weight, term.low, term.high));
+                return py::make_tuple(values, conditions, terms, spec.terminations, spec.low, spec.high);
+            },
+            [](const py::tuple& state) {
+                if (state.size() != 6)
+                    throw std::runtime_error("invalid reward spec state");
+                NES::RewardSpec spec;
+                for (const py::handle& item : state[0].cast<py::list>()) {
+                    const py::tuple value = item.cast<py::tuple>();
+                    spec.add_value(value[0].cast<std::vector<NES::NES_Address>>(), value[1].cast<NES::RAMEncoding>());
+                }
+                for (const py::handle& item : state[1].cast<py::list>()) {
+                    const py::tuple condition = item.cast<py::tuple>();
+                    spec.add_condition(
+                        condition[0].cast<std::size_t>(),
+                        condition[1].cast<bool>(),
+                        condition[2].cast<NES::Comparison>(),
+                        condition[3].cast<int64_t>()
+                    );
+                }
+                for (const py::handle& item : state[2].cast<py::list>()) {
+                    const py::tuple term = item.cast<py::tuple>();
+                    spec.add_term(
+                        term[0].cast<bool>(),
+                        term[1].cast<std::size_t>(),
+                        term[2].cast<bool>(),
+                        term[3].cast<double>(),
+                        term[4].cast<double>(),
+                        term[5].cast<double>()
+                    );
+                }
+                spec.terminations = state[3].cast<std::vector<std::size_t>>();
+                spec.low = state[4].cast<double>();
+                spec.high = state[5].cast<double>();
+                return spec;
+            }
+        ))
+    ;
+
+    py::class_<NES::RewardProgram>(m, "NESRewardProgram")
+        .def(py::init<const NES::RewardSpec&>(), py::arg("spec"))
+
+        .def_property_readonly("spec", &NES::RewardProgram::get_spec)
+        .def_property_readonly("num_values", &NES::RewardProgram::num_values)
+
+        .def(
+            "reset",
+            [](NES::RewardProgram& program, NES::Emulator& emu) {
+                py::array_t<int64_t> info(program.num_values());
+                program.reset(emu.get_memory_buffer(), info.mutable_data());
+                return info;
+            },
+            py::arg("emulator"),
+            "Start an episode from the RAM of an emulator and return its values"
+        )
+
+        .def(
+            "evaluate",
+            [](NES::RewardProgram& program, NES::Emulator& emu) {
+                py::array_t<int64_t> info(program.num_values());
+                float reward;
+                NES::NES_Byte done;
+                program.evaluate(emu.get_memory_buffer(), &reward, &done, info.mutable_data());
+                return py::make_tuple(reward, done != 0, info);
+            },
+            py::arg("emulator"),
+            "Evaluate the frame an emulator stepped and return the (reward, done, values)"
+        )
+    ;
+
+    // Python holds images as non-const, the emulators only read them
+    py::class_<NES::ROMImage, std::shared_ptr<NES::ROMImage>>(m, "NESROMImage")
+        .def(
+            py::init([](const py::buffer& data) {
+                // accept bytes, bytearray, memoryview, and uint8 arrays
+                py::buffer_info info = data.request();
+                if (info.ndim != 1 || info.itemsize != 1 || info.strides[0] != 1)
+                    throw py::value_error("ROM data must be a contiguous buffer of bytes");
+                return std::const_pointer_cast<NES::ROMImage>(NES::ROMImage::from_buffer(
+                    static_cast<const NES::NES_Byte*>(info.ptr),
+                    info.size
+                ));
+            }),
+            py::arg("data"),
+            "Share the bytes of an iNES ROM file between emulators"
+        )
+        .def_static(
+            "open",
+            [](const std::string& path) {
+                return std::const_pointer_cast<NES::ROMImage>(NES::ROMImage::open(path));
+            },
+            py::arg("path"),
+            "Return the shared, memory-mapped image of an iNES ROM file"
+        )
+        .def_property_readonly("hash", &NES::ROMImage::get_hash, "The 64-bit FNV-1a hash of the ROM")
+        .def_property_readonly("is_mapped", &NES::ROMImage::get_is_mapped, "Whether the ROM is memory-mapped")
+        .def("__len__", &NES::ROMImage::size)
+    ;
+
     py::class_<NES::Emulator>(m, "NESEmulator")
         .def(py::init<const std::string&>())
+        .def(py::init<std::shared_ptr<NES::ROMImage>>(), py::arg("rom"))
+
+        .def_property_readonly(
+            "rom",
+            [](NES::Emulator& emu) { return std::const_pointer_cast<NES::ROMImage>(emu.get_rom()); },
+            "The shared image of the ROM the emulator runs"
+        )
 
         .def_property_readonly_static("width", [](py::object) { return NES::Emulator::WIDTH; })
         .def_property_readonly_static("height", [](py::object) { return NES::Emulator::HEIGHT; })        
 
-        .def("reset", &NES::Emulator::reset, "Reset the emulator")
-        .def("step", &NES::Emulator::step, "Perform a step on the emulator")
-        
+        .def_property(
+            "render_mode",
+            &NES::Emulator::get_render_mode,
+            &NES::Emulator::set_render_mode,
+            "The mode the PPU renders pixels with (per-dot or batched per scanline)"
+        )
+
+        .def_property(
+            "pixel_format",
+            &NES::Emulator::get_pixel_format,
+            &NES::Emulator::set_pixel_format,
+            "The format the PPU writes pixels in (RGB, or palette indexes converted on demand)"
+        )
+
+        .def_property(
+            "cpu_engine",
+            &NES::Emulator::get_cpu_engine,
+            &NES::Emulator::set_cpu_engine,
+            "The engine that executes the CPU (the interpreter, or decoded blocks of PRG ROM)"
+        )
+
+        .def("reset", &NES::Emulator::reset, py::call_guard<py::gil_scoped_release>(), "Reset the emulator")
+        .def(
+            "step",
+            static_cast<void (NES::Emulator::*)(bool)>(&NES::Emulator::step),
+            py::arg("render") = true,
+            py::call_guard<py::gil_scoped_release>(),
+            "Perform a step on the emulator, skipping the pixels of the frame if render is False"
+        )
+
+        .def(
+            "step_n",
+            [](NES::Emulator& emu, uint8_t action, int frames) {
+                if (frames < 1)
+                    throw py::value_error("frames must be at least 1");
+                py::gil_scoped_release release;
+                emu.step(action, *emu.get_controller(1), frames);
+            },
+            py::arg("action"),
+            py::arg("frames"),
+            "Perform a number of steps holding the action on the first controller, rendering only the last"
+        )
+
+        .def(
+            "step_n",
+            [](NES::Emulator& emu, std::tuple<uint8_t, uint8_t> action, int frames) {
+                if (frames < 1)
+                    throw py::value_error("frames must be at least 1");
+                py::gil_scoped_release release;
+                emu.step(std::get<0>(action), std::get<1>(action), frames);
+            },
+            py::arg("action"),
+            py::arg("frames"),
+            "Perform a number of steps holding the actions on both controllers, rendering only the last"
+        )
+
         .def(
             "screen_buffer", 
             [](NES::Emulator& emu) -> py::array_t<uint8_t> {
                 const int HEIGHT = NES::Emulator::HEIGHT;
                 const int WIDTH = NES::Emulator::WIDTH;
+                // convert the palette indexes of the last frame in the indexed format
+                emu.convert_screen();
                 
                 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
                     // On little-endian systems: BGRx -> RGB
@@ -53,6 +695,21 @@ PYBIND11_MODULE(emulator, m) {
             "Get the screen buffer as a HEIGHT x WIDTH x 3 numpy.ndarray in RGB format"
         )
 
+        .def(
+            "index_buffer",
+            [](NES::Emulator& emu) -> py::array_t<uint8_t> {
+                const int HEIGHT = NES::Emulator::HEIGHT;
+                const int WIDTH = NES::Emulator::WIDTH;
+                return py::array_t<uint8_t>(
+                    {HEIGHT, WIDTH},                          // shape
+                    {WIDTH, 1},                               // stride (1 byte)
+                    &(*emu.get_index_buffer())[0][0],         // pointer to data
+                    py::capsule(emu.get_index_buffer(), [](void*) {})  // capsule with data pointer
+                );
+            },
+            "Get the palette indexes of the last frame in the indexed pixel format as a HEIGHT x WIDTH numpy.ndarray"
+        )
+
         .def(
             "controller",
             [](NES::Emulator& emu, int port) -> py::array_t<uint8_t> {
@@ -86,15 +743,14 @@ PYBIND11_MODULE(emulator, m) {
             "dump_state",
             [](NES::Emulator& emu) -> py::array_t<uint8_t> {
                 // Create a copy of the state data
-                auto* core = new NES::Core;
-                memset(core, 0, sizeof(NES::Core));
-                emu.snapshot(core);
-                
+                auto* state = new NES::State;
+                emu.snapshot(state);
+
                 return py::array_t<uint8_t>(
-                    {sizeof(NES::Core)},
+                    {sizeof(NES::State)},
                     {1},
-                    reinterpret_cast<uint8_t*>(core),
-                    py::capsule(core, [](void* p) { delete static_cast<NES::Core*>(p); })
+                    reinterpret_cast<uint8_t*>(state),
+                    py::capsule(state, [](void* p) { delete static_cast<NES::State*>(p); })
                 );
             },
             "Dump the current state to bytes"
@@ -102,12 +758,619 @@ PYBIND11_MODULE(emulator, m) {
 
         .def(
             "load_state",
-            [](NES::Emulator& emu, const py::array_t<uint8_t>& state) {
-                emu.restore(reinterpret_cast<const NES::Core*>(state.request().ptr));
-                emu.ppu_step();
+            [](NES::Emulator& emu, const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& state, bool redraw) {
+                if (static_cast<std::size_t>(state.nbytes()) != sizeof(NES::State))
+                    throw py::value_error("state must be " + std::to_string(sizeof(NES::State)) + " bytes");
+                std::vector<NES::State> aligned;
+                auto* snapshot = as_states(state.data(), 1, aligned);
+                if (!emu.is_compatible(snapshot))
+                    throw py::value_error("state is from another version or ROM, or is corrupted");
+                py::gil_scoped_release release;
+                emu.restore(snapshot);
+                if (redraw) emu.ppu_step();
+            },
+            py::arg("state"),
+            py::arg("redraw") = false,
+            "Load state from bytes, and if redraw, render a frame over the restored state to refresh the screen"
+        )
+
+        .def(
+            "dump_state_into",
+            [](NES::Emulator& emu, const py::buffer& buffer) {
+                const py::buffer_info info = state_buffer(buffer, true);
+                const bool is_aligned = reinterpret_cast<std::uintptr_t>(info.ptr) % alignof(NES::State) == 0;
+                py::gil_scoped_release release;
+                if (is_aligned) {
+                    emu.snapshot(static_cast<NES::State*>(info.ptr));
+                } else {
+                    emu.snapshot(&scratch_state());
+                    std::memcpy(info.ptr, &scratch_state(), sizeof(NES::State));
+                }
+            },
+            py::arg("buffer"),
+            "Dump the current state into a writable buffer of STATE_SIZE bytes without allocating"
+        )
+
+        .def(
+            "load_state_from",
+            [](NES::Emulator& emu, const py::buffer& buffer, bool redraw) {
+                const py::buffer_info info = state_buffer(buffer, false);
+                const NES::State* snapshot = static_cast<const NES::State*>(info.ptr);
+                if (reinterpret_cast<std::uintptr_t>(info.ptr) % alignof(NES::State) != 0) {
+                    std::memcpy(&scratch_state(), info.ptr, sizeof(NES::State));
+                    snapshot = &scratch_state();
+                }
+                if (!emu.is_compatible(snapshot))
+                    throw py::value_error("state is from another version or ROM, or is corrupted");
+                py::gil_scoped_release release;
+                emu.restore(snapshot);
+                if (redraw) emu.ppu_step();
+            },
+            py::arg("buffer"),
+            py::arg("redraw") = false,
+            "Load state from a buffer of STATE_SIZE bytes without allocating, and if redraw, refresh the screen"
+        )
+
+        .def(
+            "clone",
+            &NES::Emulator::clone,
+            py::call_guard<py::gil_scoped_release>(),
+            "Return a new emulator in the same state that shares the ROM image"
+        )
+
+        .def(
+            "copy_from",
+            &NES::Emulator::copy_from,
+            py::arg("other"),
+            py::call_guard<py::gil_scoped_release>(),
+            "Put the emulator in the same state as another emulator of the same ROM"
+        )
+
+        .def(
+            "set_hash_ring",
+            [](NES::Emulator& emu, py::array_t<uint64_t> ring) {
+                if (ring.ndim() != 1 || ring.size() < 1 || ring.strides(0) != static_cast<py::ssize_t>(sizeof(uint64_t)) || !ring.writeable())
+                    throw py::value_error("hash ring must be a writable, contiguous, non-empty uint64 array");
+                emu.set_hash_ring(ring.mutable_data(), ring.size());
+            },
+            py::arg("ring").noconvert(),
+            // the emulator writes to the ring until it is replaced or cleared
+            py::keep_alive<1, 2>(),
+            "Write the hash of the state after every frame to ring[frame % len(ring)], counting from this call"
+        )
+        .def(
+            "clear_hash_ring",
+            [](NES::Emulator& emu) { emu.set_hash_ring(nullptr, 0); },
+            "Stop hashing the state after every frame"
+        )
+        .def_property_readonly("hash_count", &NES::Emulator::get_hash_count, "The number of hashes written to the hash ring since it was set")
+        .def("state_hash", &NES::Emulator::hash, "Return the 64-bit hash of the current state")
+
+        .def(
+            "counters",
+            [](NES::Emulator& emu) { return emu.get_counters(); },
+            "Return a snapshot of the counters of the hot paths (zero unless built with NES_PY_COUNTERS=1)"
+        )
+        .def("reset_counters", &NES::Emulator::reset_counters, "Reset the counters of the hot paths to zero")
+
+        .def(
+            "rollout",
+            [](
+                NES::Emulator& emu,
+                const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& state,
+                const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& actions,
+                const py::array_t<uint16_t, py::array::c_style | py::array::forcecast>& addresses
+            ) {
+                if (static_cast<std::size_t>(state.nbytes()) != sizeof(NES::State))
+                    throw py::value_error("state must be " + std::to_string(sizeof(NES::State)) + " bytes");
+                if (addresses.ndim() != 1)
+                    throw py::value_error("addresses must have shape (K,)");
+                const std::size_t players = action_players(actions, 1);
+                const py::ssize_t frames = actions.shape(0);
+                const py::ssize_t count = addresses.shape(0);
+                std::vector<NES::State> aligned;
+                auto* snapshot = as_states(state.data(), 1, aligned);
+                py::array_t<uint8_t> trace({frames, count});
+                uint8_t* output = trace.mutable_data();
+                {
+                    py::gil_scoped_release release;
+                    emu.rollout(snapshot, actions.data(), players, frames, addresses.data(), count, output);
+                }
+                return trace;
             },
             py::arg("state"),
-            "Load state from bytes"
+            py::arg("actions"),
+            py::arg("addresses"),
+            "Run (T,) or (T, 2) actions headless from a state and return the (T, K) RAM bytes at the addresses after each frame"
+        )
+    ;
+
+    py::class_<NES::VecEmulator>(m, "NESVecEmulator")
+        .def(
+            py::init([](const std::string& rom_path, std::size_t num_envs, std::size_t num_threads, bool pin_threads, const NES::ObservationConfig* observation) {
+                auto vec = new NES::VecEmulator(rom_path, num_envs, num_threads, pin_threads);
+                if (observation != nullptr)
+                    vec->set_observation_config(*observation);
+                return vec;
+            }),
+            py::arg("rom_path"),
+            py::arg("num_envs"),
+            py::arg("num_threads") = 0,
+            py::arg("pin_threads") = false,
+            py::arg("observation") = py::none()
+        )
+        .def(
+            py::init([](std::shared_ptr<NES::ROMImage> rom, std::size_t num_envs, std::size_t num_threads, bool pin_threads, const NES::ObservationConfig* observation) {
+                auto vec = new NES::VecEmulator(rom, num_envs, num_threads, pin_threads);
+                if (observation != nullptr)
+                    vec->set_observation_config(*observation);
+                return vec;
+            }),
+            py::arg("rom"),
+            py::arg("num_envs"),
+            py::arg("num_threads") = 0,
+            py::arg("pin_threads") = false,
+            py::arg("observation") = py::none()
+        )
+
+        .def_property_readonly_static("width", [](py::object) { return NES::Emulator::WIDTH; })
+        .def_property_readonly_static("height", [](py::object) { return NES::Emulator::HEIGHT; })
+        .def_property_readonly("num_envs", &NES::VecEmulator::size)
+        .def_property_readonly("num_threads", &NES::VecEmulator::num_threads)
+        .def("__len__", &NES::VecEmulator::size)
+
+        .def(
+            "reset",
+            [](NES::VecEmulator& vec) { vec.reset(); },
+            py::call_guard<py::gil_scoped_release>(),
+            "Reset every emulator in the batch"
+        )
+
+        .def(
+            "reset",
+            [](NES::VecEmulator& vec, std::size_t index) {
+                if (index >= vec.size())
+                    throw py::index_error("emulator index out of range");
+                vec.reset(index);
+            },
+            py::arg("index"),
+            py::call_guard<py::gil_scoped_release>(),
+            "Reset the emulator at the given index in the batch"
+        )
+
+        .def(
+            "step",
+            [](const py::object& self, const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& actions) {
+                NES::VecEmulator& vec = self.cast<NES::VecEmulator&>();
+                // accept (N,) for player 1 only or (N, 2) for both players
+                const bool is_one_player = actions.ndim() == 1;
+                const bool is_two_player = actions.ndim() == 2 && actions.shape(1) == 2;
+                if (!(is_one_player || is_two_player) || static_cast<std::size_t>(actions.shape(0)) != vec.size())
+                    throw py::value_error("actions must have shape (num_envs,) or (num_envs, 2)");
+                const std::size_t players = is_one_player ? 1 : 2;
+                {
+                    py::gil_scoped_release release;
+                    vec.step(actions.data(), players);
+                }
+                return py::make_tuple(vec_observations(self), vec_memory_buffer(self));
+            },
+            py::arg("actions"),
+            "Perform a step on every emulator in the batch and return the (observations, RAMs)"
+        )
+
+        .def(
+            "step_async",
+            [](NES::VecEmulator& vec, const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& actions) {
+                const bool is_one_player = actions.ndim() == 1;
+                const bool is_two_player = actions.ndim() == 2 && actions.shape(1) == 2;
+                if (!(is_one_player || is_two_player) || static_cast<std::size_t>(actions.shape(0)) != vec.size())
+                    throw py::value_error("actions must have shape (num_envs,) or (num_envs, 2)");
+                const std::size_t players = is_one_player ? 1 : 2;
+                py::gil_scoped_release release;
+                vec.step_async(actions.data(), players);
+            },
+            py::arg("actions"),
+            "Start a step on every emulator in the batch on a background thread and return immediately, the outputs of the last step stay intact until the step after it"
+        )
+
+        .def(
+            "wait",
+            [](const py::object& self) {
+                NES::VecEmulator& vec = self.cast<NES::VecEmulator&>();
+                {
+                    py::gil_scoped_release release;
+                    vec.wait();
+                }
+                return py::make_tuple(vec_observations(self), vec_memory_buffer(self));
+            },
+            "Wait for the step started by step_async and return the (observations, RAMs)"
+        )
+
+        .def_property_readonly("is_stepping", &NES::VecEmulator::is_stepping, "Whether a step started by step_async hasn't been waited for")
+
+        .def(
+            "rollout",
+            [](
+                NES::VecEmulator& vec,
+                const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& states,
+                const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& actions,
+                const py::array_t<uint16_t, py::array::c_style | py::array::forcecast>& addresses
+            ) {
+                if (states.ndim() != 2 || static_cast<std::size_t>(states.shape(1)) != sizeof(NES::State))
+                    throw py::value_error("states must have shape (R, " + std::to_string(sizeof(NES::State)) + ")");
+                if (addresses.ndim() != 1)
+                    throw py::value_error("addresses must have shape (K,)");
+                const std::size_t players = action_players(actions, 2);
+                const py::ssize_t rollouts = states.shape(0);
+                if (actions.shape(0) != rollouts)
+                    throw py::value_error("actions must have one sequence per state");
+                const py::ssize_t frames = actions.shape(1);
+                const py::ssize_t count = addresses.shape(0);
+                std::vector<NES::State> aligned;
+                auto* snapshots = as_states(states.data(), rollouts, aligned);
+                py::array_t<uint8_t> traces({rollouts, frames, count});
+                uint8_t* output = traces.mutable_data();
+                {
+                    py::gil_scoped_release release;
+                    vec.rollout(snapshots, rollouts, actions.data(), players, frames, addresses.data(), count, output);
+                }
+                return traces;
+            },
+            py::arg("states"),
+            py::arg("actions"),
+            py::arg("addresses"),
+            "Run (R, T) or (R, T, 2) actions headless from (R, S) states in parallel and return the (R, T, K) RAM bytes at the addresses after each frame"
+        )
+
+        .def(
+            "counters",
+            [](NES::VecEmulator& vec, std::size_t index) {
+                if (index >= vec.size())
+                    throw py::index_error("emulator index out of range");
+                return vec[index].get_counters();
+            },
+            py::arg("index"),
+            "Return a snapshot of the counters of the emulator at the given index in the batch"
+        )
+
+        .def(
+            "set_reward_spec",
+            &NES::VecEmulator::set_reward_spec,
+            py::arg("spec"),
+            "Evaluate a reward spec over the RAM of every emulator after each reset and step"
+        )
+
+        .def(
+            "rewards",
+            [](const py::object& self) -> py::array_t<float> {
+                NES::VecEmulator& vec = self.cast<NES::VecEmulator&>();
+                float* rewards = with_rewards(vec).get_rewards();
+                return py::array_t<float>({py::ssize_t(vec.size())}, rewards, self);
+            },
+            "Get the rewards of the last step as an N numpy.ndarray"
+        )
+
+        .def(
+            "dones",
+            [](const py::object& self) -> py::array_t<bool> {
+                NES::VecEmulator& vec = self.cast<NES::VecEmulator&>();
+                bool* dones = reinterpret_cast<bool*>(with_rewards(vec).get_dones());
+                return py::array_t<bool>({py::ssize_t(vec.size())}, dones, self);
+            },
+            "Get the terminations of the last step as an N numpy.ndarray"
+        )
+
+        .def(
+            "infos",
+            [](const py::object& self) -> py::array_t<int64_t> {
+                NES::VecEmulator& vec = self.cast<NES::VecEmulator&>();
+                int64_t* infos = with_rewards(vec).get_infos();
+                const py::ssize_t count = vec.num_info_values();
+                return py::array_t<int64_t>({py::ssize_t(vec.size()), count}, infos, self);
+            },
+            "Get the values of the reward spec after the last reset or step as an N x values numpy.ndarray"
+        )
+
+        .def(
+            "set_observation_buffer",
+            [](NES::VecEmulator& vec, const py::object& buffer, NES::ObservationLayout layout, const py::object& back_buffer) {
+                if (buffer.is_none()) {
+                    if (!back_buffer.is_none())
+                        throw py::value_error("the back observation buffer needs an observation buffer");
+                    py::gil_scoped_release release;
+                    vec.set_observation_buffer(nullptr, layout);
+                    return;
+                }
+                const std::size_t size = vec.size() * vec.observation_size();
+                const py::buffer_info info = observation_buffer(buffer.cast<py::buffer>(), size);
+                NES::NES_Byte* back = nullptr;
+                if (!back_buffer.is_none())
+                    back = static_cast<NES::NES_Byte*>(observation_buffer(back_buffer.cast<py::buffer>(), size).ptr);
+                py::gil_scoped_release release;
+                vec.set_observation_buffer(static_cast<NES::NES_Byte*>(info.ptr), layout, back);
+            },
+            py::arg("buffer"),
+            py::arg("layout") = NES::ObservationLayout::NHWC,
+            py::arg("back_buffer") = py::none(),
+            // the batch writes to the buffers until they're replaced
+            py::keep_alive<1, 2>(),
+            py::keep_alive<1, 4>(),
+            "Write the observations of every reset and step to a C-contiguous buffer (e.g., pinned memory) in a layout, None to clear it, alternating with a back buffer on every step_async if one is given"
+        )
+
+        .def("observations", &vec_observations, "Get the observations as the observation buffer in its layout, or the stacks of frames or screens")
+        .def("frame_stacks", &vec_frame_stacks, "Get the stacks of frames as an N x frames x height x width numpy.ndarray")
+
+        .def("screen_buffer", &vec_screen_buffer, "Get the screen buffers as an N x HEIGHT x WIDTH x 3 numpy.ndarray in RGB format")
+        .def("memory_buffer", &vec_memory_buffer, "Get the RAM of each emulator after the last step as an N x 0x800 numpy.ndarray")
+    ;
+
+    py::class_<NES::SharedBatch> shared_batch(m, "NESSharedBatch");
+
+    py::enum_<NES::SharedBatch::Command>(shared_batch, "Command")
+        .value("RESET", NES::SharedBatch::RESET)
+        .value("RESET_ONE", NES::SharedBatch::RESET_ONE)
+        .value("STEP", NES::SharedBatch::STEP)
+        .value("STOP", NES::SharedBatch::STOP)
+    ;
+
+    py::enum_<NES::SharedBatch::Status>(shared_batch, "Status")
+        .value("STARTING", NES::SharedBatch::STARTING)
+        .value("READY", NES::SharedBatch::READY)
+        .value("FAILED", NES::SharedBatch::FAILED)
+        .value("STOPPED", NES::SharedBatch::STOPPED)
+    ;
+
+    shared_batch
+        .def(
+            py::init(&NES::SharedBatch::create),
+            py::arg("name"),
+            py::arg("num_envs"),
+            py::arg("observation_size"),
+            py::arg("num_info_values"),
+            py::arg("num_workers"),
+            py::arg("slots") = 2,
+            "Create a shared memory segment for the outputs of a batch stepped by worker processes"
+        )
+
+        .def_property_readonly("name", &NES::SharedBatch::get_name)
+        .def_property_readonly("num_envs", &NES::SharedBatch::size)
+        .def_property_readonly("observation_size", &NES::SharedBatch::observation_size)
+        .def_property_readonly("num_info_values", &NES::SharedBatch::num_info_values)
+        .def_property_readonly("num_workers", &NES::SharedBatch::num_workers)
+        .def_property_readonly("num_slots", &NES::SharedBatch::num_slots)
+        .def("__len__", &NES::SharedBatch::size)
+
+        .def("unlink", &NES::SharedBatch::unlink, "Remove the name of the segment once every worker attached")
+
+        .def(
+            "worker_range",
+            [](const NES::SharedBatch& batch, std::size_t worker) {
+                shared_worker(batch, worker);
+                return std::make_tuple(batch.worker_begin(worker), batch.worker_end(worker));
+            },
+            py::arg("worker"),
+            "Return the (begin, end) indexes of the emulators of a worker"
+        )
+
+        .def(
+            "status",
+            [](const NES::SharedBatch& batch, std::size_t worker) {
+                return batch.get_status(shared_worker(batch, worker));
+            },
+            py::arg("worker"),
+            "Return the status of a worker"
+        )
+
+        .def(
+            "error",
+            [](const NES::SharedBatch& batch, std::size_t worker) {
+                return batch.get_error(shared_worker(batch, worker));
+            },
+            py::arg("worker"),
+            "Return the error message of the last failed request of a worker"
+        )
+
+        .def(
+            "request",
+            [](NES::SharedBatch& batch, std::size_t worker, NES::SharedBatch::Command command, std::size_t slot, std::size_t index) {
+                shared_worker(batch, worker);
+                shared_slot(batch, slot);
+                py::gil_scoped_release release;
+                batch.request(worker, command, slot, index);
+            },
+            py::arg("worker"),
+            py::arg("command"),
+            py::arg("slot"),
+            py::arg("index") = 0,
+            "Push a request to a worker to run a command on a slot (index is the emulator of RESET_ONE)"
+        )
+
+        .def(
+            "wait",
+            [](NES::SharedBatch& batch, std::size_t worker, int64_t timeout) {
+                shared_worker(batch, worker);
+                py::gil_scoped_release release;
+                return batch.wait(worker, timeout);
+            },
+            py::arg("worker"),
+            py::arg("timeout") = -1,
+            "Wait up to timeout milliseconds (forever if negative) for the oldest request to a worker and return its slot, or -1 on timeout"
+        )
+
+        .def(
+            "actions",
+            [](const py::object& self, std::size_t slot) {
+                NES::SharedBatch& batch = self.cast<NES::SharedBatch&>();
+                return shared_view(self, batch.get_actions(shared_slot(batch, slot)), {py::ssize_t(batch.size()), py::ssize_t(2)});
+            },
+            py::arg("slot"),
+            "Get the controller bytes of a slot as an N x 2 numpy.ndarray"
+        )
+
+        .def(
+            "observations",
+            [](const py::object& self, std::size_t slot) {
+                NES::SharedBatch& batch = self.cast<NES::SharedBatch&>();
+                return shared_view(self, batch.get_observations(shared_slot(batch, slot)), {py::ssize_t(batch.size()), py::ssize_t(batch.observation_size())});
+            },
+            py::arg("slot"),
+            "Get the observations of a slot as an N x observation_size numpy.ndarray"
+        )
+
+        .def(
+            "memory",
+            [](const py::object& self, std::size_t slot) {
+                NES::SharedBatch& batch = self.cast<NES::SharedBatch&>();
+                return shared_view(self, batch.get_memory(shared_slot(batch, slot)), {py::ssize_t(batch.size()), py::ssize_t(NES::VecEmulator::MEMORY_SIZE)});
+            },
+            py::arg("slot"),
+            "Get the RAM of a slot as an N x 0x800 numpy.ndarray"
+        )
+
+        .def(
+            "rewards",
+            [](const py::object& self, std::size_t slot) {
+                NES::SharedBatch& batch = self.cast<NES::SharedBatch&>();
+                return shared_view(self, batch.get_rewards(shared_slot(batch, slot)), {py::ssize_t(batch.size())});
+            },
+            py::arg("slot"),
+            "Get the rewards of a slot as an N numpy.ndarray"
+        )
+
+        .def(
+            "dones",
+            [](const py::object& self, std::size_t slot) {
+                NES::SharedBatch& batch = self.cast<NES::SharedBatch&>();
+                bool* dones = reinterpret_cast<bool*>(batch.get_dones(shared_slot(batch, slot)));
+                return shared_view(self, dones, {py::ssize_t(batch.size())});
+            },
+            py::arg("slot"),
+            "Get the terminations of a slot as an N numpy.ndarray"
+        )
+
+        .def(
+            "infos",
+            [](const py::object& self, std::size_t slot) {
+                NES::SharedBatch& batch = self.cast<NES::SharedBatch&>();
+                return shared_view(self, batch.get_infos(shared_slot(batch, slot)), {py::ssize_t(batch.size()), py::ssize_t(batch.num_info_values())});
+            },
+            py::arg("slot"),
+            "Get the info values of a slot as an N x values numpy.ndarray"
+        )
+    ;
+
+    m.def(
+        "serve_shared",
+        [](NES::VecEmulator& vec, const std::string& name, std::size_t worker) {
+            py::gil_scoped_release release;
+            NES::SharedBatch::attach(name)->serve(vec, worker);
+        },
+        py::arg("vec"),
+        py::arg("name"),
+        py::arg("worker"),
+        "Attach to a shared batch and serve the requests of a worker with a batch of emulators until it stops"
+    );
+
+    py::class_<NES::SnapshotPool>(m, "NESSnapshotPool")
+        .def(py::init<int>(), py::arg("keyframe_interval") = 32)
+
+        .def_property_readonly("keyframe_interval", &NES::SnapshotPool::get_keyframe_interval)
+        .def_property_readonly("nbytes", &NES::SnapshotPool::nbytes)
+        .def("__len__", &NES::SnapshotPool::size)
+
+        .def(
+            "save",
+            &NES::SnapshotPool::save,
+            py::arg("emulator"),
+            py::arg("parent") = NES::SnapshotPool::NONE,
+            py::call_guard<py::gil_scoped_release>(),
+            "Save the state of an emulator as a delta to a parent snapshot and return its handle"
+        )
+
+        .def(
+            "restore",
+            &NES::SnapshotPool::restore,
+            py::arg("handle"),
+            py::arg("emulator"),
+            py::call_guard<py::gil_scoped_release>(),
+            "Restore the snapshot with the given handle on an emulator"
+        )
+
+        .def(
+            "release",
+            &NES::SnapshotPool::release,
+            py::arg("handle"),
+            "Release the snapshot with the given handle"
+        )
+    ;
+
+    py::class_<NES::Movie>(m, "NESMovie")
+        .def(py::init<int>(), py::arg("keyframe_interval") = 120)
+
+        .def_property_readonly("keyframe_interval", &NES::Movie::get_keyframe_interval)
+        .def_property_readonly("is_recording", &NES::Movie::is_recording)
+        .def_property_readonly("num_runs", &NES::Movie::num_runs, "The number of runs of frames that hold the same buttons")
+        .def_property_readonly("num_keyframes", &NES::Movie::num_keyframes)
+        .def_property_readonly("nbytes", &NES::Movie::nbytes)
+        .def("__len__", &NES::Movie::size)
+
+        .def(
+            "record",
+            &NES::Movie::record,
+            py::arg("emulator"),
+            // the emulator appends to the movie until it stops recording
+            py::keep_alive<1, 2>(),
+            "Clear the movie and record the frames the emulator steps from its current state"
+        )
+        .def("stop", &NES::Movie::stop, "Stop recording the movie")
+
+        .def(
+            "load",
+            [](NES::Movie& movie, NES::Emulator& emu, const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& state, const py::array_t<uint8_t, py::array::c_style | py::array::forcecast>& inputs) {
+                if (static_cast<std::size_t>(state.nbytes()) != sizeof(NES::State))
+                    throw py::value_error("state must be " + std::to_string(sizeof(NES::State)) + " bytes");
+                if (inputs.ndim() != 2 || inputs.shape(1) != 2)
+                    throw py::value_error("inputs must have shape (T, 2)");
+                std::vector<NES::State> aligned;
+                auto* snapshot = as_states(state.data(), 1, aligned);
+                py::gil_scoped_release release;
+                movie.load(emu, snapshot, inputs.data(), inputs.shape(0));
+            },
+            py::arg("emulator"),
+            py::arg("state"),
+            py::arg("inputs"),
+            "Rebuild the movie by replaying (T, 2) inputs headless from a state on an emulator"
+        )
+
+        .def(
+            "seek",
+            &NES::Movie::seek,
+            py::arg("emulator"),
+            py::arg("frame"),
+            py::call_guard<py::gil_scoped_release>(),
+            "Put an emulator in the state after a number of frames of the movie, rewinds the recording if it records"
+        )
+
+        .def(
+            "input",
+            [](const NES::Movie& movie, std::size_t frame) {
+                NES::NES_Byte buttons[2];
+                movie.get_input(frame, buttons);
+                return std::make_tuple(buttons[0], buttons[1]);
+            },
+            py::arg("frame"),
+            "Return the controller bytes of player 1 and 2 on a frame"
+        )
+
+        .def(
+            "inputs",
+            [](const NES::Movie& movie) {
+                py::array_t<uint8_t> inputs({static_cast<py::ssize_t>(movie.size()), static_cast<py::ssize_t>(2)});
+                movie.get_inputs(inputs.mutable_data());
+                return inputs;
+            },
+            "Return the (T, 2) controller bytes of every frame"
         )
     ;
 };
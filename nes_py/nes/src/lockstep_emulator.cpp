@@ -0,0 +1,66 @@
+//  Program:      nes-py
+//  File:         lockstep_emulator.cpp
+//  Description:  An experimental engine that steps lanes of a ROM in lockstep
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "lockstep_emulator.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include "state_hash.hpp"
+
+namespace NES {
+
+LockstepEmulator::LockstepEmulator(std::shared_ptr<const ROMImage> rom, std::size_t lanes) :
+    states(lanes),
+    hashes(lanes),
+    leaders(lanes) {
+    if (lanes == 0)
+        throw std::invalid_argument("a lockstep group needs at least 1 lane");
+    emulators.reserve(lanes);
+    for (std::size_t lane = 0; lane < lanes; lane++)
+        emulators.emplace_back(new Emulator(rom));
+}
+
+void LockstepEmulator::reset() {
+    for (auto& emulator : emulators)
+        emulator->reset();
+    frames = 0;
+    shared_frames = 0;
+}
+
+void LockstepEmulator::step(const NES_Byte* actions, std::size_t players) {
+    if (players != 1 && players != 2)
+        throw std::invalid_argument("players must be 1 or 2");
+    // group the lanes by their states with the new buttons, the hashes find
+    // the candidate group and the bytes confirm it
+    std::unordered_map<uint64_t, std::size_t> groups;
+    for (std::size_t lane = 0; lane < size(); lane++) {
+        Emulator& emulator = *emulators[lane];
+        const NES_Byte* action = actions + lane * players;
+        *emulator.get_controller(0) = action[0];
+        *emulator.get_controller(1) = players == 2 ? action[1] : 0;
+        emulator.snapshot(&states[lane]);
+        hashes[lane] = hash_state(states[lane]);
+        leaders[lane] = lane;
+        auto group = groups.find(hashes[lane]);
+        if (group == groups.end())
+            groups.emplace(hashes[lane], lane);
+        else if (std::memcmp(&states[group->second], &states[lane], sizeof(State)) == 0)
+            leaders[lane] = group->second;
+    }
+    // run the frame once per group, then copy it to the rest of the group
+    for (std::size_t lane = 0; lane < size(); lane++)
+        if (leaders[lane] == lane)
+            emulators[lane]->step();
+    for (std::size_t lane = 0; lane < size(); lane++) {
+        if (leaders[lane] == lane) continue;
+        emulators[lane]->copy_from(*emulators[leaders[lane]]);
+        shared_frames++;
+    }
+    frames += size();
+}
+
+}  // namespace NES
@@ -7,23 +7,56 @@
 
 #include "main_bus.hpp"
 #include "log.hpp"
+#include <cstring>
 
 namespace NES {
 
-NES_Byte MainBus::read(NES_Address address) {
+MainBus::MainBus() : mapper(nullptr) {
+    read_pages.fill(nullptr);
+    write_pages.fill(nullptr);
+    map_pages();
+}
+
+MainBus::MainBus(const MainBus& other) : MainBus() {
+    ram = other.ram;
+    extended_ram = other.extended_ram;
+}
+
+MainBus& MainBus::operator=(const MainBus& other) {
+    // the page tables point into the memory of this bus, so only copy the
+    // memory and leave the wiring of the bus in place
+    ram = other.ram;
+    extended_ram = other.extended_ram;
+    return *this;
+}
+
+void MainBus::map_pages() {
+    // RAM, mirrored every 0x800 bytes up to $2000
+    for (int page = 0; page < 0x20; page++) {
+        read_pages[page] = write_pages[page] = &ram[(page << 8) & 0x7ff];
+    }
+    // extended RAM, if the mapper has extended RAM
+    bool has_extended_ram = mapper != nullptr && mapper->hasExtendedRAM();
+    for (int page = 0x60; page < 0x80; page++) {
+        NES_Byte* pointer = has_extended_ram ? &extended_ram[(page - 0x60) << 8] : nullptr;
+        read_pages[page] = write_pages[page] = pointer;
+    }
+}
+
+NES_Byte MainBus::read_unmapped(NES_Address address) {
     if (address < 0x2000) {
         return ram[address & 0x7ff];
     } else if (address < 0x4020) {
         if (address < 0x4000) {  // PPU registers, mirrored
-            auto reg = static_cast<IORegisters>(address & 0x2007);
-            if (read_callbacks.count(reg))
-                return read_callbacks.at(reg)();
+            auto& callback = read_callbacks[io_index(static_cast<IORegisters>(address & 0x2007))];
+            if (callback)
+                return callback();
             else
                 LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +address << std::endl;
         } else if (address < 0x4018 && address >= 0x4014) {  // only *some* IO registers
-            auto reg = static_cast<IORegisters>(address);
-            if (read_callbacks.count(reg))
-                return read_callbacks.at(reg)();
+            auto& callback = read_callbacks[io_index(static_cast<IORegisters>(address))];
+            if (callback)
+                return callback();
             else
                 LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +address << std::endl;
         }
@@ -41,20 +74,20 @@ NES_Byte MainBus::read(NES_Address address) {
     return 0;
 }
 
-void MainBus::write(NES_Address address, NES_Byte value) {
+void MainBus::write_unmapped(NES_Address address, NES_Byte value) {
     if (address < 0x2000) {
         ram[address & 0x7ff] = value;
     } else if (address < 0x4020) {
         if (address < 0x4000) {  // PPU registers, mirrored
-            auto reg = static_cast<IORegisters>(address & 0x2007);
-            if (write_callbacks.count(reg))
-                return write_callbacks.at(reg)(value);
+            auto& callback = write_callbacks[io_index(static_cast<IORegisters>(address & 0x2007))];
+            if (callback)
+                return callback(value);
             else
                 LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +address << std::endl;
         } else if (address < 0x4017 && address >= 0x4014) {  // only some registers
-            auto reg = static_cast<IORegisters>(address);
-            if (write_callbacks.count(reg))
-                return write_callbacks.at(reg)(value);
+            auto& callback = write_callbacks[io_index(static_cast<IORegisters>(address))];
+            if (callback)
+                return callback(value);
             else
                 LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +address << std::endl;
         } else {
@@ -66,6 +99,9 @@ void MainBus::write(NES_Address address, NES_Byte value) {
         if (mapper->hasExtendedRAM())
             extended_ram[address - 0x6000] = value;
     } else {
+        if (mapper_write_callback)
+            mapper_write_callback();
+        // the mapper patches the read page table on bank switches
         mapper->writePRG(address, value);
     }
 }
@@ -85,10 +121,22 @@ const NES_Byte* MainBus::get_page_pointer(NES_Byte page) {
     return nullptr;
 }
 
+void MainBus::save(MainBusState& state) const {
+    std::memcpy(state.ram, ram.data(), sizeof(state.ram));
+    std::memcpy(state.extended_ram, extended_ram.data(), sizeof(state.extended_ram));
+}
+
+void MainBus::load(const MainBusState& state) {
+    std::memcpy(ram.data(), state.ram, sizeof(state.ram));
+    std::memcpy(extended_ram.data(), state.extended_ram, sizeof(state.extended_ram));
+}
+
 void MainBus::set_mapper(Mapper* mapper) {
     this->mapper = mapper;
     if (mapper->hasExtendedRAM())
         extended_ram.resize(0x2000);
+    map_pages();
+    mapper->set_prg_pages(read_pages.data());
 }
 
 }  // namespace NES
@@ -7,6 +7,7 @@
 
 #include "mappers/mapper_CNROM.hpp"
 #include "log.hpp"
+#include <cstring>
 
 namespace NES {
 
@@ -18,4 +19,19 @@ void MapperCNROM::writeCHR(NES_Address address, NES_Byte value) {
         std::endl;
 }
 
+void MapperCNROM::save(MapperState& state) const {
+    std::memset(state.registers, 0, sizeof(state.registers));
+    state.registers[0] = select_chr;
+    std::memset(state.character_ram, 0, sizeof(state.character_ram));
+}
+
+void MapperCNROM::load(const MapperState& state) {
+    select_chr = state.registers[0];
+    map_chr_pages();
+}
+
+bool MapperCNROM::is_valid(const MapperState& state) const {
+    return state.registers[0] <= 0x3 && state.registers[0] < cartridge->getVROM().size() / 0x2000;
+}
+
 }  // namespace NES
@@ -7,6 +7,7 @@
 
 #include "mappers/mapper_NROM.hpp"
 #include "log.hpp"
+#include <cstring>
 
 namespace NES {
 
@@ -40,4 +41,19 @@ void MapperNROM::writeCHR(NES_Address address, NES_Byte value) {
             std::endl;
 }
 
+void MapperNROM::save(MapperState& state) const {
+    std::memset(state.registers, 0, sizeof(state.registers));
+    if (has_character_ram)
+        std::memcpy(state.character_ram, character_ram.data(), sizeof(state.character_ram));
+    else
+        std::memset(state.character_ram, 0, sizeof(state.character_ram));
+}
+
+void MapperNROM::load(const MapperState& state) {
+    if (has_character_ram)
+        std::memcpy(character_ram.data(), state.character_ram, sizeof(state.character_ram));
+}
+
+bool MapperNROM::is_valid(const MapperState&) const { return true; }
+
 }  // namespace NES
@@ -7,6 +7,7 @@
 
 #include "mappers/mapper_SxROM.hpp"
 #include "log.hpp"
+#include <cstring>
 
 namespace NES {
 
@@ -43,6 +44,7 @@ void MapperSxROM::writePRG(NES_Address address, NES_Byte value) {
         ++write_counter;
 
         if (write_counter == 5) {
+            NES_COUNT(counters, bank_switches++);
             if (address <= 0x9fff) {
                 switch (temp_register & 0x3) {
                     case 0: { mirroring = ONE_SCREEN_LOWER;   break; }
@@ -84,6 +86,7 @@ void MapperSxROM::writePRG(NES_Address address, NES_Byte value) {
                 register_prg = temp_register;
                 calculatePRGPointers();
             }
+            map_chr_pages();
 
             temp_register = 0;
             write_counter = 0;
@@ -109,6 +112,7 @@ void MapperSxROM::calculatePRGPointers() {
         first_bank_prg = 0x4000 * register_prg;
         second_bank_prg = cartridge->getROM().size() - 0x4000;
     }
+    map_prg_pages();
 }
 
 void MapperSxROM::writeCHR(NES_Address address, NES_Byte value) {
@@ -118,4 +122,64 @@ void MapperSxROM::writeCHR(NES_Address address, NES_Byte value) {
         LOG(Info) << "Read-only CHR memory write attempt at " << std::hex << address << std::endl;
 }
 
+void MapperSxROM::save(MapperState& state) const {
+    std::memset(state.registers, 0, sizeof(state.registers));
+    state.registers[0] = mirroring;
+    state.registers[1] = mode_chr;
+    state.registers[2] = mode_prg;
+    state.registers[3] = temp_register;
+    state.registers[4] = write_counter;
+    state.registers[5] = register_prg;
+    state.registers[6] = register_chr0;
+    state.registers[7] = register_chr1;
+    state.registers[8] = first_bank_prg;
+    state.registers[9] = second_bank_prg;
+    state.registers[10] = first_bank_chr;
+    state.registers[11] = second_bank_chr;
+    if (has_character_ram)
+        std::memcpy(state.character_ram, character_ram.data(), sizeof(state.character_ram));
+    else
+        std::memset(state.character_ram, 0, sizeof(state.character_ram));
+}
+
+void MapperSxROM::load(const MapperState& state) {
+    mirroring = static_cast<NameTableMirroring>(state.registers[0]);
+    mode_chr = state.registers[1];
+    mode_prg = state.registers[2];
+    temp_register = state.registers[3];
+    write_counter = state.registers[4];
+    register_prg = state.registers[5];
+    register_chr0 = state.registers[6];
+    register_chr1 = state.registers[7];
+    first_bank_prg = state.registers[8];
+    second_bank_prg = state.registers[9];
+    first_bank_chr = state.registers[10];
+    second_bank_chr = state.registers[11];
+    if (has_character_ram)
+        std::memcpy(character_ram.data(), state.character_ram, sizeof(state.character_ram));
+    map_prg_pages();
+    map_chr_pages();
+    mirroring_callback();
+}
+
+bool MapperSxROM::is_valid(const MapperState& state) const {
+    switch (state.registers[0]) {
+        case HORIZONTAL:
+        case VERTICAL:
+        case ONE_SCREEN_LOWER:
+        case ONE_SCREEN_HIGHER:
+            break;
+        default:
+            return false;
+    }
+    const std::size_t prg_size = cartridge->getROM().size();
+    const std::size_t chr_size = cartridge->getVROM().size();
+    return state.registers[1] <= 1 && state.registers[2] <= 3 &&
+        state.registers[3] < 0x20 && state.registers[4] < 5 &&
+        state.registers[5] < 0x10 && state.registers[6] < 0x20 && state.registers[7] < 0x20 &&
+        state.registers[8] <= prg_size - 0x4000 && state.registers[9] <= prg_size - 0x4000 &&
+        // the CHR banks only index CHR ROM
+        (has_character_ram || (state.registers[10] <= chr_size - 0x1000 && state.registers[11] <= chr_size - 0x1000));
+}
+
 }  // namespace NES
@@ -7,6 +7,7 @@
 
 #include "mappers/mapper_UxROM.hpp"
 #include "log.hpp"
+#include <cstring>
 
 namespace NES {
 
@@ -46,4 +47,24 @@ void MapperUxROM::writeCHR(NES_Address address, NES_Byte value) {
             std::endl;
 }
 
+void MapperUxROM::save(MapperState& state) const {
+    std::memset(state.registers, 0, sizeof(state.registers));
+    state.registers[0] = select_prg;
+    if (has_character_ram)
+        std::memcpy(state.character_ram, character_ram.data(), sizeof(state.character_ram));
+    else
+        std::memset(state.character_ram, 0, sizeof(state.character_ram));
+}
+
+void MapperUxROM::load(const MapperState& state) {
+    select_prg = state.registers[0];
+    if (has_character_ram)
+        std::memcpy(character_ram.data(), state.character_ram, sizeof(state.character_ram));
+    map_prg_pages();
+}
+
+bool MapperUxROM::is_valid(const MapperState& state) const {
+    return state.registers[0] < cartridge->getROM().size() / 0x4000;
+}
+
 }  // namespace NES
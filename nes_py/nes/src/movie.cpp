@@ -0,0 +1,169 @@
+//  Program:      nes-py
+//  File:         movie.cpp
+//  Description:  A movie of controller inputs with keyframes for fast seeking
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "movie.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace NES {
+
+Movie::Movie(int keyframe_interval_) :
+    keyframe_interval(keyframe_interval_),
+    frames(0),
+    rom_hash(0),
+    recorder(nullptr),
+    is_cut(false) {
+    if (keyframe_interval < 1)
+        throw std::invalid_argument("keyframe_interval must be positive");
+}
+
+Movie::~Movie() { stop(); }
+
+void Movie::record(Emulator& emulator) {
+    stop();
+    // an emulator records to one movie at a time
+    if (emulator.get_movie() != nullptr)
+        emulator.get_movie()->stop();
+    clear();
+    rom_hash = emulator.get_rom()->get_hash();
+    keyframes.push_back({0, pool.save(emulator)});
+    recorder = &emulator;
+    emulator.set_movie(this);
+}
+
+void Movie::stop() {
+    if (recorder == nullptr) return;
+    recorder->set_movie(nullptr);
+    recorder = nullptr;
+}
+
+void Movie::append(Emulator& emulator) {
+    const NES_Byte player_1 = *emulator.get_controller(0);
+    const NES_Byte player_2 = *emulator.get_controller(1);
+    if (!is_cut && !runs.empty() && runs.back().buttons[0] == player_1 && runs.back().buttons[1] == player_2)
+        runs.back().length++;
+    else
+        runs.push_back({frames, 1, {player_1, player_2}});
+    is_cut = false;
+    frames++;
+    // each keyframe only stores the pages that changed since the last
+    if (frames - keyframes.back().frame == static_cast<uint64_t>(keyframe_interval))
+        keyframes.push_back({frames, pool.save(emulator, keyframes.back().handle)});
+}
+
+void Movie::cut(Emulator& emulator) {
+    // the state the frames so far led to is gone, so is its keyframe
+    if (keyframes.back().frame == frames) {
+        pool.release(keyframes.back().handle);
+        keyframes.pop_back();
+    }
+    const SnapshotPool::Handle parent = keyframes.empty() ? SnapshotPool::NONE : keyframes.back().handle;
+    keyframes.push_back({frames, pool.save(emulator, parent)});
+    is_cut = true;
+}
+
+void Movie::load(Emulator& emulator, const State* const state, const NES_Byte* inputs, std::size_t count) {
+    if (!emulator.is_compatible(state))
+        throw std::invalid_argument("state is from another version or ROM, or is corrupted");
+    emulator.restore(state);
+    record(emulator);
+    for (std::size_t frame = 0; frame < count; frame++) {
+        *emulator.get_controller(0) = inputs[2 * frame];
+        *emulator.get_controller(1) = inputs[2 * frame + 1];
+        emulator.step(false);
+    }
+    stop();
+}
+
+void Movie::seek(Emulator& emulator, std::size_t frame) {
+    if (keyframes.empty())
+        throw std::invalid_argument("the movie has no frames to seek to");
+    if (frame > frames)
+        throw std::invalid_argument("frame " + std::to_string(frame) + " is past the end of the movie");
+    if (emulator.get_rom()->get_hash() != rom_hash)
+        throw std::invalid_argument("the movie was recorded on another ROM");
+    // seeking the recording rewinds it, the recording goes on from the frame
+    if (recorder == &emulator)
+        truncate(frame);
+    // the frames replayed to the target aren't new frames of any movie
+    Movie* const attached = emulator.get_movie();
+    emulator.set_movie(nullptr);
+    const Keyframe& keyframe = keyframes[find_keyframe(frame)];
+    pool.restore(keyframe.handle, emulator);
+    std::size_t current = keyframe.frame;
+    if (current < frame) {
+        std::size_t run = find_run(current);
+        for (; current < frame; current++) {
+            if (current >= runs[run].first + runs[run].length)
+                run++;
+            *emulator.get_controller(0) = runs[run].buttons[0];
+            *emulator.get_controller(1) = runs[run].buttons[1];
+            // only the last frame is observed, skip the pixels of the rest
+            emulator.step(current + 1 == frame);
+        }
+    }
+    emulator.set_movie(attached);
+    // the state of another recording jumped to the frame of this movie
+    if (attached != nullptr && attached != this)
+        attached->cut(emulator);
+}
+
+void Movie::get_input(std::size_t frame, NES_Byte* buttons) const {
+    if (frame >= frames)
+        throw std::invalid_argument("frame " + std::to_string(frame) + " is past the end of the movie");
+    const Run& run = runs[find_run(frame)];
+    buttons[0] = run.buttons[0];
+    buttons[1] = run.buttons[1];
+}
+
+void Movie::get_inputs(NES_Byte* inputs) const {
+    for (const Run& run : runs) {
+        for (uint64_t frame = 0; frame < run.length; frame++) {
+            *inputs++ = run.buttons[0];
+            *inputs++ = run.buttons[1];
+        }
+    }
+}
+
+void Movie::clear() {
+    for (const Keyframe& keyframe : keyframes)
+        pool.release(keyframe.handle);
+    keyframes.clear();
+    runs.clear();
+    frames = 0;
+    is_cut = false;
+}
+
+void Movie::truncate(std::size_t frame) {
+    // keep the keyframes at or before the frame
+    const std::size_t kept = find_keyframe(frame) + 1;
+    for (std::size_t keyframe = kept; keyframe < keyframes.size(); keyframe++)
+        pool.release(keyframes[keyframe].handle);
+    keyframes.resize(kept);
+    // drop the runs after the frame and shorten the run across it
+    while (!runs.empty() && runs.back().first >= frame)
+        runs.pop_back();
+    if (!runs.empty())
+        runs.back().length = std::min<uint64_t>(runs.back().length, frame - runs.back().first);
+    frames = frame;
+    is_cut = false;
+}
+
+std::size_t Movie::find_run(std::size_t frame) const {
+    auto run = std::upper_bound(runs.begin(), runs.end(), frame,
+        [](std::size_t frame, const Run& run) { return frame < run.first; });
+    return run - runs.begin() - 1;
+}
+
+std::size_t Movie::find_keyframe(std::size_t frame) const {
+    auto keyframe = std::upper_bound(keyframes.begin(), keyframes.end(), frame,
+        [](std::size_t frame, const Keyframe& keyframe) { return frame < keyframe.frame; });
+    return keyframe - keyframes.begin() - 1;
+}
+
+}  // namespace NES
@@ -0,0 +1,172 @@
+//  Program:      nes-py
+//  File:         observation.cpp
+//  Description:  A pipeline that preprocesses screens into stacked frames
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "observation.hpp"
+#include "palette.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace NES {
+
+/// Compute the area-averaging taps that resize a row or column.
+///
+/// In units of 1 / (output * source) the output o covers [o * S, (o + 1) * S)
+/// and the source s covers [s * O, (s + 1) * O), so the overlaps are exact
+/// integers and the taps of each output sum to the source size S.
+///
+/// @param source the number of source pixels
+/// @param output the number of output pixels
+/// @param taps the taps to fill, in order of output
+/// @param begin the first tap of each output and one past the last to fill
+///
+template <typename Tap>
+static void make_taps(int source, int output, std::vector<Tap>& taps, std::vector<int>& begin) {
+    taps.clear();
+    begin.clear();
+    for (int o = 0; o < output; o++) {
+        begin.push_back(taps.size());
+        const int64_t first = int64_t(o) * source;
+        const int64_t last = int64_t(o + 1) * source;
+        for (int s = first / output; s < source && int64_t(s) * output < last; s++) {
+            const int64_t overlap = std::min(last, int64_t(s + 1) * output) -
+                std::max(first, int64_t(s) * output);
+            if (overlap > 0)
+                taps.push_back({s, static_cast<uint32_t>(overlap)});
+        }
+    }
+    begin.push_back(taps.size());
+}
+
+/// Convert a row of RGB pixels to grayscale.
+///
+/// @param pixels the RGB pixels to convert
+/// @param gray the grayscale pixels to write
+/// @param length the number of pixels in the row
+///
+static void to_gray(const NES_Pixel* pixels, uint16_t* gray, int length) {
+    // ITU-R BT.601 luma with 8-bit fixed point weights, the sums fit in 16
+    // bits so the loop vectorizes without 32-bit multiplies
+    for (int x = 0; x < length; x++) {
+        const NES_Pixel pixel = pixels[x];
+        const uint16_t red = (pixel >> 16) & 0xff;
+        const uint16_t green = (pixel >> 8) & 0xff;
+        const uint16_t blue = pixel & 0xff;
+        gray[x] = uint16_t(77 * red + 150 * green + 29 * blue + 128) >> 8;
+    }
+}
+
+/// Return the grayscale of each color in the palette.
+static std::array<uint16_t, 64> make_palette_gray() {
+    std::array<uint16_t, 64> gray;
+    for (int index = 0; index < 64; index++)
+        to_gray(&PALETTE[index], &gray[index], 1);
+    return gray;
+}
+
+/// The grayscale of each color in the palette
+static const std::array<uint16_t, 64> PALETTE_GRAY = make_palette_gray();
+
+/// Convert a row of palette indexes to grayscale.
+///
+/// @param indexes the palette indexes to convert
+/// @param gray the grayscale pixels to write
+/// @param length the number of pixels in the row
+///
+static void to_gray(const NES_Byte* indexes, uint16_t* gray, int length) {
+    for (int x = 0; x < length; x++)
+        gray[x] = PALETTE_GRAY[indexes[x] & 0x3f];
+}
+
+ObservationPipeline::ObservationPipeline(const ObservationConfig& config_) :
+    ObservationPipeline(config_, nullptr) { }
+
+ObservationPipeline::ObservationPipeline(const ObservationConfig& config_, NES_Byte* ring_) :
+    config(config_), ring(ring_), head(0) {
+    if (config.crop_top < 0 || config.crop_left < 0 ||
+        config.crop_height < 1 || config.crop_width < 1 ||
+        config.crop_top + config.crop_height > VISIBLE_SCANLINES ||
+        config.crop_left + config.crop_width > SCANLINE_VISIBLE_DOTS)
+        throw std::invalid_argument("crop must be a non-empty rectangle inside the screen");
+    if (config.height < 1 || config.width < 1 || config.frames < 1)
+        throw std::invalid_argument("height, width, and frames must be positive");
+    make_taps(config.crop_width, config.width, taps_x, tap_begin_x);
+    make_taps(config.crop_height, config.height, taps_y, tap_begin_y);
+    luma.resize(config.crop_width);
+    sum.resize(config.crop_width);
+    if (ring == nullptr) {
+        storage.resize(2 * stack_size(), 0);
+        ring = storage.data();
+    }
+}
+
+void ObservationPipeline::reset(const NESFrameBufferT& screen) { fill(screen); }
+
+void ObservationPipeline::reset(const NESIndexBufferT& screen) { fill(screen); }
+
+void ObservationPipeline::push(const NESFrameBufferT& screen) { advance(screen); }
+
+void ObservationPipeline::push(const NESIndexBufferT& screen) { advance(screen); }
+
+template <typename Pixel>
+void ObservationPipeline::fill(const Pixel (&screen)[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS]) {
+    convert(screen, ring);
+    for (int slot = 1; slot < 2 * config.frames; slot++)
+        std::memcpy(ring + slot * frame_size(), ring, frame_size());
+}
+
+template <typename Pixel>
+void ObservationPipeline::advance(const Pixel (&screen)[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS]) {
+    head = (head + 1) % config.frames;
+    NES_Byte* frame = ring + head * frame_size();
+    convert(screen, frame);
+    std::memcpy(frame + config.frames * frame_size(), frame, frame_size());
+}
+
+template <typename Pixel>
+void ObservationPipeline::convert(const Pixel (&screen)[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS], NES_Byte* frame) {
+    // keep the buffers in locals so the loops over them vectorize
+    const int width = config.width;
+    const int crop_width = config.crop_width;
+    const Tap* horizontal = taps_x.data();
+    const int* horizontal_begin = tap_begin_x.data();
+    uint16_t* const gray = luma.data();
+    uint32_t* const total = sum.data();
+    // the sum of the weights of the taps of an output pixel
+    const uint32_t norm = uint32_t(crop_width) * config.crop_height;
+    // divide by the norm with a 44-bit reciprocal, exact for sums below
+    // 2^44 / norm (the sums are at most 256 x norm)
+    const uint64_t reciprocal = ((uint64_t(1) << 44) + norm - 1) / norm;
+    int last_source = -1;
+    for (int y = 0; y < config.height; y++) {
+        // resize vertically over whole source rows
+        std::fill(total, total + crop_width, 0);
+        for (int tap_y = tap_begin_y[y]; tap_y < tap_begin_y[y + 1]; tap_y++) {
+            const Tap& vertical = taps_y[tap_y];
+            // adjacent output rows share the source row on their boundary
+            if (vertical.source != last_source) {
+                to_gray(&screen[config.crop_top + vertical.source][config.crop_left], gray, crop_width);
+                last_source = vertical.source;
+            }
+            // the overlaps are at most 256, so the products fit in 16 bits
+            const uint16_t weight = vertical.weight;
+            for (int x = 0; x < crop_width; x++)
+                total[x] += uint16_t(gray[x] * weight);
+        }
+        // then resize the row horizontally
+        NES_Byte* output = frame + y * width;
+        for (int x = 0; x < width; x++) {
+            uint32_t value = norm / 2;
+            for (int tap_x = horizontal_begin[x]; tap_x < horizontal_begin[x + 1]; tap_x++)
+                value += total[horizontal[tap_x].source] * horizontal[tap_x].weight;
+            output[x] = (value * reciprocal) >> 44;
+        }
+    }
+}
+
+}  // namespace NES
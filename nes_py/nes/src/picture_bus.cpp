@@ -7,13 +7,12 @@
 
 #include "picture_bus.hpp"
 #include "log.hpp"
+#include <cstring>
 
 namespace NES {
 
-NES_Byte PictureBus::read(NES_Address address) {
-    if (address < 0x2000) {
-        return mapper->readCHR(address);
-    } else if (address < 0x3eff) {  // Name tables up to 0x3000, then mirrored up to 0x3ff
+NES_Byte PictureBus::read_unmapped(NES_Address address) {
+    if (address < 0x3eff) {  // Name tables up to 0x3000, then mirrored up to 0x3ff
         if (address < 0x2400)  // NT0
             return ram[name_tables[0] + (address & 0x3ff)];
         else if (address < 0x2800)  // NT1
@@ -48,6 +47,16 @@ void PictureBus::write(NES_Address address, NES_Byte value) {
     }
 }
 
+void PictureBus::save(PictureBusState& state) const {
+    std::memcpy(state.ram, ram.data(), sizeof(state.ram));
+    std::memcpy(state.palette, palette.data(), sizeof(state.palette));
+}
+
+void PictureBus::load(const PictureBusState& state) {
+    std::memcpy(ram.data(), state.ram, sizeof(state.ram));
+    std::memcpy(palette.data(), state.palette, sizeof(state.palette));
+}
+
 void PictureBus::update_mirroring() {
     switch (mapper->getNameTableMirroring()) {
         case HORIZONTAL:
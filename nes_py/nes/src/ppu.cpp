@@ -5,6 +5,7 @@
 //  Copyright (c) 2019 Christian Kauten. All rights reserved.
 //
 
+#include <array>
 #include <cstring>
 #include "ppu.hpp"
 #include "palette.hpp"
@@ -12,6 +13,43 @@
 
 namespace NES {
 
+/// The pixels of an 8-pixel row of a tile, one byte per pixel
+typedef std::array<uint64_t, 256> PatternTable;
+
+/// Return the pixels of each byte of a bit plane, from left to right.
+///
+/// @param is_flipped whether to read the bits of the plane right to left
+/// @return the table of the 8 pixels (0 or 1) of each byte of a bit plane
+///
+static PatternTable make_pattern_table(bool is_flipped) {
+    PatternTable table;
+    for (int plane = 0; plane < 256; plane++) {
+        NES_Byte pixels[8];
+        for (int pixel = 0; pixel < 8; pixel++)
+            pixels[pixel] = (plane >> (is_flipped ? pixel : 7 ^ pixel)) & 1;
+        std::memcpy(&table[plane], pixels, sizeof pixels);
+    }
+    return table;
+}
+
+/// The pixels of each byte of a bit plane from left to right
+static const PatternTable PATTERN_PIXELS = make_pattern_table(false);
+/// The pixels of each byte of a bit plane from right to left
+static const PatternTable PATTERN_PIXELS_FLIPPED = make_pattern_table(true);
+
+/// Decode the two bit planes of a tile row into 8 pixels of 2-bit colors.
+///
+/// @param table the table of pixels of each bit plane (flipped or not)
+/// @param low the low bit plane of the row
+/// @param high the high bit plane of the row
+/// @param pixels the 8 colors of the row to write, from left to right
+///
+static inline void decode_pattern(const PatternTable& table, NES_Byte low, NES_Byte high, NES_Byte* pixels) {
+    // the planes are 0 or 1 in each byte, so the shift doesn't carry
+    const uint64_t row = table[low] | (table[high] << 1);
+    std::memcpy(pixels, &row, sizeof row);
+}
+
 void PPU::reset() {
     is_long_sprites = false;
     is_interrupting = false;
@@ -30,11 +68,12 @@ void PPU::reset() {
     temp_address = 0;
     data_address_increment = 1;
     pipeline_state = PRE_RENDER;
-    scanline_sprites.reserve(8);
-    scanline_sprites.resize(0);
+    is_sprite_table_stale = true;
+    render_x = 0;
 }
 
 void PPU::cycle(PictureBus& bus, NESFrameBufferT* const screen) {
+    count_dots(1);
     switch (pipeline_state) {
         case PRE_RENDER: {
             if (cycles == 1)
@@ -54,128 +93,16 @@ void PPU::cycle(PictureBus& bus, NESFrameBufferT* const screen) {
             // if rendering is on, every other frame is one cycle shorter
             if (cycles >= SCANLINE_END_CYCLE - (!is_even_frame && is_showing_background && is_showing_sprites)) {
                 pipeline_state = RENDER;
-                cycles = scanline = 0;
+                cycles = scanline = render_x = 0;
             }
             break;
         }
         case RENDER: {
             if (cycles > 0 && cycles <= SCANLINE_VISIBLE_DOTS) {
-                NES_Byte bgColor = 0, sprColor = 0;
-                bool bgOpaque = false, sprOpaque = true;
-                bool spriteForeground = false;
-
-                int x = cycles - 1;
-                int y = scanline;
-
-                if (is_showing_background) {
-                    auto x_fine = (fine_x_scroll + x) % 8;
-                    if (!is_hiding_edge_background || x >= 8) {
-                        // fetch tile
-                        // mask off fine y
-                        auto address = 0x2000 | (data_address & 0x0FFF);
-                        //auto address = 0x2000 + x / 8 + (y / 8) * (SCANLINE_VISIBLE_DOTS / 8);
-                        NES_Byte tile = bus.read(address);
-
-                        //fetch pattern
-                        //Each pattern occupies 16 bytes, so multiply by 16
-                        //Add fine y
-                        address = (tile * 16) + ((data_address >> 12/*y % 8*/) & 0x7);
-                        //set whether the pattern is in the high or low page
-                        address |= background_page << 12;
-                        //Get the corresponding bit determined by (8 - x_fine) from the right
-                        //bit 0 of palette entry
-                        bgColor = (bus.read(address) >> (7 ^ x_fine)) & 1;
-                        //bit 1
-                        bgColor |= ((bus.read(address + 8) >> (7 ^ x_fine)) & 1) << 1;
-
-                        //flag used to calculate final pixel with the sprite pixel
-                        bgOpaque = bgColor;
-
-                        //fetch attribute and calculate higher two bits of palette
-                        address = 0x23C0 | (data_address & 0x0C00) | ((data_address >> 4) & 0x38)
-                                    | ((data_address >> 2) & 0x07);
-                        auto attribute = bus.read(address);
-                        int shift = ((data_address >> 4) & 4) | (data_address & 2);
-                        //Extract and set the upper two bits for the color
-                        bgColor |= ((attribute >> shift) & 0x3) << 2;
-                    }
-                    //Increment/wrap coarse X
-                    if (x_fine == 7) {
-                        // if coarse X == 31
-                        if ((data_address & 0x001F) == 31) {
-                            // coarse X = 0
-                            data_address &= ~0x001F;
-                            // switch horizontal nametable
-                            data_address ^= 0x0400;
-                        }
-                        else
-                            // increment coarse X
-                            data_address += 1;
-                    }
-                }
-
-                if (is_showing_sprites && (!is_hiding_edge_sprites || x >= 8)) {
-                    for (auto i : scanline_sprites) {
-                        NES_Byte spr_x =     sprite_memory[i * 4 + 3];
-
-                        if (0 > x - spr_x || x - spr_x >= 8)
-                            continue;
-
-                        NES_Byte spr_y     = sprite_memory[i * 4 + 0] + 1,
-                             tile      = sprite_memory[i * 4 + 1],
-                             attribute = sprite_memory[i * 4 + 2];
-
-                        int length = (is_long_sprites) ? 16 : 8;
-
-                        int x_shift = (x - spr_x) % 8, y_offset = (y - spr_y) % length;
-
-                        if ((attribute & 0x40) == 0) //If NOT flipping horizontally
-                            x_shift ^= 7;
-                        if ((attribute & 0x80) != 0) //IF flipping vertically
-                            y_offset ^= (length - 1);
-
-                        NES_Address address = 0;
-
-                        if (!is_long_sprites) {
-                            address = tile * 16 + y_offset;
-                            if (sprite_page == HIGH) address += 0x1000;
-                        }
-                        // 8 x 16 sprites
-                        else {
-                            //bit-3 is one if it is the bottom tile of the sprite, multiply by two to get the next pattern
-                            y_offset = (y_offset & 7) | ((y_offset & 8) << 1);
-                            address = (tile >> 1) * 32 + y_offset;
-                            address |= (tile & 1) << 12; //Bank 0x1000 if bit-0 is high
-                        }
-
-                        sprColor |= (bus.read(address) >> (x_shift)) & 1; //bit 0 of palette entry
-                        sprColor |= ((bus.read(address + 8) >> (x_shift)) & 1) << 1; //bit 1
-
-                        if (!(sprOpaque = sprColor)) {
-                            sprColor = 0;
-                            continue;
-                        }
-
-                        sprColor |= 0x10; //Select sprite palette
-                        sprColor |= (attribute & 0x3) << 2; //bits 2-3
-
-                        spriteForeground = !(attribute & 0x20);
-
-                        //Sprite-0 hit detection
-                        if (!is_sprite_zero_hit && is_showing_background && i == 0 && sprOpaque && bgOpaque)
-                            is_sprite_zero_hit = true;
-
-                        break; //Exit the loop now since we've found the highest priority sprite
-                    }
-                }
-                // get the address of the color in the palette
-                NES_Byte paletteAddr = bgColor;
-                if ( (!bgOpaque && sprOpaque) || (bgOpaque && sprOpaque && spriteForeground) )
-                    paletteAddr = sprColor;
-                else if (!bgOpaque && !sprOpaque)
-                    paletteAddr = 0;
-                // lookup the pixel in the palette and write it to the screen
-                (*screen)[y][x] = PALETTE[bus.read_palette(paletteAddr)];
+                if (render_mode == RENDER_DOT)
+                    render_dot(bus, screen);
+                else if (cycles == SCANLINE_VISIBLE_DOTS)
+                    render_scanline(bus, screen, SCANLINE_VISIBLE_DOTS);
             }
             else if (cycles == SCANLINE_VISIBLE_DOTS + 1 && is_showing_background) {
                 //Shamelessly copied from nesdev wiki
@@ -217,24 +144,11 @@ void PPU::cycle(PictureBus& bus, NESFrameBufferT* const screen) {
                 //This isn't where/when this indexing, actually copying in 2C02 is done
                 //but (I think) it shouldn't hurt any games if this is done here
 
-                scanline_sprites.resize(0);
-
-                int range = 8;
-                if (is_long_sprites)
-                    range = 16;
-
-                NES_Byte j = 0;
-                for (NES_Byte i = sprite_data_address / 4; i < 64; ++i) {
-                    auto diff = (scanline - sprite_memory[i * 4]);
-                    if (0 <= diff && diff < range) {
-                        scanline_sprites.push_back(i);
-                        if (++j >= 8)
-                            break;
-                    }
-                }
+                if (is_sprite_table_stale || sprite_table_first != sprite_data_address / 4 || is_sprite_table_long != is_long_sprites)
+                    build_sprite_table();
 
                 ++scanline;
-                cycles = 0;
+                cycles = render_x = 0;
             }
 
             if (scanline >= VISIBLE_SCANLINES)
@@ -276,6 +190,545 @@ void PPU::cycle(PictureBus& bus, NESFrameBufferT* const screen) {
     ++cycles;
 }
 
+void PPU::run(PictureBus& bus, NESFrameBufferT* const screen, int count) {
+    while (count > 0) {
+        int idle = std::min(idle_cycles(), count);
+        count_dots(idle);
+        cycles += idle;
+        count -= idle;
+        if (count == 0) break;
+        cycle(bus, screen);
+        --count;
+    }
+}
+
+/// Return the number of calls to cycle before the one that ends a scanline.
+///
+/// @param cycles the cycle of the next call on the scanline
+/// @param end the cycle that ends the scanline
+/// @return the number of idle calls before the end of the scanline
+///
+static inline int cycles_until(int cycles, int end) {
+    return std::max(end - cycles, 0);
+}
+
+int PPU::idle_cycles() const {
+    const bool is_rendering = is_showing_background && is_showing_sprites;
+    switch (pipeline_state) {
+        case PRE_RENDER: {
+            if (cycles <= 1)
+                return cycles_until(cycles, 1);
+            if (is_rendering && cycles <= SCANLINE_VISIBLE_DOTS + 2)
+                return cycles_until(cycles, SCANLINE_VISIBLE_DOTS + 2);
+            if (is_rendering && cycles <= 304)
+                return cycles_until(cycles, 281);
+            return cycles_until(cycles, SCANLINE_END_CYCLE - (!is_even_frame && is_rendering));
+        }
+        case RENDER: {
+            if (cycles == 0)
+                return 0;
+            if (cycles <= SCANLINE_VISIBLE_DOTS)
+                return render_mode == RENDER_DOT ? 0 : cycles_until(cycles, SCANLINE_VISIBLE_DOTS);
+            if (is_showing_background && cycles <= SCANLINE_VISIBLE_DOTS + 1)
+                return 0;
+            if (is_rendering && cycles <= SCANLINE_VISIBLE_DOTS + 2)
+                return cycles_until(cycles, SCANLINE_VISIBLE_DOTS + 2);
+            return cycles_until(cycles, SCANLINE_END_CYCLE);
+        }
+        case VERTICAL_BLANK: {
+            if (scanline == VISIBLE_SCANLINES + 1 && cycles <= 1)
+                return cycles_until(cycles, 1);
+            return cycles_until(cycles, SCANLINE_END_CYCLE);
+        }
+        default:
+            return cycles_until(cycles, SCANLINE_END_CYCLE);
+    }
+}
+
+int PPU::cycles_until_interrupt() const {
+    if (!is_interrupting) return -1;
+    // the cycles of a full scanline, the first call on a scanline is cycle 1
+    const int line = SCANLINE_END_CYCLE;
+    // the cycles from the start of the pre-render line to the interrupt
+    // (240 visible lines, the post-render line, and the first vblank cycle)
+    const int from_render = (VISIBLE_SCANLINES + 1) * line + 1;
+    const bool is_rendering = is_showing_background && is_showing_sprites;
+    // the remaining calls on the current line, including the one that ends it
+    const int remaining = cycles_until(cycles, SCANLINE_END_CYCLE) + 1;
+    switch (pipeline_state) {
+        case PRE_RENDER: {
+            const int end = SCANLINE_END_CYCLE - (!is_even_frame && is_rendering);
+            return cycles_until(cycles, end) + 1 + from_render;
+        }
+        case RENDER:
+            return remaining + from_render - (scanline + 1) * line;
+        case POST_RENDER:
+            return remaining + 1;
+        case VERTICAL_BLANK: {
+            if (scanline == VISIBLE_SCANLINES + 1 && cycles <= 1)
+                return cycles_until(cycles, 1) + 1;
+            // the next frame flips the parity of the pre-render line
+            const int pre_render = SCANLINE_END_CYCLE - (is_even_frame && is_rendering);
+            return remaining + (FRAME_END_SCANLINE - 1 - scanline) * line + pre_render + from_render;
+        }
+    }
+    return -1;
+}
+
+int PPU::cycles_until_status_change(int elapsed) const {
+    const int line = SCANLINE_END_CYCLE;
+    const int frame = (FRAME_END_SCANLINE + 1) * line;
+    // the position of the next call in the frame (from the pre-render line)
+    const int now = (pipeline_state == PRE_RENDER ? 0 : (scanline + 1) * line) + cycles - 1;
+    // the spans of the frame the status changes in: the flags clear on the
+    // pre-render line, vertical blank starts after the post-render line,
+    // and sprite 0 can hit on any visible scanline it covers
+    const int vblank = (VISIBLE_SCANLINES + 2) * line;
+    int spans[3][2] = {{0, 1}, {vblank, vblank + 1}, {0, 1}};
+    const int top = sprite_memory[0] + 1;
+    if (top < VISIBLE_SCANLINES) {
+        const int bottom = std::min(top + (is_long_sprites ? 16 : 8), VISIBLE_SCANLINES);
+        spans[2][0] = (top + 1) * line;
+        spans[2][1] = (bottom + 1) * line;
+    }
+    // a scanline of margin covers the shorter odd frames
+    int until = 2 * frame;
+    for (const auto& span : spans) {
+        for (int offset = -frame; offset <= frame; offset += frame) {
+            const int begin = span[0] + offset - line;
+            const int end = span[1] + offset + line;
+            if (end <= now - elapsed)
+                continue;
+            if (begin <= now)
+                return -1;
+            until = std::min(until, begin - now);
+        }
+    }
+    return until;
+}
+
+void PPU::render_dot(PictureBus& bus, NESFrameBufferT* const screen) {
+    NES_Byte bgColor = 0, sprColor = 0;
+    bool bgOpaque = false, sprOpaque = true;
+    bool spriteForeground = false;
+
+    int x = cycles - 1;
+    int y = scanline;
+
+    if (is_showing_background) {
+        auto x_fine = (fine_x_scroll + x) % 8;
+        if (!is_hiding_edge_background || x >= 8) {
+            // fetch tile
+            // mask off fine y
+            auto address = 0x2000 | (data_address & 0x0FFF);
+            //auto address = 0x2000 + x / 8 + (y / 8) * (SCANLINE_VISIBLE_DOTS / 8);
+            NES_Byte tile = bus.read(address);
+
+            //fetch pattern
+            //Each pattern occupies 16 bytes, so multiply by 16
+            //Add fine y
+            address = (tile * 16) + ((data_address >> 12/*y % 8*/) & 0x7);
+            //set whether the pattern is in the high or low page
+            address |= background_page << 12;
+            //Get the corresponding bit determined by (8 - x_fine) from the right
+            //bit 0 of palette entry
+            bgColor = (bus.read(address) >> (7 ^ x_fine)) & 1;
+            //bit 1
+            bgColor |= ((bus.read(address + 8) >> (7 ^ x_fine)) & 1) << 1;
+
+            //flag used to calculate final pixel with the sprite pixel
+            bgOpaque = bgColor;
+
+            //fetch attribute and calculate higher two bits of palette
+            address = 0x23C0 | (data_address & 0x0C00) | ((data_address >> 4) & 0x38)
+                        | ((data_address >> 2) & 0x07);
+            auto attribute = bus.read(address);
+            int shift = ((data_address >> 4) & 4) | (data_address & 2);
+            //Extract and set the upper two bits for the color
+            bgColor |= ((attribute >> shift) & 0x3) << 2;
+        }
+        //Increment/wrap coarse X
+        if (x_fine == 7) {
+            // if coarse X == 31
+            if ((data_address & 0x001F) == 31) {
+                // coarse X = 0
+                data_address &= ~0x001F;
+                // switch horizontal nametable
+                data_address ^= 0x0400;
+            }
+            else
+                // increment coarse X
+                data_address += 1;
+        }
+    }
+
+    if (is_showing_sprites && (!is_hiding_edge_sprites || x >= 8)) {
+        const int sprite_count = get_scanline_sprite_count();
+        for (int n = 0; n < sprite_count; ++n) {
+            const NES_Byte i = sprite_table[scanline - 1][n];
+            NES_Byte spr_x =     sprite_memory[i * 4 + 3];
+
+            if (0 > x - spr_x || x - spr_x >= 8)
+                continue;
+
+            NES_Byte spr_y     = sprite_memory[i * 4 + 0] + 1,
+                 tile      = sprite_memory[i * 4 + 1],
+                 attribute = sprite_memory[i * 4 + 2];
+
+            int length = (is_long_sprites) ? 16 : 8;
+
+            int x_shift = (x - spr_x) % 8, y_offset = (y - spr_y) % length;
+
+            if ((attribute & 0x40) == 0) //If NOT flipping horizontally
+                x_shift ^= 7;
+            if ((attribute & 0x80) != 0) //IF flipping vertically
+                y_offset ^= (length - 1);
+
+            NES_Address address = 0;
+
+            if (!is_long_sprites) {
+                address = tile * 16 + y_offset;
+                if (sprite_page == HIGH) address += 0x1000;
+            }
+            // 8 x 16 sprites
+            else {
+                //bit-3 is one if it is the bottom tile of the sprite, multiply by two to get the next pattern
+                y_offset = (y_offset & 7) | ((y_offset & 8) << 1);
+                address = (tile >> 1) * 32 + y_offset;
+                address |= (tile & 1) << 12; //Bank 0x1000 if bit-0 is high
+            }
+
+            sprColor |= (bus.read(address) >> (x_shift)) & 1; //bit 0 of palette entry
+            sprColor |= ((bus.read(address + 8) >> (x_shift)) & 1) << 1; //bit 1
+
+            if (!(sprOpaque = sprColor)) {
+                sprColor = 0;
+                continue;
+            }
+
+            sprColor |= 0x10; //Select sprite palette
+            sprColor |= (attribute & 0x3) << 2; //bits 2-3
+
+            spriteForeground = !(attribute & 0x20);
+
+            //Sprite-0 hit detection
+            if (!is_sprite_zero_hit && is_showing_background && i == 0 && sprOpaque && bgOpaque)
+                is_sprite_zero_hit = true;
+
+            break; //Exit the loop now since we've found the highest priority sprite
+        }
+    }
+    // get the address of the color in the palette
+    NES_Byte paletteAddr = bgColor;
+    if ( (!bgOpaque && sprOpaque) || (bgOpaque && sprOpaque && spriteForeground) )
+        paletteAddr = sprColor;
+    else if (!bgOpaque && !sprOpaque)
+        paletteAddr = 0;
+    // lookup the pixel in the palette and write it to the screen
+    write_pixel(screen, y, x, bus.read_palette(paletteAddr));
+    render_x = x + 1;
+}
+
+void PPU::build_sprite_table() {
+    const int range = is_long_sprites ? 16 : 8;
+    std::memset(sprite_table_sizes, 0, sizeof sprite_table_sizes);
+    // sprites in OAM order, so the first 8 on a scanline fill its row
+    for (int i = sprite_data_address / 4; i < 64; ++i) {
+        const int top = sprite_memory[i * 4];
+        const int bottom = std::min(top + range, VISIBLE_SCANLINES);
+        for (int line = top; line < bottom; ++line) {
+            if (sprite_table_sizes[line] < 8)
+                sprite_table[line][sprite_table_sizes[line]++] = i;
+        }
+    }
+    sprite_table_first = sprite_data_address / 4;
+    is_sprite_table_long = is_long_sprites;
+    is_sprite_table_stale = false;
+}
+
+void PPU::fetch_sprite_pattern(PictureBus& bus, NES_Byte index, NES_Byte& low, NES_Byte& high) {
+    const int length = (is_long_sprites) ? 16 : 8;
+    NES_Byte spr_y     = sprite_memory[index * 4 + 0] + 1,
+             tile      = sprite_memory[index * 4 + 1],
+             attribute = sprite_memory[index * 4 + 2];
+
+    int y_offset = (scanline - spr_y) % length;
+    if ((attribute & 0x80) != 0)  // if flipping vertically
+        y_offset ^= (length - 1);
+
+    NES_Address address = 0;
+    if (!is_long_sprites) {
+        address = tile * 16 + y_offset;
+        if (sprite_page == HIGH) address += 0x1000;
+    } else {  // 8 x 16 sprites
+        y_offset = (y_offset & 7) | ((y_offset & 8) << 1);
+        address = (tile >> 1) * 32 + y_offset;
+        address |= (tile & 1) << 12;
+    }
+    low = bus.read(address);
+    high = bus.read(address + 8);
+}
+
+void PPU::skip_scanline(PictureBus& bus, int end) {
+    const int begin = render_x;
+    // the opaque pixels of sprite 0 that can still hit the background
+    bool is_sprite_zero_opaque[SCANLINE_VISIBLE_DOTS];
+    int hit_begin = end, hit_end = end;
+    const int sprite_count = get_scanline_sprite_count();
+    const bool is_sprite_zero = sprite_count > 0 && sprite_table[scanline - 1][0] == 0;
+    if (!is_sprite_zero_hit && is_showing_background && is_showing_sprites && is_sprite_zero) {
+        const int left = is_hiding_edge_sprites ? std::max(begin, 8) : begin;
+        const NES_Byte spr_x = sprite_memory[3];
+        hit_begin = std::max(left, static_cast<int>(spr_x));
+        hit_end = std::min(end, spr_x + 8);
+        if (hit_begin < hit_end) {
+            NES_Byte pattern_low, pattern_high;
+            fetch_sprite_pattern(bus, 0, pattern_low, pattern_high);
+            const NES_Byte attribute = sprite_memory[2];
+            for (int x = hit_begin; x < hit_end; x++) {
+                int x_shift = x - spr_x;
+                if ((attribute & 0x40) == 0)  // if NOT flipping horizontally
+                    x_shift ^= 7;
+                is_sprite_zero_opaque[x] = ((pattern_low | pattern_high) >> x_shift) & 1;
+            }
+        }
+    }
+
+    // step over the background one tile row at a time, only the tiles under
+    // sprite 0 are fetched to check for a hit
+    if (is_showing_background) {
+        for (int x = begin; x < end;) {
+            const int x_fine = (fine_x_scroll + x) % 8;
+            const int length = std::min(8 - x_fine, end - x);
+            const int first = std::max(hit_begin,
+                (is_hiding_edge_background && x < 8) ? std::min(8, x + length) : x);
+            const int last = std::min(hit_end, x + length);
+            if (first < last && !is_sprite_zero_hit) {
+                NES_Byte tile = bus.read(0x2000 | (data_address & 0x0FFF));
+                NES_Address address = (tile * 16) + ((data_address >> 12) & 0x7);
+                address |= background_page << 12;
+                const NES_Byte pattern = bus.read(address) | bus.read(address + 8);
+                for (int pixel = first; pixel < last; pixel++) {
+                    if (is_sprite_zero_opaque[pixel] && ((pattern >> (7 ^ (x_fine + pixel - x))) & 1))
+                        is_sprite_zero_hit = true;
+                }
+            }
+            // increment / wrap coarse X after the last pixel of the tile
+            if (x_fine + length == 8) {
+                if ((data_address & 0x001F) == 31) {
+                    data_address &= ~0x001F;
+                    data_address ^= 0x0400;
+                } else {
+                    data_address += 1;
+                }
+            }
+            x += length;
+        }
+    }
+    render_x = end;
+}
+
+void PPU::render_scanline(PictureBus& bus, NESFrameBufferT* const screen, int end) {
+    if (render_x >= end) return;
+    if (is_skipping_pixels) {
+        skip_scanline(bus, end);
+        return;
+    }
+    const int begin = render_x;
+    const int y = scanline;
+    // the background color of each pixel (attribute bits included), where
+    // the lower two bits are zero for transparent pixels
+    NES_Byte background[SCANLINE_VISIBLE_DOTS];
+    // the sprite color of each pixel, zero for transparent pixels
+    NES_Byte sprite[SCANLINE_VISIBLE_DOTS];
+    // the priority and sprite-0 flags of each sprite pixel
+    NES_Byte sprite_flags[SCANLINE_VISIBLE_DOTS];
+    enum : NES_Byte { SPRITE_FOREGROUND = 1, SPRITE_ZERO = 2 };
+
+    // decode the background one tile row (up to 8 pixels) at a time
+    std::memset(background + begin, 0, end - begin);
+    if (is_showing_background) {
+        for (int x = begin; x < end;) {
+            const int x_fine = (fine_x_scroll + x) % 8;
+            // the pixels up to and including the last pixel of this tile
+            const int length = std::min(8 - x_fine, end - x);
+            // the first pixel in the tile that isn't hidden by the edge mask
+            const int first = (is_hiding_edge_background && x < 8) ? std::min(8, x + length) : x;
+            if (first < x + length) {
+                // fetch the tile and its pattern, same as the per-dot fetch
+                NES_Byte tile = bus.read(0x2000 | (data_address & 0x0FFF));
+                NES_Address address = (tile * 16) + ((data_address >> 12) & 0x7);
+                address |= background_page << 12;
+                const NES_Byte pattern_low = bus.read(address);
+                const NES_Byte pattern_high = bus.read(address + 8);
+                // fetch the attribute for the upper two bits of the color
+                address = 0x23C0 | (data_address & 0x0C00) | ((data_address >> 4) & 0x38)
+                            | ((data_address >> 2) & 0x07);
+                const int shift = ((data_address >> 4) & 4) | (data_address & 2);
+                const NES_Byte palette = ((bus.read(address) >> shift) & 0x3) << 2;
+                NES_Byte pixels[8];
+                decode_pattern(PATTERN_PIXELS, pattern_low, pattern_high, pixels);
+                for (int pixel = first; pixel < x + length; pixel++)
+                    background[pixel] = palette | pixels[x_fine + pixel - x];
+            }
+            // increment / wrap coarse X after the last pixel of the tile
+            if (x_fine + length == 8) {
+                if ((data_address & 0x001F) == 31) {
+                    data_address &= ~0x001F;
+                    data_address ^= 0x0400;
+                } else {
+                    data_address += 1;
+                }
+            }
+            x += length;
+        }
+    }
+
+    // compose the sprites into the line buffer, the first opaque sprite
+    // pixel in OAM order has priority
+    std::memset(sprite + begin, 0, end - begin);
+    if (is_showing_sprites) {
+        const int left = is_hiding_edge_sprites ? std::max(begin, 8) : begin;
+        const int sprite_count = get_scanline_sprite_count();
+        for (int n = 0; n < sprite_count; ++n) {
+            const NES_Byte i = sprite_table[scanline - 1][n];
+            const NES_Byte spr_x = sprite_memory[i * 4 + 3];
+            const int sprite_begin = std::max(left, static_cast<int>(spr_x));
+            const int sprite_end = std::min(end, spr_x + 8);
+            if (sprite_begin >= sprite_end)
+                continue;
+
+            const NES_Byte attribute = sprite_memory[i * 4 + 2];
+            NES_Byte pattern_low, pattern_high;
+            fetch_sprite_pattern(bus, i, pattern_low, pattern_high);
+            NES_Byte pixels[8];
+            decode_pattern((attribute & 0x40) ? PATTERN_PIXELS_FLIPPED : PATTERN_PIXELS,
+                pattern_low, pattern_high, pixels);
+
+            const NES_Byte palette = 0x10 | ((attribute & 0x3) << 2);
+            const NES_Byte flags = (!(attribute & 0x20) ? SPRITE_FOREGROUND : 0) | (i == 0 ? SPRITE_ZERO : 0);
+            for (int x = sprite_begin; x < sprite_end; x++) {
+                if (sprite[x]) continue;
+                const NES_Byte color = pixels[x - spr_x];
+                if (!color) continue;
+                sprite[x] = palette | color;
+                sprite_flags[x] = flags;
+            }
+        }
+    }
+
+    // merge the background and sprites and write the pixels to the screen
+    for (int x = begin; x < end; x++) {
+        const bool is_background_opaque = background[x] & 0x3;
+        NES_Byte palette_address = is_background_opaque ? background[x] : 0;
+        if (sprite[x]) {
+            if (!is_background_opaque || (sprite_flags[x] & SPRITE_FOREGROUND))
+                palette_address = sprite[x];
+            if (is_background_opaque && (sprite_flags[x] & SPRITE_ZERO))
+                is_sprite_zero_hit = true;
+        }
+        write_pixel(screen, y, x, bus.read_palette(palette_address));
+    }
+    render_x = end;
+}
+
+void PPU::sync(PictureBus& bus, NESFrameBufferT* const screen) {
+    if (render_mode == RENDER_SCANLINE && pipeline_state == RENDER)
+        render_scanline(bus, screen, std::min(cycles - 1, SCANLINE_VISIBLE_DOTS));
+}
+
+void PPU::set_render_mode(RenderMode mode, PictureBus& bus, NESFrameBufferT* const screen) {
+    // finish the pixels pending in the current mode before switching
+    sync(bus, screen);
+    render_mode = mode;
+}
+
+void PPU::set_is_skipping_pixels(bool is_skipping, PictureBus& bus, NESFrameBufferT* const screen) {
+    // finish the pixels pending in the current mode before switching
+    sync(bus, screen);
+    is_skipping_pixels = is_skipping;
+}
+
+void PPU::set_index_screen(NESIndexBufferT* const indexes, PictureBus& bus, NESFrameBufferT* const screen) {
+    // finish the pixels pending in the current format before switching
+    sync(bus, screen);
+    index_screen = indexes;
+}
+
+void convert_indexes(const NESIndexBufferT& indexes, NESFrameBufferT& screen) {
+    const NES_Byte* index = &indexes[0][0];
+    NES_Pixel* pixel = &screen[0][0];
+    for (int i = 0; i < VISIBLE_SCANLINES * SCANLINE_VISIBLE_DOTS; i++)
+        pixel[i] = PALETTE[index[i] & 0x3f];
+}
+
+void PPU::save(PPUState& state) const {
+    std::memcpy(state.sprite_memory, sprite_memory.data(), sizeof(state.sprite_memory));
+    state.pipeline_state = pipeline_state;
+    state.is_even_frame = is_even_frame;
+    state.is_vblank = is_vblank;
+    state.is_sprite_zero_hit = is_sprite_zero_hit;
+    state.is_first_write = is_first_write;
+    state.data_buffer = data_buffer;
+    state.sprite_data_address = sprite_data_address;
+    state.fine_x_scroll = fine_x_scroll;
+    state.is_showing_sprites = is_showing_sprites;
+    state.is_showing_background = is_showing_background;
+    state.is_hiding_edge_sprites = is_hiding_edge_sprites;
+    state.is_hiding_edge_background = is_hiding_edge_background;
+    state.is_long_sprites = is_long_sprites;
+    state.is_interrupting = is_interrupting;
+    state.background_page = background_page;
+    state.sprite_page = sprite_page;
+    std::memset(state.padding, 0, sizeof(state.padding));
+    state.data_address = data_address;
+    state.temp_address = temp_address;
+    state.data_address_increment = data_address_increment;
+    state.cycles = cycles;
+    state.scanline = scanline;
+    state.render_x = render_x;
+}
+
+void PPU::load(const PPUState& state) {
+    std::memcpy(sprite_memory.data(), state.sprite_memory, sizeof(state.sprite_memory));
+    pipeline_state = static_cast<State>(state.pipeline_state);
+    is_even_frame = state.is_even_frame;
+    is_vblank = state.is_vblank;
+    is_sprite_zero_hit = state.is_sprite_zero_hit;
+    is_first_write = state.is_first_write;
+    data_buffer = state.data_buffer;
+    sprite_data_address = state.sprite_data_address;
+    fine_x_scroll = state.fine_x_scroll;
+    is_showing_sprites = state.is_showing_sprites;
+    is_showing_background = state.is_showing_background;
+    is_hiding_edge_sprites = state.is_hiding_edge_sprites;
+    is_hiding_edge_background = state.is_hiding_edge_background;
+    is_long_sprites = state.is_long_sprites;
+    is_interrupting = state.is_interrupting;
+    background_page = static_cast<CharacterPage>(state.background_page);
+    sprite_page = static_cast<CharacterPage>(state.sprite_page);
+    data_address = state.data_address;
+    temp_address = state.temp_address;
+    data_address_increment = state.data_address_increment;
+    cycles = state.cycles;
+    scanline = state.scanline;
+    render_x = state.render_x;
+    // the sprite table isn't in the state, evaluate it from the loaded OAM
+    build_sprite_table();
+}
+
+bool PPU::is_valid(const PPUState& state) {
+    // the scanline indexes the sprite table and the screen while rendering
+    const int last_scanline = state.pipeline_state == RENDER ? VISIBLE_SCANLINES : FRAME_END_SCANLINE;
+    return state.pipeline_state <= VERTICAL_BLANK &&
+        state.scanline >= 0 && state.scanline < last_scanline &&
+        state.cycles >= 0 && state.cycles <= SCANLINE_END_CYCLE &&
+        state.render_x >= 0 && state.render_x <= SCANLINE_VISIBLE_DOTS &&
+        state.fine_x_scroll < 8 &&
+        state.background_page <= HIGH && state.sprite_page <= HIGH &&
+        (state.data_address_increment == 1 || state.data_address_increment == 0x20);
+}
+
 void PPU::do_DMA(const NES_Byte* page_ptr) {
     std::memcpy(
         sprite_memory.data() + sprite_data_address,
@@ -288,6 +741,7 @@ void PPU::do_DMA(const NES_Byte* page_ptr) {
             page_ptr + (256 - sprite_data_address),
             sprite_data_address
         );
+    is_sprite_table_stale = true;
 }
 
 void PPU::control(NES_Byte ctrl) {
@@ -0,0 +1,119 @@
+//  Program:      nes-py
+//  File:         reward.cpp
+//  Description:  A compiled program of rewards and terminations over RAM
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "reward.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace NES {
+
+/// The number of bytes of RAM the program reads from
+static const NES_Address RAM_SIZE = 0x800;
+
+RewardProgram::RewardProgram(const RewardSpec& spec_) : spec(spec_) {
+    // compile each value to a load per byte with the place value of the byte
+    for (const RewardSpec::Value& value : spec.values) {
+        if (value.addresses.empty() || value.addresses.size() > MAX_VALUE_BYTES)
+            throw std::invalid_argument("a value must have 1 to 8 addresses");
+        const bool is_bcd = value.encoding == RAMEncoding::BCD;
+        uint64_t base;
+        switch (value.encoding) {
+            case RAMEncoding::BINARY: base = 0x100; break;
+            case RAMEncoding::DIGITS: base = 10;    break;
+            case RAMEncoding::BCD:    base = 100;   break;
+            default: throw std::invalid_argument("unknown RAM encoding");
+        }
+        load_begin.push_back(loads.size());
+        uint64_t scale = 1;
+        for (NES_Address address : value.addresses) {
+            if (address >= RAM_SIZE)
+                throw std::invalid_argument("reward addresses must be below 0x800");
+            loads.push_back({address, is_bcd, static_cast<int64_t>(scale)});
+            scale *= base;
+        }
+    }
+    load_begin.push_back(loads.size());
+    for (const RewardSpec::Condition& condition : spec.conditions) {
+        if (condition.value >= spec.values.size())
+            throw std::invalid_argument("a condition refers to a value that doesn't exist");
+        if (condition.comparison < Comparison::EQUAL || condition.comparison > Comparison::GREATER_EQUAL)
+            throw std::invalid_argument("unknown comparison");
+    }
+    for (const RewardSpec::Term& term : spec.terms) {
+        const std::size_t count = term.is_condition ? spec.conditions.size() : spec.values.size();
+        if (term.index >= count)
+            throw std::invalid_argument("a reward term refers to a value or condition that doesn't exist");
+        if (!(term.low <= term.high))
+            throw std::invalid_argument("the clip of a reward term must have low <= high");
+    }
+    for (std::size_t condition : spec.terminations)
+        if (condition >= spec.conditions.size())
+            throw std::invalid_argument("a termination refers to a condition that doesn't exist");
+    if (!(spec.low <= spec.high))
+        throw std::invalid_argument("the clip of the reward must have low <= high");
+    current.assign(spec.values.size(), 0);
+    previous.assign(spec.values.size(), 0);
+}
+
+void RewardProgram::decode(const NES_Byte* ram) {
+    for (std::size_t value = 0; value < current.size(); value++) {
+        uint64_t sum = 0;
+        for (std::size_t load = load_begin[value]; load < load_begin[value + 1]; load++) {
+            const NES_Byte byte = ram[loads[load].address];
+            const uint64_t digit = loads[load].is_bcd ? (byte >> 4) * 10 + (byte & 0xf) : byte;
+            sum += digit * static_cast<uint64_t>(loads[load].scale);
+        }
+        current[value] = static_cast<int64_t>(sum);
+    }
+}
+
+bool RewardProgram::test(const RewardSpec::Condition& condition) const {
+    int64_t operand = current[condition.value];
+    if (condition.is_delta)
+        operand -= previous[condition.value];
+    switch (condition.comparison) {
+        case Comparison::EQUAL:         return operand == condition.operand;
+        case Comparison::NOT_EQUAL:     return operand != condition.operand;
+        case Comparison::LESS:          return operand <  condition.operand;
+        case Comparison::LESS_EQUAL:    return operand <= condition.operand;
+        case Comparison::GREATER:       return operand >  condition.operand;
+        case Comparison::GREATER_EQUAL: return operand >= condition.operand;
+    }
+    return false;
+}
+
+void RewardProgram::reset(const NES_Byte* ram, int64_t* info) {
+    decode(ram);
+    previous = current;
+    std::copy(current.begin(), current.end(), info);
+}
+
+void RewardProgram::evaluate(const NES_Byte* ram, float* reward, NES_Byte* done, int64_t* info) {
+    decode(ram);
+    double sum = 0;
+    for (const RewardSpec::Term& term : spec.terms) {
+        double operand;
+        if (term.is_condition) {
+            operand = test(spec.conditions[term.index]);
+        } else {
+            int64_t value = current[term.index];
+            if (term.is_delta)
+                value -= previous[term.index];
+            operand = static_cast<double>(value);
+        }
+        sum += std::min(std::max(term.weight * operand, term.low), term.high);
+    }
+    *reward = static_cast<float>(std::min(std::max(sum, spec.low), spec.high));
+    bool is_done = false;
+    for (std::size_t condition : spec.terminations)
+        is_done = is_done || test(spec.conditions[condition]);
+    *done = is_done;
+    std::copy(current.begin(), current.end(), info);
+    std::swap(previous, current);
+}
+
+}  // namespace NES
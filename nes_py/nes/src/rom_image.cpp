@@ -0,0 +1,159 @@
+//  Program:      nes-py
+//  File:         rom_image.cpp
+//  Description:  A read-only ROM file image shared between emulators
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "rom_image.hpp"
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#if defined(_WIN32)
+    #include <fstream>
+    #include <iterator>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace NES {
+
+/// Return the 64-bit FNV-1a hash of a buffer.
+///
+/// @param data the bytes to hash
+/// @param size the number of bytes to hash
+/// @return the hash of the bytes
+///
+static uint64_t fnv1a(const NES_Byte* data, std::size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/// The images that emulators reference, keyed by the contents of the ROM
+struct ROMImageCache {
+    /// the key of a file: the path, size, and modification time
+    typedef std::tuple<std::string, uint64_t, int64_t> FileKey;
+    /// the key of a buffer: the hash and size of the bytes
+    typedef std::pair<uint64_t, std::size_t> BufferKey;
+
+    /// the lock on the cache
+    std::mutex lock;
+    /// the images of files
+    std::map<FileKey, std::weak_ptr<const ROMImage>> files;
+    /// the images of buffers
+    std::map<BufferKey, std::weak_ptr<const ROMImage>> buffers;
+};
+
+/// Return the process-wide cache of ROM images.
+static ROMImageCache& cache() {
+    static ROMImageCache instance;
+    return instance;
+}
+
+/// Remove the entries of released images from a map of the cache.
+///
+/// @param images the map to remove the entries of released images from
+///
+template <typename Map>
+static void erase_expired(Map& images) {
+    for (auto entry = images.begin(); entry != images.end();) {
+        if (entry->second.expired())
+            entry = images.erase(entry);
+        else
+            ++entry;
+    }
+}
+
+ROMImage::~ROMImage() {
+#if !defined(_WIN32)
+    if (is_mapped)
+        munmap(const_cast<NES_Byte*>(bytes), length);
+#endif
+}
+
+std::shared_ptr<const ROMImage> ROMImage::from_buffer(const NES_Byte* data, std::size_t size) {
+    const uint64_t hash = fnv1a(data, size);
+    ROMImageCache& images = cache();
+    std::lock_guard<std::mutex> guard(images.lock);
+    erase_expired(images.buffers);
+    auto& entry = images.buffers[ROMImageCache::BufferKey(hash, size)];
+    auto image = entry.lock();
+    if (image && std::memcmp(image->data(), data, size) == 0)
+        return image;
+    std::shared_ptr<ROMImage> created(new ROMImage);
+    created->buffer.assign(data, data + size);
+    created->bytes = created->buffer.data();
+    created->length = size;
+    created->hash = hash;
+    // a hash collision replaces the cached image, the old one stays valid
+    entry = created;
+    return created;
+}
+
+#if defined(_WIN32)
+
+std::shared_ptr<const ROMImage> ROMImage::open(const std::string& path) {
+    // memory mapping isn't supported here, read the file into the shared
+    // buffers instead
+    std::ifstream file(path, std::ios_base::binary | std::ios_base::in);
+    if (!file)
+        throw std::invalid_argument("failed to open ROM file " + path);
+    std::vector<NES_Byte> data(
+        (std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>()
+    );
+    return from_buffer(data.data(), data.size());
+}
+
+#else
+
+std::shared_ptr<const ROMImage> ROMImage::open(const std::string& path) {
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        throw std::invalid_argument("failed to open ROM file " + path);
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        close(descriptor);
+        throw std::invalid_argument("failed to read ROM file " + path);
+    }
+    const ROMImageCache::FileKey key(
+        path,
+        static_cast<uint64_t>(status.st_size),
+        static_cast<int64_t>(status.st_mtime)
+    );
+    ROMImageCache& images = cache();
+    std::lock_guard<std::mutex> guard(images.lock);
+    erase_expired(images.files);
+    // reuse the image if the file hasn't changed since it was mapped
+    auto& entry = images.files[key];
+    if (auto image = entry.lock()) {
+        close(descriptor);
+        return image;
+    }
+    void* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED)
+        throw std::invalid_argument("failed to map ROM file " + path);
+    std::shared_ptr<ROMImage> created(new ROMImage);
+    created->bytes = static_cast<const NES_Byte*>(mapping);
+    created->length = status.st_size;
+    created->is_mapped = true;
+    created->hash = fnv1a(created->bytes, created->length);
+    entry = created;
+    return created;
+}
+
+#endif
+
+}  // namespace NES
@@ -0,0 +1,297 @@
+//  Program:      nes-py
+//  File:         shared_batch.cpp
+//  Description:  A batch of emulator outputs in shared memory for workers
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "shared_batch.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace NES {
+
+/// The number of bytes each part of the segment is aligned to
+static const std::size_t ALIGNMENT = 64;
+
+/// Return a number of bytes rounded up to the alignment.
+static inline std::size_t aligned(std::size_t bytes) {
+    return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+/// Wait a little before polling a queue again: spin first, then yield, and
+/// then sleep so that an idle worker doesn't keep a core busy.
+///
+/// @param polls the number of polls so far, incremented
+///
+static inline void backoff(std::size_t& polls) {
+    if (++polls < 64)
+        return;
+    if (polls < 1024)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+/// The bits of the fields of a request message
+static const unsigned SLOT_BITS = 16;
+static const unsigned COMMAND_BITS = 8;
+/// The bit of a completion message set if the request failed
+static const uint64_t FAILED_BIT = uint64_t(1) << 32;
+
+SharedBatch::SharedBatch(const std::string& name_, bool is_owner_, void* base_, std::size_t bytes_) :
+    name(name_),
+    is_owner(is_owner_),
+    base(base_),
+    bytes(bytes_),
+    header(static_cast<Header*>(base_)),
+    channels(reinterpret_cast<Channel*>(static_cast<NES_Byte*>(base_) + aligned(sizeof(Header)))) { }
+
+std::unique_ptr<SharedBatch> SharedBatch::create(
+    const std::string& name,
+    std::size_t num_emulators,
+    std::size_t observation_size,
+    std::size_t num_info_values,
+    std::size_t num_workers,
+    std::size_t slots
+) {
+    if (num_emulators == 0 || observation_size == 0 || num_workers == 0 || slots == 0)
+        throw std::invalid_argument("a shared batch needs emulators, observations, workers, and slots");
+    if (num_workers > num_emulators)
+        throw std::invalid_argument("every worker of a shared batch needs an emulator");
+    if (slots >= (std::size_t(1) << SLOT_BITS))
+        throw std::invalid_argument("a shared batch has at most 65535 slots");
+    // the regions of a slot in the order of REGIONS
+    const std::size_t sizes[REGIONS] = {
+        num_emulators * 2,
+        num_emulators * observation_size,
+        num_emulators * VecEmulator::MEMORY_SIZE,
+        num_emulators * sizeof(float),
+        num_emulators,
+        num_emulators * num_info_values * sizeof(int64_t),
+    };
+    const std::size_t start = aligned(sizeof(Header)) + aligned(num_workers * sizeof(Channel));
+    uint64_t offsets[REGIONS];
+    std::size_t slot_size = 0;
+    for (std::size_t region = 0; region < REGIONS; region++) {
+        offsets[region] = start + slot_size;
+        slot_size += aligned(sizes[region]);
+    }
+    const std::size_t bytes = start + slots * slot_size;
+#if defined(__unix__) || defined(__APPLE__)
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        throw std::invalid_argument("failed to create shared memory " + name + ": " + std::strerror(errno));
+    // the new pages read as zeros
+    if (ftruncate(fd, bytes) != 0) {
+        const int error = errno;
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::invalid_argument("failed to size shared memory " + name + ": " + std::strerror(error));
+    }
+    void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int error = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::invalid_argument("failed to map shared memory " + name + ": " + std::strerror(error));
+    }
+    std::unique_ptr<SharedBatch> batch(new SharedBatch(name, true, base, bytes));
+    Header* header = new (base) Header;
+    header->bytes = bytes;
+    header->num_emulators = num_emulators;
+    header->observation_size = observation_size;
+    header->num_info_values = num_info_values;
+    header->num_workers = num_workers;
+    header->slots = slots;
+    std::memcpy(header->offsets, offsets, sizeof(offsets));
+    header->slot_size = slot_size;
+    for (std::size_t worker = 0; worker < num_workers; worker++) {
+        Channel* channel = new (&batch->channels[worker]) Channel;
+        channel->requests.head.store(0, std::memory_order_relaxed);
+        channel->requests.tail.store(0, std::memory_order_relaxed);
+        channel->completions.head.store(0, std::memory_order_relaxed);
+        channel->completions.tail.store(0, std::memory_order_relaxed);
+        channel->status.store(STARTING, std::memory_order_relaxed);
+    }
+    // publish the layout to the processes that attach
+    header->magic.store(MAGIC, std::memory_order_release);
+    return batch;
+#else
+    (void) name;
+    throw std::runtime_error("shared memory batches require POSIX shared memory");
+#endif
+}
+
+std::unique_ptr<SharedBatch> SharedBatch::attach(const std::string& name) {
+#if defined(__unix__) || defined(__APPLE__)
+    const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+        throw std::invalid_argument("failed to open shared memory " + name + ": " + std::strerror(errno));
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(Header)) {
+        close(fd);
+        throw std::invalid_argument("shared memory " + name + " isn't a batch");
+    }
+    const std::size_t bytes = info.st_size;
+    void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int error = errno;
+    close(fd);
+    if (base == MAP_FAILED)
+        throw std::invalid_argument("failed to map shared memory " + name + ": " + std::strerror(error));
+    std::unique_ptr<SharedBatch> batch(new SharedBatch(name, false, base, bytes));
+    if (batch->header->magic.load(std::memory_order_acquire) != MAGIC || batch->header->bytes != bytes)
+        throw std::invalid_argument("shared memory " + name + " isn't a batch");
+    return batch;
+#else
+    (void) name;
+    throw std::runtime_error("shared memory batches require POSIX shared memory");
+#endif
+}
+
+SharedBatch::~SharedBatch() {
+#if defined(__unix__) || defined(__APPLE__)
+    unlink();
+    munmap(base, bytes);
+#endif
+}
+
+void SharedBatch::unlink() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (is_owner)
+        shm_unlink(name.c_str());
+#endif
+    is_owner = false;
+}
+
+void SharedBatch::request(std::size_t worker, Command command, std::size_t slot, std::size_t index) {
+    const uint64_t message = slot
+        | (static_cast<uint64_t>(command) << SLOT_BITS)
+        | (static_cast<uint64_t>(index) << 32);
+    std::size_t polls = 0;
+    while (!channels[worker].requests.try_push(message))
+        backoff(polls);
+}
+
+int64_t SharedBatch::wait(std::size_t worker, int64_t timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    Channel& channel = channels[worker];
+    uint64_t message;
+    std::size_t polls = 0;
+    while (!channel.completions.try_pop(message)) {
+        backoff(polls);
+        if (timeout >= 0 && std::chrono::steady_clock::now() >= deadline)
+            return -1;
+    }
+    // the error is written before the completion is pushed
+    if (message & FAILED_BIT)
+        throw std::runtime_error(get_error(worker));
+    return message & ((uint64_t(1) << SLOT_BITS) - 1);
+}
+
+void SharedBatch::write_outputs(VecEmulator& vec, std::size_t begin, std::size_t first, std::size_t count, std::size_t slot) {
+    const std::size_t size = observation_size();
+    NES_Byte* observations = get_observations(slot) + (begin + first) * size;
+    if (vec.has_frame_stacks()) {
+        // pack the stacks, which are strided by the rings of the pipelines
+        const std::size_t stride = vec.get_frame_stack_stride();
+        for (std::size_t index = 0; index < count; index++)
+            std::memcpy(observations + index * size, vec.get_frame_stacks() + (first + index) * stride, size);
+    } else {
+        std::memcpy(observations, vec.get_observations() + first * size, count * size);
+    }
+    const std::size_t MEMORY_SIZE = VecEmulator::MEMORY_SIZE;
+    std::memcpy(get_memory(slot) + (begin + first) * MEMORY_SIZE, vec.get_memory() + first * MEMORY_SIZE, count * MEMORY_SIZE);
+    if (vec.has_rewards()) {
+        const std::size_t values = num_info_values();
+        std::memcpy(get_rewards(slot) + begin + first, vec.get_rewards() + first, count * sizeof(float));
+        std::memcpy(get_dones(slot) + begin + first, vec.get_dones() + first, count);
+        std::memcpy(get_infos(slot) + (begin + first) * values, vec.get_infos() + first * values, count * values * sizeof(int64_t));
+    }
+}
+
+void SharedBatch::serve(VecEmulator& vec, std::size_t worker) {
+    if (worker >= num_workers())
+        throw std::invalid_argument("worker index out of range");
+    Channel& channel = channels[worker];
+    const std::size_t begin = worker_begin(worker);
+    const std::size_t count = worker_end(worker) - begin;
+    const char* mismatch = nullptr;
+    if (vec.size() != count)
+        mismatch = "the worker has the wrong number of emulators for the shared batch";
+    else if (vec.observation_size() != observation_size() || vec.get_observation_buffer() != nullptr)
+        mismatch = "the observations of the worker don't match the shared batch";
+    else if (vec.num_info_values() != num_info_values())
+        mismatch = "the reward spec of the worker doesn't match the shared batch";
+    if (mismatch != nullptr) {
+        std::strncpy(channel.error, mismatch, ERROR_SIZE - 1);
+        channel.status.store(FAILED, std::memory_order_release);
+        throw std::invalid_argument(mismatch);
+    }
+    channel.status.store(READY, std::memory_order_release);
+#if defined(__unix__) || defined(__APPLE__)
+    // a worker is orphaned (and reparented) when the client dies
+    const pid_t parent = getppid();
+#endif
+    std::size_t polls = 0;
+    uint64_t message;
+    while (true) {
+        if (!channel.requests.try_pop(message)) {
+            backoff(polls);
+#if defined(__unix__) || defined(__APPLE__)
+            if (polls % 2048 == 0 && getppid() != parent)
+                break;
+#endif
+            continue;
+        }
+        polls = 0;
+        const std::size_t slot = message & ((uint64_t(1) << SLOT_BITS) - 1);
+        const uint64_t command = (message >> SLOT_BITS) & ((uint64_t(1) << COMMAND_BITS) - 1);
+        const std::size_t index = message >> 32;
+        if (command == STOP)
+            break;
+        uint64_t completion = slot;
+        try {
+            if (slot >= num_slots())
+                throw std::invalid_argument("slot index out of range");
+            switch (command) {
+                case RESET:
+                    vec.reset();
+                    write_outputs(vec, begin, 0, count, slot);
+                    break;
+                case RESET_ONE:
+                    if (index < begin || index - begin >= count)
+                        throw std::invalid_argument("the emulator isn't hosted by the worker");
+                    vec.reset(index - begin);
+                    write_outputs(vec, begin, index - begin, 1, slot);
+                    break;
+                case STEP:
+                    vec.step(get_actions(slot) + begin * 2, 2);
+                    write_outputs(vec, begin, 0, count, slot);
+                    break;
+                default:
+                    throw std::invalid_argument("unknown shared batch command");
+            }
+        } catch (const std::exception& error) {
+            std::strncpy(channel.error, error.what(), ERROR_SIZE - 1);
+            completion |= FAILED_BIT;
+        }
+        std::size_t waits = 0;
+        while (!channel.completions.try_push(completion))
+            backoff(waits);
+    }
+    channel.status.store(STOPPED, std::memory_order_release);
+}
+
+}  // namespace NES
@@ -0,0 +1,153 @@
+//  Program:      nes-py
+//  File:         snapshot_pool.cpp
+//  Description:  A pool of emulator snapshots stored as page-level deltas
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "snapshot_pool.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace NES {
+
+/// Return true if a page contains only zeros.
+///
+/// @param page the first byte of the page
+/// @return true if every byte of the page is zero, false otherwise
+///
+static bool is_zero_page(const NES_Byte* page) {
+    for (std::size_t i = 0; i < SnapshotPool::PAGE_SIZE; i++)
+        if (page[i]) return false;
+    return true;
+}
+
+SnapshotPool::SnapshotPool(int keyframe_interval) :
+    keyframe_interval(std::max(1, keyframe_interval)),
+    live(0),
+    stored_bytes(0),
+    buffers(2),
+    cache(&buffers[0]),
+    cached(NONE),
+    scratch(&buffers[1]) {
+    // zero the padding after the state in the last page
+    std::memset(cache->bytes, 0, sizeof(cache->bytes));
+    std::memset(scratch->bytes, 0, sizeof(scratch->bytes));
+}
+
+SnapshotPool::Handle SnapshotPool::save(Emulator& emulator, Handle parent) {
+    emulator.snapshot(scratch->state());
+    Snapshot snapshot;
+    snapshot.parent = NONE;
+    snapshot.depth = 0;
+    snapshot.references = 1;
+    snapshot.is_live = true;
+    if (parent != NONE && at(parent).depth + 1 < keyframe_interval) {
+        // store the pages that differ from the parent
+        if (cached != parent) {
+            build(parent, *cache);
+            cached = parent;
+        }
+        snapshot.parent = parent;
+        snapshot.depth = snapshots[parent].depth + 1;
+        for (std::size_t page = 0; page < PAGES; page++) {
+            const NES_Byte* bytes = scratch->bytes + page * PAGE_SIZE;
+            if (std::memcmp(bytes, cache->bytes + page * PAGE_SIZE, PAGE_SIZE) == 0)
+                continue;
+            if (is_zero_page(bytes)) {
+                snapshot.zero.set(page);
+            } else {
+                snapshot.stored.set(page);
+                snapshot.pages.insert(snapshot.pages.end(), bytes, bytes + PAGE_SIZE);
+            }
+        }
+        ++snapshots[parent].references;
+    } else {  // store a keyframe with every page that isn't zero
+        for (std::size_t page = 0; page < PAGES; page++) {
+            const NES_Byte* bytes = scratch->bytes + page * PAGE_SIZE;
+            if (is_zero_page(bytes)) {
+                snapshot.zero.set(page);
+            } else {
+                snapshot.stored.set(page);
+                snapshot.pages.insert(snapshot.pages.end(), bytes, bytes + PAGE_SIZE);
+            }
+        }
+    }
+    snapshot.pages.shrink_to_fit();
+    stored_bytes += snapshot.pages.size();
+    // place the snapshot in a free slot if there is one
+    Handle handle;
+    if (free_handles.empty()) {
+        handle = snapshots.size();
+        snapshots.push_back(std::move(snapshot));
+    } else {
+        handle = free_handles.back();
+        free_handles.pop_back();
+        snapshots[handle] = std::move(snapshot);
+    }
+    ++live;
+    // the new state is the most likely parent of the next snapshot
+    std::swap(cache, scratch);
+    cached = handle;
+    return handle;
+}
+
+void SnapshotPool::restore(Handle handle, Emulator& emulator) {
+    at(handle);
+    if (cached != handle) {
+        build(handle, *cache);
+        cached = handle;
+    }
+    if (!emulator.is_compatible(cache->state()))
+        throw std::invalid_argument("snapshot is from an emulator with another ROM");
+    emulator.restore(cache->state());
+}
+
+void SnapshotPool::release(Handle handle) {
+    at(handle).is_live = false;
+    --live;
+    unreference(handle);
+}
+
+SnapshotPool::Snapshot& SnapshotPool::at(Handle handle) {
+    if (handle < 0 || handle >= static_cast<Handle>(snapshots.size()) || !snapshots[handle].is_live)
+        throw std::invalid_argument("invalid snapshot handle " + std::to_string(handle));
+    return snapshots[handle];
+}
+
+void SnapshotPool::build(Handle handle, Buffer& buffer) const {
+    std::bitset<PAGES> done;
+    // the closest snapshot in the chain that has a page holds its value
+    for (; handle != NONE && !done.all(); handle = snapshots[handle].parent) {
+        const Snapshot& snapshot = snapshots[handle];
+        const NES_Byte* bytes = snapshot.pages.data();
+        for (std::size_t page = 0; page < PAGES; page++) {
+            if (snapshot.stored[page]) {
+                if (!done[page])
+                    std::memcpy(buffer.bytes + page * PAGE_SIZE, bytes, PAGE_SIZE);
+                bytes += PAGE_SIZE;
+            } else if (!snapshot.zero[page] || done[page]) {
+                continue;
+            } else {
+                std::memset(buffer.bytes + page * PAGE_SIZE, 0, PAGE_SIZE);
+            }
+            done.set(page);
+        }
+    }
+}
+
+void SnapshotPool::unreference(Handle handle) {
+    while (handle != NONE && --snapshots[handle].references == 0) {
+        Snapshot& snapshot = snapshots[handle];
+        Handle parent = snapshot.parent;
+        stored_bytes -= snapshot.pages.size();
+        std::vector<NES_Byte>().swap(snapshot.pages);
+        free_handles.push_back(handle);
+        if (cached == handle) cached = NONE;
+        handle = parent;
+    }
+}
+
+}  // namespace NES
@@ -0,0 +1,144 @@
+//  Program:      nes-py
+//  File:         state_hash.cpp
+//  Description:  Fast 64-bit hashes of emulator states for determinism checks
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "state_hash.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace NES {
+
+/// The primes of XXH64
+static const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+/// Rotate a 64-bit value left.
+static inline uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/// Read a 64-bit value from unaligned memory (little-endian hosts).
+static inline uint64_t read_64(const NES_Byte* data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof value);
+    return value;
+}
+
+/// Read a 32-bit value from unaligned memory (little-endian hosts).
+static inline uint64_t read_32(const NES_Byte* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof value);
+    return value;
+}
+
+/// Mix 8 bytes of input into an accumulator of XXH64.
+static inline uint64_t accumulate(uint64_t accumulator, uint64_t input) {
+    accumulator += input * PRIME_2;
+    return rotate_left(accumulator, 31) * PRIME_1;
+}
+
+/// Merge an accumulator of XXH64 into the hash.
+static inline uint64_t merge_round(uint64_t hash, uint64_t accumulator) {
+    hash ^= accumulate(0, accumulator);
+    return hash * PRIME_1 + PRIME_4;
+}
+
+uint64_t xxhash64(const void* data, std::size_t size, uint64_t seed) {
+    const NES_Byte* input = static_cast<const NES_Byte*>(data);
+    const NES_Byte* const end = input + size;
+    uint64_t hash;
+    if (size >= 32) {
+        // 4 independent lanes of 8 bytes each
+        uint64_t lane_1 = seed + PRIME_1 + PRIME_2;
+        uint64_t lane_2 = seed + PRIME_2;
+        uint64_t lane_3 = seed;
+        uint64_t lane_4 = seed - PRIME_1;
+        for (; input + 32 <= end; input += 32) {
+            lane_1 = accumulate(lane_1, read_64(input));
+            lane_2 = accumulate(lane_2, read_64(input + 8));
+            lane_3 = accumulate(lane_3, read_64(input + 16));
+            lane_4 = accumulate(lane_4, read_64(input + 24));
+        }
+        hash = rotate_left(lane_1, 1) + rotate_left(lane_2, 7) +
+            rotate_left(lane_3, 12) + rotate_left(lane_4, 18);
+        hash = merge_round(hash, lane_1);
+        hash = merge_round(hash, lane_2);
+        hash = merge_round(hash, lane_3);
+        hash = merge_round(hash, lane_4);
+    } else {
+        hash = seed + PRIME_5;
+    }
+    hash += size;
+    // the tail of fewer than 32 bytes
+    for (; input + 8 <= end; input += 8)
+        hash = rotate_left(hash ^ accumulate(0, read_64(input)), 27) * PRIME_1 + PRIME_4;
+    if (input + 4 <= end) {
+        hash = rotate_left(hash ^ (read_32(input) * PRIME_1), 23) * PRIME_2 + PRIME_3;
+        input += 4;
+    }
+    for (; input < end; input++)
+        hash = rotate_left(hash ^ (*input * PRIME_5), 11) * PRIME_1;
+    // avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/// Return the number of bytes in a page of a state.
+///
+/// @param page the index of the page
+/// @return the size of the page, only the last page is short
+///
+static inline std::size_t page_size(std::size_t page) {
+    return std::min(STATE_HASH_PAGE_SIZE, sizeof(State) - page * STATE_HASH_PAGE_SIZE);
+}
+
+/// Return the hash of a page of a state.
+///
+/// @param bytes the bytes of the state
+/// @param page the index of the page to hash
+/// @return the hash of the page, seeded by its index
+///
+static inline uint64_t hash_page(const NES_Byte* bytes, std::size_t page) {
+    return xxhash64(bytes + page * STATE_HASH_PAGE_SIZE, page_size(page), page);
+}
+
+uint64_t hash_state(const State& state) {
+    const NES_Byte* bytes = reinterpret_cast<const NES_Byte*>(&state);
+    uint64_t page_hashes[STATE_HASH_PAGES];
+    for (std::size_t page = 0; page < STATE_HASH_PAGES; page++)
+        page_hashes[page] = hash_page(bytes, page);
+    return xxhash64(page_hashes, sizeof page_hashes);
+}
+
+StateHasher::StateHasher() : previous(new State()) {
+    const NES_Byte* bytes = reinterpret_cast<const NES_Byte*>(previous.get());
+    for (std::size_t page = 0; page < STATE_HASH_PAGES; page++)
+        page_hashes[page] = hash_page(bytes, page);
+}
+
+uint64_t StateHasher::hash(const State& state) {
+    const NES_Byte* bytes = reinterpret_cast<const NES_Byte*>(&state);
+    NES_Byte* last = reinterpret_cast<NES_Byte*>(previous.get());
+    // comparing a page is cheaper than hashing it, only rehash the pages
+    // that changed since the last state
+    for (std::size_t page = 0; page < STATE_HASH_PAGES; page++) {
+        const std::size_t offset = page * STATE_HASH_PAGE_SIZE;
+        if (std::memcmp(bytes + offset, last + offset, page_size(page)) == 0)
+            continue;
+        std::memcpy(last + offset, bytes + offset, page_size(page));
+        page_hashes[page] = hash_page(bytes, page);
+    }
+    return xxhash64(page_hashes, sizeof page_hashes);
+}
+
+}  // namespace NES
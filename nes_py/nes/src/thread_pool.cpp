@@ -0,0 +1,147 @@
+//  Program:      nes-py
+//  File:         thread_pool.cpp
+//  Description:  A persistent work-stealing thread pool for batched emulation
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "thread_pool.hpp"
+#include "log.hpp"
+#include <new>
+#include <utility>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace NES {
+
+/// Pin a thread to a single CPU core (only supported on Linux).
+///
+/// @param thread the thread to pin
+/// @param core the index of the core to pin the thread to
+///
+static void pin_thread(std::thread& thread, std::size_t core) {
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus)) {
+        LOG(Info) << "Failed to pin worker thread to core " << core << std::endl;
+    }
+#else
+    (void) thread;
+    (void) core;
+#endif
+}
+
+ThreadPool::ThreadPool(std::size_t num_threads, bool pin_threads) :
+    blocks(nullptr),
+    task(nullptr),
+    generation(0),
+    active(0),
+    is_stopping(false),
+    is_failed(false) {
+    std::size_t cores = std::thread::hardware_concurrency();
+    if (cores == 0) cores = 1;
+    if (num_threads == 0) num_threads = cores;
+    // over-allocate by a line and construct the blocks at the first boundary
+    block_storage.reset(new unsigned char[(num_threads + 1) * sizeof(Block)]);
+    void* aligned = block_storage.get();
+    std::size_t space = (num_threads + 1) * sizeof(Block);
+    blocks = static_cast<Block*>(std::align(alignof(Block), num_threads * sizeof(Block), aligned, space));
+    for (std::size_t id = 0; id < num_threads; id++) {
+        new (&blocks[id]) Block;
+        blocks[id].next = 0;
+        blocks[id].end = 0;
+    }
+    // the calling thread is participant 0, so spawn one less worker
+    for (std::size_t id = 1; id < num_threads; id++) {
+        workers.emplace_back(&ThreadPool::work, this, id);
+        if (pin_threads) pin_thread(workers.back(), id % cores);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_stopping = true;
+    }
+    start_condition.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::parallel_for(std::size_t count, const Task& task) {
+    if (count == 0) return;
+    // without workers (or with one index) there is nothing to schedule
+    if (workers.empty() || count == 1) {
+        for (std::size_t index = 0; index < count; index++) task(index);
+        return;
+    }
+    // split the indices into one contiguous block per participant
+    const std::size_t participants = size();
+    for (std::size_t id = 0; id < participants; id++) {
+        blocks[id].next.store(id * count / participants, std::memory_order_relaxed);
+        blocks[id].end = (id + 1) * count / participants;
+    }
+    // wake the workers (the mutex publishes the blocks to them)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        active = workers.size();
+        is_failed.store(false, std::memory_order_relaxed);
+        error = nullptr;
+        ++generation;
+    }
+    start_condition.notify_all();
+    // participate in the loop from the calling thread (drain doesn't throw,
+    // so the task outlives every worker that still references it)
+    drain(0);
+    // wait for the workers to finish their last index
+    std::exception_ptr failure;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done_condition.wait(lock, [this]() { return active == 0; });
+        this->task = nullptr;
+        std::swap(failure, error);
+    }
+    if (failure) std::rethrow_exception(failure);
+}
+
+void ThreadPool::work(std::size_t id) {
+    std::size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [&]() { return is_stopping || generation != seen; });
+            if (is_stopping) return;
+            seen = generation;
+        }
+        drain(id);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--active == 0) done_condition.notify_one();
+    }
+}
+
+void ThreadPool::drain(std::size_t id) {
+    const std::size_t participants = size();
+    // start with the owned block, then visit the others in ring order
+    for (std::size_t offset = 0; offset < participants; offset++) {
+        Block& block = blocks[(id + offset) % participants];
+        while (!is_failed.load(std::memory_order_relaxed)) {
+            std::size_t index = block.next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= block.end) break;
+            try {
+                (*task)(index);
+            } catch (...) {
+                // keep the first exception for the caller and skip the rest
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+                is_failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+}  // namespace NES
@@ -0,0 +1,388 @@
+//  Program:      nes-py
+//  File:         vec_emulator.cpp
+//  Description:  This class houses a batch of NES emulators stepped together
+//
+//  Copyright (c) 2019 Christian Kauten. All rights reserved.
+//
+
+#include "vec_emulator.hpp"
+#include "palette.hpp"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace NES {
+
+/// Return the number of threads to step a batch of emulators with.
+///
+/// @param num_threads the requested number of threads, 0 for the default
+/// @param num_emulators the number of emulators in the batch
+/// @return the number of threads, at most one per emulator
+///
+static std::size_t pool_size(std::size_t num_threads, std::size_t num_emulators) {
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    return std::max(std::size_t(1), std::min(num_threads, num_emulators));
+}
+
+/// Convert a screen of palette indexes to packed RGB pixels.
+///
+/// @param indexes the HEIGHT x WIDTH palette indexes to convert
+/// @param rgb the HEIGHT x WIDTH x 3 bytes to write
+///
+static void write_packed_rgb(const NES_Byte* indexes, NES_Byte* rgb) {
+    for (int pixel = 0; pixel < Emulator::HEIGHT * Emulator::WIDTH; pixel++) {
+        const NES_Pixel color = PALETTE[indexes[pixel] & 0x3f];
+        rgb[0] = color >> 16;
+        rgb[1] = color >> 8;
+        rgb[2] = color;
+        rgb += 3;
+    }
+}
+
+/// Convert a screen of palette indexes to planar RGB pixels.
+///
+/// @param indexes the HEIGHT x WIDTH palette indexes to convert
+/// @param rgb the 3 x HEIGHT x WIDTH bytes to write
+///
+static void write_planar_rgb(const NES_Byte* indexes, NES_Byte* rgb) {
+    const int PIXELS = Emulator::HEIGHT * Emulator::WIDTH;
+    for (int pixel = 0; pixel < PIXELS; pixel++) {
+        const NES_Pixel color = PALETTE[indexes[pixel] & 0x3f];
+        rgb[pixel] = color >> 16;
+        rgb[PIXELS + pixel] = color >> 8;
+        rgb[2 * PIXELS + pixel] = color;
+    }
+}
+
+VecEmulator::VecEmulator(
+    const std::string& rom_path,
+    std::size_t num_emulators,
+    std::size_t num_threads,
+    bool pin_threads
+) : VecEmulator(ROMImage::open(rom_path), num_emulators, num_threads, pin_threads) { }
+
+VecEmulator::VecEmulator(
+    std::shared_ptr<const ROMImage> rom,
+    std::size_t num_emulators,
+    std::size_t num_threads,
+    bool pin_threads
+) :
+    pool(pool_size(num_threads, num_emulators), pin_threads),
+    observations(num_emulators * OBSERVATION_SIZE, 0),
+    memory(num_emulators * MEMORY_SIZE, 0) {
+    emulators.reserve(num_emulators);
+    for (std::size_t index = 0; index < num_emulators; index++) {
+        emulators.emplace_back(new Emulator(rom));
+        // the outputs are converted from palette indexes once per frame
+        emulators.back()->set_pixel_format(PPU::PIXEL_INDEXED);
+    }
+}
+
+VecEmulator::~VecEmulator() {
+    if (!stepper.joinable())
+        return;
+    {
+        std::unique_lock<std::mutex> lock(step_mutex);
+        // finish the pending step before the emulators it uses go away
+        done_condition.wait(lock, [this] { return !is_step_started; });
+        is_stopping = true;
+    }
+    start_condition.notify_one();
+    stepper.join();
+}
+
+void VecEmulator::reset() {
+    wait();
+    pool.parallel_for(size(), [this](std::size_t index) { reset_emulator(index); });
+}
+
+void VecEmulator::reset(std::size_t index) {
+    wait();
+    reset_emulator(index);
+}
+
+void VecEmulator::reset_emulator(std::size_t index) {
+    emulators[index]->reset();
+    write_outputs(index, true);
+}
+
+void VecEmulator::step(const NES_Byte* actions, std::size_t players) {
+    wait();
+    step_emulators(actions, players);
+}
+
+void VecEmulator::step_emulators(const NES_Byte* actions, std::size_t players) {
+    pool.parallel_for(size(), [&](std::size_t index) {
+        Emulator& emulator = *emulators[index];
+        const NES_Byte* action = actions + index * players;
+        *emulator.get_controller(0) = action[0];
+        if (players > 1)
+            *emulator.get_controller(1) = action[1];
+        emulator.step();
+        write_outputs(index, false);
+    });
+}
+
+void VecEmulator::step_async(const NES_Byte* actions, std::size_t players) {
+    wait();
+    if (!is_double_buffered) {
+        // the back buffers start as copies of the front buffers
+        back_observations = observations;
+        back_memory = memory;
+        back_rewards = rewards;
+        back_dones = dones;
+        back_infos = infos;
+        if (has_frame_stacks()) {
+            const std::size_t stack_size = pipelines.front().stack_size();
+            stacks.resize(size() * stack_size);
+            for (std::size_t index = 0; index < size(); index++)
+                std::memcpy(stacks.data() + index * stack_size, pipelines[index].get_stack(), stack_size);
+            back_stacks = stacks;
+        }
+        is_double_buffered = true;
+    }
+    // the step writes over the buffers of the step before the last, the
+    // buffers of the last step are left to the caller
+    swap_buffers();
+    async_actions.assign(actions, actions + size() * players);
+    async_players = players;
+    if (!stepper.joinable())
+        stepper = std::thread(&VecEmulator::run_stepper, this);
+    {
+        std::lock_guard<std::mutex> lock(step_mutex);
+        is_step_started = true;
+        is_step_done = false;
+    }
+    is_pending = true;
+    start_condition.notify_one();
+}
+
+void VecEmulator::run_stepper() {
+    std::unique_lock<std::mutex> lock(step_mutex);
+    while (true) {
+        start_condition.wait(lock, [this] { return is_step_started || is_stopping; });
+        if (is_stopping)
+            return;
+        lock.unlock();
+        // the stepper is the calling participant of the worker pool
+        std::exception_ptr error;
+        try {
+            step_emulators(async_actions.data(), async_players);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        step_error = error;
+        is_step_started = false;
+        is_step_done = true;
+        done_condition.notify_all();
+    }
+}
+
+void VecEmulator::wait() {
+    if (!is_pending) return;
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(step_mutex);
+        done_condition.wait(lock, [this] { return is_step_done; });
+        is_step_done = false;
+        std::swap(error, step_error);
+    }
+    is_pending = false;
+    // rethrow the exception of the step, if any
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void VecEmulator::swap_buffers() {
+    observations.swap(back_observations);
+    memory.swap(back_memory);
+    stacks.swap(back_stacks);
+    rewards.swap(back_rewards);
+    dones.swap(back_dones);
+    infos.swap(back_infos);
+    if (back_observation_buffer != nullptr)
+        std::swap(observation_buffer, back_observation_buffer);
+}
+
+void VecEmulator::stop_double_buffering() {
+    wait();
+    is_double_buffered = false;
+}
+
+template <typename T>
+void VecEmulator::retire(std::vector<T>& buffer) {
+    if (buffer.capacity() != 0)
+        retired.push_back(std::make_shared<std::vector<T>>(std::move(buffer)));
+    buffer = std::vector<T>();
+}
+
+void VecEmulator::rollout(
+    const State* states,
+    std::size_t rollouts,
+    const NES_Byte* actions,
+    std::size_t players,
+    int frames,
+    const NES_Address* addresses,
+    std::size_t count,
+    NES_Byte* traces
+) {
+    wait();
+    // validate everything up front so a failed rollout can't leave the
+    // batch halfway through
+    Emulator& first = *emulators.front();
+    for (std::size_t index = 0; index < rollouts; index++)
+        if (!first.is_compatible(&states[index]))
+            throw std::invalid_argument("state is from another version or ROM, or is corrupted");
+    for (std::size_t index = 0; index < count; index++)
+        if (addresses[index] >= 0x800)
+            throw std::invalid_argument("rollout addresses must be below 0x800");
+    const std::size_t workers = std::min(size(), rollouts);
+    pool.parallel_for(workers, [&](std::size_t worker) {
+        // emulator i runs rollouts i, i + workers, ... and then returns to
+        // the state it was in
+        Emulator& emulator = *emulators[worker];
+        std::unique_ptr<State> saved(new State);
+        emulator.snapshot(saved.get());
+        for (std::size_t index = worker; index < rollouts; index += workers) {
+            emulator.rollout(
+                &states[index],
+                actions + index * frames * players,
+                players,
+                frames,
+                addresses,
+                count,
+                traces + index * frames * count
+            );
+        }
+        emulator.restore(saved.get());
+    });
+}
+
+void VecEmulator::set_observation_config(const ObservationConfig& config) {
+    // validate the configuration before dropping the current pipelines
+    ObservationPipeline pipeline(config);
+    stop_double_buffering();
+    // the size of the observations changes
+    observation_buffer = nullptr;
+    back_observation_buffer = nullptr;
+    pipelines.clear();
+    // the old outputs may still be viewed, new storage replaces them
+    retire(frame_stacks);
+    retire(observations);
+    retire(back_observations);
+    retire(stacks);
+    retire(back_stacks);
+    frame_stacks.assign(size() * 2 * pipeline.stack_size(), 0);
+    pipelines.reserve(size());
+    for (std::size_t index = 0; index < size(); index++) {
+        NES_Byte* ring = frame_stacks.data() + index * 2 * pipeline.stack_size();
+        pipelines.emplace_back(config, ring);
+        pipelines.back().reset(*emulators[index]->get_index_buffer());
+    }
+}
+
+void VecEmulator::set_observation_buffer(NES_Byte* buffer, ObservationLayout layout, NES_Byte* back_buffer) {
+    if (back_buffer != nullptr) {
+        const std::size_t bytes = size() * observation_size();
+        if (buffer == nullptr)
+            throw std::invalid_argument("the back observation buffer needs an observation buffer");
+        const std::uintptr_t front = reinterpret_cast<std::uintptr_t>(buffer);
+        const std::uintptr_t back = reinterpret_cast<std::uintptr_t>(back_buffer);
+        if (back < front + bytes && front < back + bytes)
+            throw std::invalid_argument("the observation buffers must not overlap");
+    }
+    wait();
+    observation_buffer = buffer;
+    back_observation_buffer = back_buffer;
+    observation_layout = layout;
+    // fill the buffer with the current observations, or the buffers of the
+    // batch that weren't written while the buffer was set
+    for (std::size_t index = 0; index < size(); index++) {
+        if (buffer != nullptr)
+            write_observation_buffer(index);
+        else if (!has_frame_stacks())
+            write_packed_rgb(&(*emulators[index]->get_index_buffer())[0][0], observations.data() + index * OBSERVATION_SIZE);
+    }
+}
+
+void VecEmulator::write_observation_buffer(std::size_t index) {
+    NES_Byte* output = observation_buffer + index * observation_size();
+    if (!has_frame_stacks()) {
+        const NES_Byte* indexes = &(*emulators[index]->get_index_buffer())[0][0];
+        if (observation_layout == ObservationLayout::NCHW)
+            write_planar_rgb(indexes, output);
+        else
+            write_packed_rgb(indexes, output);
+        return;
+    }
+    const ObservationPipeline& pipeline = pipelines[index];
+    const NES_Byte* stack = pipeline.get_stack();
+    if (observation_layout == ObservationLayout::NCHW) {
+        std::memcpy(output, stack, pipeline.stack_size());
+        return;
+    }
+    // interleave the frames of each pixel
+    const std::size_t frames = pipeline.get_config().frames;
+    const std::size_t pixels = pipeline.frame_size();
+    for (std::size_t frame = 0; frame < frames; frame++) {
+        for (std::size_t pixel = 0; pixel < pixels; pixel++)
+            output[pixel * frames + frame] = stack[frame * pixels + pixel];
+    }
+}
+
+void VecEmulator::set_reward_spec(const RewardSpec& spec) {
+    // validate the specification before dropping the current programs
+    RewardProgram program(spec);
+    stop_double_buffering();
+    programs.assign(size(), program);
+    // the old outputs may still be viewed, new storage replaces them
+    retire(rewards);
+    retire(dones);
+    retire(infos);
+    retire(back_rewards);
+    retire(back_dones);
+    retire(back_infos);
+    rewards.assign(size(), 0);
+    dones.assign(size(), 0);
+    infos.assign(size() * program.num_values(), 0);
+    // the deltas of the next step are relative to the current RAM
+    for (std::size_t index = 0; index < size(); index++)
+        programs[index].reset(emulators[index]->get_memory_buffer(), infos.data() + index * program.num_values());
+}
+
+void VecEmulator::write_outputs(std::size_t index, bool is_reset) {
+    Emulator& emulator = *emulators[index];
+    if (has_frame_stacks()) {
+        // the pipeline replaces the RGB observation
+        if (is_reset)
+            pipelines[index].reset(*emulator.get_index_buffer());
+        else
+            pipelines[index].push(*emulator.get_index_buffer());
+        if (is_double_buffered) {
+            const std::size_t stack_size = pipelines[index].stack_size();
+            std::memcpy(stacks.data() + index * stack_size, pipelines[index].get_stack(), stack_size);
+        }
+    } else if (observation_buffer == nullptr) {
+        // convert the palette indexes to packed RGB
+        write_packed_rgb(&(*emulator.get_index_buffer())[0][0], observations.data() + index * OBSERVATION_SIZE);
+    }
+    if (observation_buffer != nullptr)
+        write_observation_buffer(index);
+    // copy the RAM
+    std::memcpy(memory.data() + index * MEMORY_SIZE, emulator.get_memory_buffer(), MEMORY_SIZE);
+    if (has_rewards()) {
+        int64_t* info = infos.data() + index * programs[index].num_values();
+        if (is_reset) {
+            rewards[index] = 0;
+            dones[index] = 0;
+            programs[index].reset(emulator.get_memory_buffer(), info);
+        } else {
+            programs[index].evaluate(emulator.get_memory_buffer(), &rewards[index], &dones[index], info);
+        }
+    }
+}
+
+}  // namespace NES
@@ -123,34 +123,39 @@ class NESEmulatorWrapper(NESGameCallbacks):
     def dump_state(self) -> np.ndarray:
         return self._emulator.dump_state()
 
-    def load_state(self, snapshot: np.ndarray):
+    def load_state(self, snapshot: np.ndarray, redraw: bool = False):
         self._will_restore()
-        self._emulator.load_state(snapshot)
+        self._emulator.load_state(snapshot, redraw)
         self._did_restore()
 
-    def frame_advance(self, action: Union[int, Tuple[int, int]]) -> None:
+    def dump_state_into(self, buffer) -> None:
+        self._emulator.dump_state_into(buffer)
+
+    def load_state_from(self, buffer, redraw: bool = False):
+        self._will_restore()
+        self._emulator.load_state_from(buffer, redraw)
+        self._did_restore()
+
+    def frame_advance(self, action: Union[int, Tuple[int, int]], frames: int = 1) -> None:
         """
-        Advance a frame in the emulator with an action.
+        Advance frames in the emulator while holding an action.
 
         Args:
             action (byte): the action to press on the joy-pad
+            frames (int): the number of frames to hold the action for
 
         Returns:
             None
 
         """
-        # set the action on the controller
+        # set the action on the controller(s) and step the emulator natively
         if isinstance(action, (int, np.integer)):
-            self._controller_buffers[0][:] = action
+            self._emulator.step_n(int(action), frames)
         elif isinstance(action, tuple) and len(action) == 2:
-            self._controller_buffers[0][:] = action[0]
-            self._controller_buffers[1][:] = action[1]
+            self._emulator.step_n((int(action[0]), int(action[1])), frames)
         else:
             raise ValueError(f'Invalid action type or length: {type(action)}')
 
-        # perform a step on the emulator
-        self._emulator.step()        
-
 
 
 
@@ -379,7 +384,8 @@ class NESEnv(NESEmulatorWrapper, gym.Env[np.ndarray, int]):
         if self._snapshot is None:
             raise ValueError('no snapshot to restore')
         
-        self.load_state(self._snapshot)
+        # the screen is part of the backup, render it over the restored state
+        self.load_state(self._snapshot, redraw=True)
 
 
 # explicitly define the outward facing API of this module
@@ -0,0 +1,302 @@
+"""A batch of NES emulators hosted by worker processes in shared memory."""
+import os
+import uuid
+import multiprocessing
+from typing import List
+from typing import Tuple
+from typing import Optional
+
+import numpy as np
+
+from nes_py.emulator import NESSharedBatch
+from nes_py.emulator import NESVecEmulator
+from nes_py.emulator import NESRewardSpec
+from nes_py.emulator import NESObservationConfig
+from nes_py.emulator import SHARED_MEMORY_ENABLED
+from nes_py.emulator import serve_shared
+
+
+# the number of milliseconds to wait between checks that a worker is alive
+_POLL_MILLISECONDS = 100
+
+
+def _serve(
+    name: str,
+    worker: int,
+    rom_path: str,
+    num_envs: int,
+    num_threads: int,
+    observation: Optional[NESObservationConfig],
+    reward_spec: Optional[NESRewardSpec],
+) -> None:
+    """Host the emulators of a worker and serve its requests until it stops."""
+    vec = NESVecEmulator(rom_path, num_envs, num_threads, observation=observation)
+    if reward_spec is not None:
+        vec.set_reward_spec(reward_spec)
+    serve_shared(vec, name, worker)
+
+
+class SharedVecEmulator:
+    """
+    A batch of NES emulators hosted by worker processes.
+
+    Each worker process steps a contiguous range of the batch in its own
+    NESVecEmulator and writes the observations, RAM, and rewards straight
+    into a POSIX shared memory segment. The actions and completions travel
+    over lock-free queues in the same segment, so a step pickles nothing,
+    and the outputs are numpy views of the segment. The segment has a ring
+    of slots: the outputs of a step stay intact for the next slots - 1
+    steps.
+
+    """
+
+    def __init__(
+        self,
+        rom_path: str,
+        num_envs: int,
+        num_workers: Optional[int] = None,
+        num_threads: int = 1,
+        observation: Optional[NESObservationConfig] = None,
+        reward_spec: Optional[NESRewardSpec] = None,
+        slots: int = 2,
+    ):
+        """
+        Initialize a new batch of emulators hosted by worker processes.
+
+        Args:
+            rom_path: the path to the ROM for the emulators to run
+            num_envs: the number of emulators in the batch
+            num_workers: the number of worker processes, None for one per
+                CPU core (at most one per emulator)
+            num_threads: the number of threads of each worker
+            observation: the configuration of the stacks of frames to
+                observe, None to observe RGB screens
+            reward_spec: the reward spec to evaluate in the workers, None
+                for no rewards
+            slots: the number of slots in the ring of outputs
+
+        Returns:
+            None
+
+        """
+        if not SHARED_MEMORY_ENABLED:
+            raise RuntimeError('shared memory batches require POSIX shared memory')
+        if num_workers is None:
+            num_workers = min(num_envs, os.cpu_count() or 1)
+        if observation is None:
+            self._shape = (NESVecEmulator.height, NESVecEmulator.width, 3)
+        else:
+            self._shape = (observation.frames, observation.height, observation.width)
+        num_info_values = 0 if reward_spec is None else reward_spec.num_values
+        self._has_rewards = reward_spec is not None
+        name = '/nes-py-{}-{}'.format(os.getpid(), uuid.uuid4().hex[:8])
+        self._batch = NESSharedBatch(name, num_envs, int(np.prod(self._shape)), num_info_values, num_workers, slots)
+        # spawn the workers instead of forking the threads of this process
+        context = multiprocessing.get_context('spawn')
+        self._workers: List[multiprocessing.Process] = []
+        self._slot = 0
+        self._pending: Optional[int] = None
+        try:
+            for worker in range(num_workers):
+                begin, end = self._batch.worker_range(worker)
+                process = context.Process(
+                    target=_serve,
+                    args=(name, worker, rom_path, end - begin, num_threads, observation, reward_spec),
+                    daemon=True,
+                )
+                process.start()
+                self._workers.append(process)
+            for worker, process in enumerate(self._workers):
+                while self._batch.status(worker) == NESSharedBatch.Status.STARTING:
+                    self._check_alive(worker)
+                    process.join(_POLL_MILLISECONDS / 1000)
+                if self._batch.status(worker) == NESSharedBatch.Status.FAILED:
+                    raise RuntimeError(self._batch.error(worker))
+        except BaseException:
+            self.close()
+            raise
+        # every worker mapped the segment, its memory lives until they exit
+        self._batch.unlink()
+
+    def __len__(self) -> int:
+        """Return the number of emulators in the batch."""
+        return self._batch.num_envs
+
+    @property
+    def num_envs(self) -> int:
+        """Return the number of emulators in the batch."""
+        return self._batch.num_envs
+
+    @property
+    def num_workers(self) -> int:
+        """Return the number of worker processes."""
+        return len(self._workers)
+
+    @property
+    def is_stepping(self) -> bool:
+        """Return whether a step started by step_async hasn't been waited for."""
+        return self._pending is not None
+
+    def _check_alive(self, worker: int) -> None:
+        """Raise an error if a worker process exited."""
+        process = self._workers[worker]
+        if not process.is_alive():
+            raise RuntimeError('worker {} exited with code {}'.format(worker, process.exitcode))
+
+    def _wait_all(self) -> None:
+        """Wait for the oldest request to every worker."""
+        error = None
+        for worker in range(len(self._workers)):
+            try:
+                while self._batch.wait(worker, _POLL_MILLISECONDS) < 0:
+                    self._check_alive(worker)
+            except RuntimeError as worker_error:
+                # drain the other workers so the queues stay in step
+                error = error or worker_error
+        if error is not None:
+            raise error
+
+    def _request_all(self, command: NESSharedBatch.Command, slot: int) -> None:
+        """Push a request to every worker."""
+        for worker in range(len(self._workers)):
+            self._batch.request(worker, command, slot)
+
+    def _outputs(self, slot: int) -> Tuple[np.ndarray, np.ndarray]:
+        """Return views of the (observations, RAMs) of a slot."""
+        observations = self._batch.observations(slot).reshape((self.num_envs,) + self._shape)
+        return observations, self._batch.memory(slot)
+
+    def reset(self, index: Optional[int] = None) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        Reset every emulator in the batch, or a single emulator.
+
+        Args:
+            index: the index of the emulator to reset, None for every
+                emulator. A single emulator overwrites its outputs in the
+                current slot
+
+        Returns:
+            a tuple of views of the (observations, RAMs)
+
+        """
+        self.wait()
+        if index is None:
+            self._slot = (self._slot + 1) % self._batch.num_slots
+            self._request_all(NESSharedBatch.Command.RESET, self._slot)
+            self._wait_all()
+            return self._outputs(self._slot)
+        if not 0 <= index < self.num_envs:
+            raise IndexError('emulator index out of range')
+        for worker in range(len(self._workers)):
+            begin, end = self._batch.worker_range(worker)
+            if begin <= index < end:
+                self._batch.request(worker, NESSharedBatch.Command.RESET_ONE, self._slot, index)
+                while self._batch.wait(worker, _POLL_MILLISECONDS) < 0:
+                    self._check_alive(worker)
+        return self._outputs(self._slot)
+
+    def step_async(self, actions: np.ndarray) -> None:
+        """
+        Start a step of every emulator in the batch and return immediately.
+
+        Args:
+            actions: the (num_envs,) controller bytes of player 1 or the
+                (num_envs, 2) controller bytes of both players
+
+        Returns:
+            None
+
+        """
+        self.wait()
+        actions = np.asarray(actions, dtype=np.uint8)
+        if actions.shape not in [(self.num_envs,), (self.num_envs, 2)]:
+            raise ValueError('actions must have shape (num_envs,) or (num_envs, 2)')
+        slot = (self._slot + 1) % self._batch.num_slots
+        buffer = self._batch.actions(slot)
+        if actions.ndim == 1:
+            buffer[:, 0] = actions
+            buffer[:, 1] = 0
+        else:
+            buffer[:] = actions
+        self._request_all(NESSharedBatch.Command.STEP, slot)
+        self._pending = slot
+
+    def wait(self) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        Wait for the step started by step_async, if any.
+
+        Returns:
+            a tuple of views of the (observations, RAMs)
+
+        """
+        if self._pending is not None:
+            slot, self._pending = self._pending, None
+            self._wait_all()
+            self._slot = slot
+        return self._outputs(self._slot)
+
+    def step(self, actions: np.ndarray) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        Perform a step on every emulator in the batch, i.e., a single frame.
+
+        Args:
+            actions: the (num_envs,) controller bytes of player 1 or the
+                (num_envs, 2) controller bytes of both players
+
+        Returns:
+            a tuple of views of the (observations, RAMs)
+
+        """
+        self.step_async(actions)
+        return self.wait()
+
+    def _with_rewards(self) -> None:
+        """Raise an error if the batch has no reward spec."""
+        if not self._has_rewards:
+            raise ValueError('the batch has no reward spec')
+
+    def rewards(self) -> np.ndarray:
+        """Return a view of the (num_envs,) rewards of the last step."""
+        self._with_rewards()
+        return self._batch.rewards(self._slot)
+
+    def dones(self) -> np.ndarray:
+        """Return a view of the (num_envs,) terminations of the last step."""
+        self._with_rewards()
+        return self._batch.dones(self._slot)
+
+    def infos(self) -> np.ndarray:
+        """Return a view of the (num_envs, values) info of the last step."""
+        self._with_rewards()
+        return self._batch.infos(self._slot)
+
+    def close(self) -> None:
+        """Stop the worker processes."""
+        for worker, process in enumerate(self._workers):
+            if process.is_alive() and self._batch.status(worker) == NESSharedBatch.Status.READY:
+                self._batch.request(worker, NESSharedBatch.Command.STOP, 0)
+        for process in self._workers:
+            process.join(1)
+            if process.is_alive():
+                process.terminate()
+                process.join()
+        self._workers = []
+        self._pending = None
+        self._batch.unlink()
+
+    def __enter__(self) -> 'SharedVecEmulator':
+        """Return the batch for a with statement."""
+        return self
+
+    def __exit__(self, *args) -> None:
+        """Stop the worker processes at the end of a with statement."""
+        self.close()
+
+    def __del__(self) -> None:
+        """Stop the worker processes when the batch is garbage collected."""
+        if getattr(self, '_workers', None):
+            self.close()
+
+
+# explicitly define the outward facing API of this module
+__all__ = [SharedVecEmulator.__name__]
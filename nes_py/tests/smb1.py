@@ -0,0 +1,45 @@
+"""Methods to create SMB1 emulators and input traces shared by the tests."""
+import numpy as np
+
+from nes_py.emulator import NESEmulator
+from rom_file_abs_path import rom_file_abs_path
+
+
+def create_smb1_emulator(pixel_format=None):
+    """
+    Return a new SMB1 emulator after a reset.
+
+    Args:
+        pixel_format (PixelFormat): the format to write pixels in, None to
+            keep the default
+
+    Returns (NESEmulator):
+        a new SMB1 emulator after a reset
+
+    """
+    emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+    if pixel_format is not None:
+        emulator.pixel_format = pixel_format
+    emulator.reset()
+    return emulator
+
+
+def start_and_hold(frames, period, presses, action):
+    """
+    Return a trace that presses start and otherwise holds an action.
+
+    Args:
+        frames (int): the number of frames in the trace
+        period (int): the number of frames between the presses of start
+        presses (int): the number of frames to press start for each period
+        action (int): the controller byte to hold between the presses
+
+    Returns (np.ndarray):
+        the controller byte of each frame
+
+    """
+    return np.where(np.arange(frames) % period < presses, 8, action).astype(np.uint8)
+
+
+# explicitly define the outward facing API of this module
+__all__ = [create_smb1_emulator.__name__, start_and_hold.__name__]
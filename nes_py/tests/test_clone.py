@@ -0,0 +1,63 @@
+"""Test cases for cloning the NESEmulator class."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESEmulator
+from rom_file_abs_path import rom_file_abs_path
+from smb1 import start_and_hold
+
+
+def step_actions(emulator, actions):
+    """Step actions on an emulator and return the RAM after the last."""
+    for action in actions:
+        emulator.controller(0)[:] = action
+        emulator.step()
+    return emulator.memory_buffer().copy()
+
+
+ACTIONS = start_and_hold(120, 40, 5, 131)
+
+
+class ShouldCloneTheState(TestCase):
+    def test(self):
+        # Zelda keeps its tiles in CHR RAM, which the clone must copy
+        emulator = NESEmulator(rom_file_abs_path('the-legend-of-zelda.nes'))
+        emulator.reset()
+        step_actions(emulator, ACTIONS)
+        clone = emulator.clone()
+        self.assertEqual(emulator.rom.hash, clone.rom.hash)
+        self.assertTrue(np.array_equal(emulator.dump_state(), clone.dump_state()))
+        self.assertTrue(np.array_equal(emulator.screen_buffer(), clone.screen_buffer()))
+        ram = step_actions(emulator, ACTIONS)
+        self.assertTrue(np.array_equal(ram, step_actions(clone, ACTIONS)))
+        self.assertTrue(np.array_equal(emulator.screen_buffer(), clone.screen_buffer()))
+
+
+class ShouldOutliveTheOriginal(TestCase):
+    def test(self):
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        emulator.reset()
+        step_actions(emulator, ACTIONS)
+        clone = emulator.clone()
+        state = emulator.dump_state()
+        del emulator
+        self.assertTrue(np.array_equal(state, clone.dump_state()))
+        step_actions(clone, ACTIONS)
+
+
+class ShouldCopyFromAnotherEmulator(TestCase):
+    def test(self):
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        parent = NESEmulator(path)
+        parent.reset()
+        child = NESEmulator(path)
+        child.reset()
+        step_actions(parent, ACTIONS)
+        child.copy_from(parent)
+        self.assertTrue(np.array_equal(parent.dump_state(), child.dump_state()))
+        # the child steps on its own after the copy
+        step_actions(child, ACTIONS)
+        self.assertFalse(np.array_equal(parent.dump_state(), child.dump_state()))
+        other = NESEmulator(rom_file_abs_path('excitebike.nes'))
+        self.assertRaises(ValueError, child.copy_from, other)
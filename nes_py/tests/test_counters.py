@@ -0,0 +1,47 @@
+"""Test cases for the hot path counters of the NESEmulator class."""
+from unittest import TestCase
+
+from nes_py.emulator import COUNTERS_ENABLED
+from nes_py.emulator import NESEmulator
+from rom_file_abs_path import rom_file_abs_path
+
+
+# the number of CPU cycles in a frame
+CYCLES_PER_FRAME = 29781
+
+
+def step_smb1(frames):
+    """Return a new SMB1 emulator stepped for a number of frames."""
+    emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+    emulator.reset()
+    emulator.reset_counters()
+    for _ in range(frames):
+        emulator.step()
+    return emulator
+
+
+class ShouldCountHotPathsIfEnabled(TestCase):
+    def test(self):
+        counters = step_smb1(120).counters()
+        if not COUNTERS_ENABLED:
+            self.assertEqual(0, counters.frames)
+            self.assertEqual(0, counters.cycles)
+            self.assertEqual(0, sum(counters.reads.values()))
+            return
+        self.assertEqual(120, counters.frames)
+        self.assertEqual(120 * CYCLES_PER_FRAME, counters.cycles)
+        self.assertEqual(3 * counters.cycles, counters.rendering_dots + counters.vblank_dots)
+        self.assertGreater(counters.instructions, 0)
+        self.assertGreater(counters.nmis, 0)
+        self.assertGreater(counters.reads['prg'], counters.reads['ram'])
+        self.assertGreater(counters.writes['ppu'], 0)
+
+
+class ShouldResetCounters(TestCase):
+    def test(self):
+        emulator = step_smb1(10)
+        emulator.reset_counters()
+        counters = emulator.counters()
+        self.assertEqual(0, counters.frames)
+        self.assertEqual(0, counters.instructions)
+        self.assertEqual(0, counters.writes['ram'])
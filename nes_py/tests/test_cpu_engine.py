@@ -0,0 +1,67 @@
+"""Test cases for the CPU engines of the NESEmulator class."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import CPUEngine
+from nes_py.emulator import NESEmulator
+from rom_file_abs_path import rom_file_abs_path
+from smb1 import start_and_hold
+
+
+ACTIONS = start_and_hold(300, 30, 5, 129)
+
+
+def record_hashes(emulator, actions, render=True):
+    """Return the state hashes after stepping the actions."""
+    ring = np.zeros(len(actions), dtype=np.uint64)
+    emulator.set_hash_ring(ring)
+    for action in actions:
+        emulator.controller(0)[:] = action
+        emulator.step(render)
+    emulator.clear_hash_ring()
+    return ring
+
+
+class ShouldDefaultToTheInterpreter(TestCase):
+    def test(self):
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        self.assertEqual(CPUEngine.INTERPRETER, emulator.cpu_engine)
+        emulator.cpu_engine = CPUEngine.BLOCK_CACHE
+        self.assertEqual(CPUEngine.BLOCK_CACHE, emulator.cpu_engine)
+        self.assertEqual(CPUEngine.BLOCK_CACHE, emulator.clone().cpu_engine)
+
+
+class ShouldEmulateIdenticallyWithTheBlockCache(TestCase):
+    def test(self):
+        # Zelda switches PRG banks (MMC1) and runs code from RAM
+        for rom in ['super-mario-bros-1.nes', 'the-legend-of-zelda.nes', 'excitebike.nes']:
+            path = rom_file_abs_path(rom)
+            interpreter = NESEmulator(path)
+            blocks = NESEmulator(path)
+            blocks.cpu_engine = CPUEngine.BLOCK_CACHE
+            interpreter.reset()
+            blocks.reset()
+            hashes_a = record_hashes(interpreter, ACTIONS)
+            hashes_b = record_hashes(blocks, ACTIONS)
+            self.assertTrue(np.array_equal(hashes_a, hashes_b), rom)
+            self.assertTrue(np.array_equal(interpreter.screen_buffer(), blocks.screen_buffer()), rom)
+
+
+class ShouldSwitchEnginesBetweenFrames(TestCase):
+    def test(self):
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        interpreter = NESEmulator(path)
+        switching = NESEmulator(path)
+        interpreter.reset()
+        switching.reset()
+        hashes_a = record_hashes(interpreter, ACTIONS, render=False)
+        hashes_b = []
+        for start in range(0, len(ACTIONS), 100):
+            # alternate the engines every 100 frames
+            if start % 200 == 0:
+                switching.cpu_engine = CPUEngine.BLOCK_CACHE
+            else:
+                switching.cpu_engine = CPUEngine.INTERPRETER
+            hashes_b.append(record_hashes(switching, ACTIONS[start:start + 100], render=False))
+        self.assertTrue(np.array_equal(hashes_a, np.concatenate(hashes_b)))
@@ -0,0 +1,43 @@
+"""Test cases for the headless frames of the NESEmulator class."""
+from unittest import TestCase
+
+import numpy as np
+
+from smb1 import create_smb1_emulator
+
+
+class ShouldKeepScreenWhenNotRendering(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        for _ in range(60):
+            emulator.step()
+        screen = emulator.screen_buffer().copy()
+        for _ in range(60):
+            emulator.step(render=False)
+        self.assertTrue(np.array_equal(screen, emulator.screen_buffer()))
+
+
+class ShouldMatchRenderingWhenSkippingFrames(TestCase):
+    def test(self):
+        rendered = create_smb1_emulator()
+        skipped = create_smb1_emulator()
+        for step in range(600):
+            action = 8 if step % 40 < 5 else 131
+            rendered.controller(0)[:] = action
+            skipped.controller(0)[:] = action
+            rendered.step()
+            skipped.step(render=step % 4 == 3)
+            self.assertTrue(np.array_equal(rendered.memory_buffer(), skipped.memory_buffer()))
+        self.assertTrue(np.array_equal(rendered.screen_buffer(), skipped.screen_buffer()))
+
+
+class ShouldRenderLastFrameOfStepN(TestCase):
+    def test(self):
+        rendered = create_smb1_emulator()
+        skipped = create_smb1_emulator()
+        for _ in range(100):
+            rendered.controller(0)[:] = 128
+            rendered.step()
+        skipped.step_n(128, 100)
+        self.assertTrue(np.array_equal(rendered.memory_buffer(), skipped.memory_buffer()))
+        self.assertTrue(np.array_equal(rendered.screen_buffer(), skipped.screen_buffer()))
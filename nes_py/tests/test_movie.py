@@ -0,0 +1,121 @@
+"""Test cases for the NESMovie class."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESMovie
+from nes_py.nes_env import NESEnv
+from rom_file_abs_path import rom_file_abs_path
+from smb1 import create_smb1_emulator
+from smb1 import start_and_hold
+
+
+def record_movie(movie, emulator, actions):
+    """Record actions on an emulator and return the RAM after each frame."""
+    movie.record(emulator)
+    rams = [emulator.memory_buffer().copy()]
+    for action in actions:
+        emulator.controller(0)[:] = action
+        emulator.step()
+        rams.append(emulator.memory_buffer().copy())
+    movie.stop()
+    return rams
+
+
+ACTIONS = start_and_hold(400, 100, 10, 129)
+
+
+class ShouldRecordRunsAndKeyframes(TestCase):
+    def test(self):
+        movie = NESMovie(keyframe_interval=50)
+        emulator = create_smb1_emulator()
+        record_movie(movie, emulator, ACTIONS)
+        self.assertFalse(movie.is_recording)
+        self.assertEqual(len(ACTIONS), len(movie))
+        self.assertEqual(8, movie.num_runs)
+        self.assertEqual(len(ACTIONS) // 50 + 1, movie.num_keyframes)
+        self.assertEqual((8, 0), movie.input(0))
+        self.assertEqual((129, 0), movie.input(10))
+        inputs = movie.inputs()
+        self.assertEqual((len(ACTIONS), 2), inputs.shape)
+        self.assertTrue(np.array_equal(ACTIONS, inputs[:, 0]))
+        self.assertRaises(ValueError, movie.input, len(ACTIONS))
+
+
+class ShouldSeekToAnyFrame(TestCase):
+    def test(self):
+        movie = NESMovie(keyframe_interval=50)
+        rams = record_movie(movie, create_smb1_emulator(), ACTIONS)
+        emulator = create_smb1_emulator()
+        for frame in [0, 1, 49, 50, 51, 333, 200, len(ACTIONS)]:
+            movie.seek(emulator, frame)
+            self.assertTrue(np.array_equal(rams[frame], emulator.memory_buffer()))
+        self.assertRaises(ValueError, movie.seek, emulator, len(ACTIONS) + 1)
+
+
+class ShouldRewindTheRecording(TestCase):
+    def test(self):
+        movie = NESMovie(keyframe_interval=50)
+        emulator = create_smb1_emulator()
+        record_movie(movie, emulator, ACTIONS)
+        movie.record(emulator)
+        for _ in range(120):
+            emulator.step()
+        movie.seek(emulator, 75)
+        self.assertEqual(75, len(movie))
+        emulator.controller(0)[:] = 1
+        emulator.step()
+        ram = emulator.memory_buffer().copy()
+        movie.stop()
+        self.assertEqual(76, len(movie))
+        self.assertEqual((1, 0), movie.input(75))
+        other = create_smb1_emulator()
+        movie.seek(other, 76)
+        self.assertTrue(np.array_equal(ram, other.memory_buffer()))
+
+
+class ShouldLoadFromInputs(TestCase):
+    def test(self):
+        movie = NESMovie(keyframe_interval=50)
+        emulator = create_smb1_emulator()
+        state = emulator.dump_state()
+        rams = record_movie(movie, emulator, ACTIONS)
+        loaded = NESMovie(keyframe_interval=64)
+        other = create_smb1_emulator()
+        loaded.load(other, state, movie.inputs())
+        self.assertEqual(len(movie), len(loaded))
+        self.assertTrue(np.array_equal(rams[-1], other.memory_buffer()))
+        loaded.seek(other, 123)
+        self.assertTrue(np.array_equal(rams[123], other.memory_buffer()))
+
+
+class ShouldCutTheRecordingOnReset(TestCase):
+    def test(self):
+        env = NESEnv(rom_file_abs_path('super-mario-bros-1.nes'))
+        env.reset()
+        movie = NESMovie(keyframe_interval=50)
+        movie.record(env._emulator)
+        rams = [env.ram.copy()]
+
+        def play(actions):
+            for action in actions:
+                env.step(action)
+                rams.append(env.ram.copy())
+
+        play(ACTIONS[:120])
+        # a reset without a backup resets the emulator
+        env.reset()
+        rams[-1] = env.ram.copy()
+        play(ACTIONS[:80])
+        env._backup()
+        play(ACTIONS[80:180])
+        # a reset with a backup restores (and redraws) it
+        env.reset()
+        rams[-1] = env.ram.copy()
+        play(ACTIONS[180:280])
+        movie.stop()
+        self.assertEqual(400, len(movie))
+        emulator = create_smb1_emulator()
+        for frame in [0, 119, 120, 121, 170, 199, 200, 201, 250, 299, 300, 301, 350, 400]:
+            movie.seek(emulator, frame)
+            self.assertTrue(np.array_equal(rams[frame], emulator.memory_buffer()))
@@ -5,6 +5,7 @@ import numpy as np
 import gymnasium as gym
 
 from nes_py.nes_env import NESEnv
+from nes_py.emulator import RenderMode
 from rom_file_abs_path import rom_file_abs_path
 
 
@@ -134,3 +135,60 @@ class ShouldStepEnvBackupRestore(TestCase):
         env._restore()
         self.assertTrue(np.array_equal(backup, env._screen_buffer))
         env.close()
+
+
+class ShouldStepMultipleFramesNatively(TestCase):
+    def test(self):
+        env_a = create_smb1_instance()
+        env_b = create_smb1_instance()
+        env_a.reset()
+        env_b.reset()
+        for action in [0, 8, 0, 129, 1, 0] * 10:
+            env_a.frame_advance(action, frames=4)
+            for _ in range(4):
+                env_b.frame_advance(action)
+        self.assertTrue(np.array_equal(env_a.ram, env_b.ram))
+        self.assertTrue(np.array_equal(env_a.screen, env_b.screen))
+        env_a.frame_advance((0, 0), frames=2)
+        self.assertRaises(ValueError, env_a._emulator.step_n, 0, 0)
+        env_a.close()
+        env_b.close()
+
+
+class ShouldRenderIdenticallyInDotAndScanlineModes(TestCase):
+    def test(self):
+        env_dot = create_smb1_instance()
+        env_dot._emulator.render_mode = RenderMode.DOT
+        env_line = create_smb1_instance()
+        self.assertEqual(RenderMode.SCANLINE, env_line._emulator.render_mode)
+        env_dot.reset()
+        env_line.reset()
+        for action in [0, 8, 0, 129, 1, 0, 130, 131] * 30:
+            env_dot.step(action)
+            env_line.step(action)
+            self.assertTrue(np.array_equal(env_dot.screen, env_line.screen))
+        self.assertTrue(np.array_equal(env_dot.ram, env_line.ram))
+        env_dot.close()
+        env_line.close()
+
+
+class ShouldRestoreStateOnAnotherEmulator(TestCase):
+    def test(self):
+        path = rom_file_abs_path('the-legend-of-zelda.nes')
+        env_a = NESEnv(path)
+        env_b = NESEnv(path)
+        env_a.reset()
+        env_b.reset()
+        for action in [0, 8, 0, 16, 0, 8] * 40:
+            env_a.frame_advance(action)
+        state = env_a.dump_state()
+        self.assertEqual(np.uint8, state.dtype)
+        env_b.load_state(state)
+        for action in [0, 128, 64, 0, 32, 16] * 20:
+            env_a.frame_advance(action)
+            env_b.frame_advance(action)
+        self.assertTrue(np.array_equal(env_a.ram, env_b.ram))
+        self.assertTrue(np.array_equal(env_a.screen, env_b.screen))
+        self.assertRaises(ValueError, env_b.load_state, state[:-1])
+        env_a.close()
+        env_b.close()
@@ -0,0 +1,74 @@
+"""Test cases for the native observation pipeline."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESObservationConfig
+from nes_py.emulator import NESObservationPipeline
+from nes_py.emulator import NESVecEmulator
+from rom_file_abs_path import rom_file_abs_path
+from smb1 import create_smb1_emulator
+
+
+def area_average(screen, crop, height, width):
+    """Return the grayscale, cropped, and area-averaged frame of a screen."""
+    top, left, crop_height, crop_width = crop
+    rgb = screen[top:top + crop_height, left:left + crop_width].astype(np.int64)
+    gray = (77 * rgb[..., 0] + 150 * rgb[..., 1] + 29 * rgb[..., 2] + 128) >> 8
+    # upsample by the output size, then average boxes of the crop size (one
+    # axis at a time, which is equivalent and keeps the arrays small)
+    gray = np.repeat(gray, height, axis=0).reshape(height, crop_height, -1).mean(axis=1)
+    gray = np.repeat(gray, width, axis=1).reshape(height, width, crop_width).mean(axis=2)
+    return np.rint(gray).astype(np.uint8)
+
+
+class ShouldResizeLikeAreaAveraging(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        for _ in range(120):
+            emulator.step()
+        config = NESObservationConfig(crop=(32, 0, 192, 256), height=84, width=84, frames=1)
+        pipeline = NESObservationPipeline(config)
+        stack = pipeline.reset(emulator)
+        self.assertEqual((1, 84, 84), stack.shape)
+        expected = area_average(emulator.screen_buffer(), (32, 0, 192, 256), 84, 84)
+        self.assertLessEqual(np.abs(stack[0].astype(int) - expected).max(), 1)
+
+
+class ShouldStackFramesFromOldestToNewest(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        pipeline = NESObservationPipeline(NESObservationConfig(frames=3))
+        newest = NESObservationPipeline(NESObservationConfig(frames=1))
+        frames = [pipeline.reset(emulator)[-1].copy()]
+        for step in range(40):
+            emulator.controller(0)[:] = 8 if step % 2 else 0
+            emulator.step()
+            stack = pipeline.push(emulator)
+            frames.append(newest.reset(emulator)[0].copy())
+        self.assertTrue(np.array_equal(np.stack(frames[-3:]), stack))
+
+
+class ShouldReturnFrameStacksFromBatch(TestCase):
+    def test(self):
+        config = NESObservationConfig(height=42, width=48, frames=2)
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        vec = NESVecEmulator(path, 2, 1, observation=config)
+        vec.reset()
+        emulator = create_smb1_emulator()
+        pipeline = NESObservationPipeline(config)
+        pipeline.reset(emulator)
+        for _ in range(30):
+            stacks, _ = vec.step(np.zeros(2, dtype=np.uint8))
+            emulator.step()
+            stack = pipeline.push(emulator)
+        self.assertEqual((2, 2, 42, 48), stacks.shape)
+        self.assertTrue(np.array_equal(stack, stacks[1]))
+        self.assertRaises(ValueError, vec.screen_buffer)
+
+
+class ShouldRaiseValueErrorOnInvalidConfig(TestCase):
+    def test(self):
+        crop = (200, 0, 100, 256)
+        self.assertRaises(ValueError, NESObservationPipeline, NESObservationConfig(crop=crop))
+        self.assertRaises(ValueError, NESObservationPipeline, NESObservationConfig(frames=0))
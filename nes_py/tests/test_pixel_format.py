@@ -0,0 +1,45 @@
+"""Test cases for the indexed pixel format of the NESEmulator class."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESEmulator
+from nes_py.emulator import PixelFormat
+from rom_file_abs_path import rom_file_abs_path
+from smb1 import create_smb1_emulator
+
+
+class ShouldDefaultToRGB(TestCase):
+    def test(self):
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        self.assertEqual(PixelFormat.RGB, emulator.pixel_format)
+
+
+class ShouldConvertIndexesToSameScreen(TestCase):
+    def test(self):
+        rgb = create_smb1_emulator(PixelFormat.RGB)
+        indexed = create_smb1_emulator(PixelFormat.INDEXED)
+        for step in range(300):
+            action = 8 if step % 40 < 5 else 128
+            rgb.controller(0)[:] = action
+            indexed.controller(0)[:] = action
+            rgb.step()
+            indexed.step()
+        indexes = indexed.index_buffer()
+        self.assertEqual((NESEmulator.height, NESEmulator.width), indexes.shape)
+        self.assertLess(indexes.max(), 64)
+        self.assertTrue(np.array_equal(rgb.screen_buffer(), indexed.screen_buffer()))
+
+
+class ShouldKeepLastFrameWhenSwitchingToRGB(TestCase):
+    def test(self):
+        rgb = create_smb1_emulator(PixelFormat.RGB)
+        indexed = create_smb1_emulator(PixelFormat.INDEXED)
+        for _ in range(120):
+            rgb.step()
+            indexed.step()
+        indexed.pixel_format = PixelFormat.RGB
+        self.assertTrue(np.array_equal(rgb.screen_buffer(), indexed.screen_buffer()))
+        rgb.step()
+        indexed.step()
+        self.assertTrue(np.array_equal(rgb.screen_buffer(), indexed.screen_buffer()))
@@ -0,0 +1,128 @@
+"""Test cases for the native reward specs over RAM."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import Comparison
+from nes_py.emulator import NESEmulator
+from nes_py.emulator import NESRewardProgram
+from nes_py.emulator import NESRewardSpec
+from nes_py.emulator import NESVecEmulator
+from nes_py.emulator import RAMEncoding
+from rom_file_abs_path import rom_file_abs_path
+from smb1 import start_and_hold
+
+
+def create_smb1_spec():
+    """Return a spec of the SMB1 reward: progress, time, and death."""
+    spec = NESRewardSpec()
+    x = spec.value([0x86, 0x6d])
+    time = spec.value([0x7fa, 0x7f9, 0x7f8], RAMEncoding.DIGITS)
+    dying = spec.condition(spec.value([0x0e]), Comparison.EQUAL, 0x0b)
+    spec.reward(x, delta=True, low=-5, high=5)
+    spec.reward(time, delta=True, high=0)
+    spec.reward_if(dying, -25)
+    spec.done_if(dying)
+    spec.low = -15
+    spec.high = 15
+    return spec
+
+
+def smb1_values(ram):
+    """Return the x position, time, and player state of SMB1 RAMs."""
+    ram = ram.astype(np.int64)
+    x = ram[..., 0x6d] * 0x100 + ram[..., 0x86]
+    time = ram[..., 0x7f8] * 100 + ram[..., 0x7f9] * 10 + ram[..., 0x7fa]
+    return np.stack([x, time, ram[..., 0x0e]], axis=-1)
+
+
+def smb1_rewards(values, previous):
+    """Return the SMB1 rewards and terminations of values after previous."""
+    delta = values - previous
+    dying = values[..., 2] == 0x0b
+    reward = np.clip(delta[..., 0], -5, 5) + np.minimum(delta[..., 1], 0) - 25 * dying
+    return np.clip(reward, -15, 15), dying
+
+
+ACTIONS = start_and_hold(300, 100, 10, 131)
+
+
+class ShouldEvaluateInTheBatch(TestCase):
+    def test(self):
+        vec = NESVecEmulator(rom_file_abs_path('super-mario-bros-1.nes'), 4, 2)
+        self.assertRaises(ValueError, vec.rewards)
+        vec.set_reward_spec(create_smb1_spec())
+        vec.reset()
+        previous = smb1_values(vec.memory_buffer())
+        self.assertTrue(np.array_equal(previous, vec.infos()))
+        self.assertTrue(np.array_equal(np.zeros(4), vec.rewards()))
+        for action in ACTIONS:
+            _, ram = vec.step(np.full(4, action, dtype=np.uint8))
+            values = smb1_values(ram)
+            rewards, dones = smb1_rewards(values, previous)
+            self.assertTrue(np.array_equal(values, vec.infos()))
+            self.assertTrue(np.allclose(rewards, vec.rewards()))
+            self.assertTrue(np.array_equal(dones, vec.dones()))
+            previous = values
+
+
+class ShouldKeepViewsAfterReconfiguring(TestCase):
+    def test(self):
+        vec = NESVecEmulator(rom_file_abs_path('super-mario-bros-1.nes'), 4, 2)
+        vec.set_reward_spec(create_smb1_spec())
+        vec.reset()
+        vec.step_async(np.full(4, 129, dtype=np.uint8))
+        screens, ram = vec.wait()
+        infos = vec.infos()
+        held = (screens.copy(), ram.copy(), infos.copy())
+        # the views keep the batch and the replaced outputs alive
+        vec.set_reward_spec(create_smb1_spec())
+        del vec
+        self.assertTrue(np.array_equal(held[0], screens))
+        self.assertTrue(np.array_equal(held[1], ram))
+        self.assertTrue(np.array_equal(held[2], infos))
+
+
+class ShouldEvaluateOnAnEmulator(TestCase):
+    def test(self):
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        emulator.reset()
+        program = NESRewardProgram(create_smb1_spec())
+        self.assertEqual(3, program.num_values)
+        previous = program.reset(emulator)
+        for action in ACTIONS:
+            emulator.controller(0)[:] = action
+            emulator.step()
+            reward, done, values = program.evaluate(emulator)
+            expected, dying = smb1_rewards(values, previous)
+            self.assertTrue(np.array_equal(smb1_values(emulator.memory_buffer()), values))
+            self.assertAlmostEqual(expected, reward)
+            self.assertEqual(dying, done)
+            previous = values
+
+
+class ShouldDecodeBCD(TestCase):
+    def test(self):
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        emulator.reset()
+        emulator.memory_buffer()[0x10:0x12] = [0x34, 0x12]
+        spec = NESRewardSpec()
+        spec.value([0x10, 0x11], RAMEncoding.BCD)
+        spec.value([0x10, 0x11])
+        self.assertEqual([1234, 0x1234], list(NESRewardProgram(spec).reset(emulator)))
+
+
+class ShouldRejectInvalidSpecs(TestCase):
+    def test(self):
+        spec = NESRewardSpec()
+        spec.value([0x800])
+        self.assertRaises(ValueError, NESRewardProgram, spec)
+        spec = NESRewardSpec()
+        spec.value([])
+        self.assertRaises(ValueError, NESRewardProgram, spec)
+        spec = NESRewardSpec()
+        spec.condition(0, Comparison.LESS, 0)
+        self.assertRaises(ValueError, NESRewardProgram, spec)
+        spec = NESRewardSpec()
+        spec.reward(spec.value([0x10]), low=1, high=0)
+        self.assertRaises(ValueError, NESRewardProgram, spec)
@@ -0,0 +1,70 @@
+"""Test cases for the rollouts of the NESEmulator and NESVecEmulator classes."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESVecEmulator
+from rom_file_abs_path import rom_file_abs_path
+from smb1 import create_smb1_emulator
+
+
+ADDRESSES = np.array([0x006d, 0x0086, 0x075a], dtype=np.uint16)
+
+
+def step_trace(emulator, state, actions):
+    """Return the RAM trace of stepping actions one at a time from a state."""
+    emulator.load_state(state)
+    trace = []
+    for action in actions:
+        emulator.controller(0)[:] = action
+        emulator.step()
+        trace.append(emulator.memory_buffer()[ADDRESSES])
+    return np.array(trace)
+
+
+class ShouldMatchSteppingFromState(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        for _ in range(100):
+            emulator.step()
+        state = emulator.dump_state()
+        actions = np.where(np.arange(64) % 16 < 4, 131, 130).astype(np.uint8)
+        trace = emulator.rollout(state, actions, ADDRESSES)
+        self.assertEqual((64, 3), trace.shape)
+        expected = step_trace(create_smb1_emulator(), state, actions)
+        self.assertTrue(np.array_equal(expected, trace))
+
+
+class ShouldRejectAddressesOutsideRAM(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        state = emulator.dump_state()
+        actions = np.zeros(4, dtype=np.uint8)
+        with self.assertRaises(ValueError):
+            emulator.rollout(state, actions, np.array([0x800], dtype=np.uint16))
+
+
+class ShouldRolloutBatchInParallel(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        states = []
+        for _ in range(6):
+            for _ in range(30):
+                emulator.controller(0)[:] = 128
+                emulator.step()
+            states.append(emulator.dump_state())
+        states = np.stack(states)
+        actions = np.random.RandomState(0).choice([0, 128, 129, 130, 131], (6, 32)).astype(np.uint8)
+        vec = NESVecEmulator(rom_file_abs_path('super-mario-bros-1.nes'), num_envs=4, num_threads=2)
+        vec.reset()
+        traces = vec.rollout(states, actions, ADDRESSES)
+        self.assertEqual((6, 32, 3), traces.shape)
+        for index in range(6):
+            expected = emulator.rollout(states[index], actions[index], ADDRESSES)
+            self.assertTrue(np.array_equal(expected, traces[index]))
+        # the emulators of the batch continue from their own states
+        other = NESVecEmulator(rom_file_abs_path('super-mario-bros-1.nes'), num_envs=4, num_threads=2)
+        other.reset()
+        _, ram = vec.step(np.zeros(4, dtype=np.uint8))
+        _, other_ram = other.step(np.zeros(4, dtype=np.uint8))
+        self.assertTrue(np.array_equal(other_ram, ram))
@@ -0,0 +1,46 @@
+"""Test cases for the NESROMImage class."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESEmulator
+from nes_py.emulator import NESROMImage
+from nes_py.emulator import NESVecEmulator
+from rom_file_abs_path import rom_file_abs_path
+
+
+class ShouldShareImageOfSameFile(TestCase):
+    def test(self):
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        emulator_a = NESEmulator(path)
+        emulator_b = NESEmulator(path)
+        self.assertIs(emulator_a.rom, emulator_b.rom)
+        self.assertEqual(40976, len(emulator_a.rom))
+
+
+class ShouldRunImageFromBytes(TestCase):
+    def test(self):
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        with open(path, 'rb') as rom_file:
+            rom = NESROMImage(rom_file.read())
+        self.assertEqual(NESROMImage.open(path).hash, rom.hash)
+        emulator_a = NESEmulator(path)
+        emulator_b = NESEmulator(rom)
+        vec = NESVecEmulator(rom, 2, 1)
+        emulator_a.reset()
+        emulator_b.reset()
+        vec.reset()
+        for _ in range(100):
+            emulator_a.step()
+            emulator_b.step()
+            _, ram = vec.step(np.zeros(2, dtype=np.uint8))
+        self.assertTrue(np.array_equal(emulator_a.memory_buffer(), emulator_b.memory_buffer()))
+        self.assertTrue(np.array_equal(emulator_a.memory_buffer(), ram[1]))
+
+
+class ShouldRaiseValueErrorOnTruncatedROM(TestCase):
+    def test(self):
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        with open(path, 'rb') as rom_file:
+            rom = NESROMImage(rom_file.read()[:1000])
+        self.assertRaises(ValueError, NESEmulator, rom)
@@ -0,0 +1,95 @@
+"""Test cases for the SharedVecEmulator class."""
+import pickle
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import Comparison
+from nes_py.emulator import NESObservationConfig
+from nes_py.emulator import NESRewardSpec
+from nes_py.emulator import NESVecEmulator
+from nes_py.shared_vec_emulator import SharedVecEmulator
+from rom_file_abs_path import rom_file_abs_path
+from smb1 import start_and_hold
+
+
+def create_spec():
+    """Return a spec of the SMB1 progress and death."""
+    spec = NESRewardSpec()
+    x = spec.value([0x86, 0x6d])
+    dying = spec.condition(spec.value([0x0e]), Comparison.EQUAL, 0x0b)
+    spec.reward(x, delta=True, low=-5, high=5)
+    spec.done_if(dying)
+    return spec
+
+
+ACTIONS = start_and_hold(120, 40, 5, 131)
+
+
+class ShouldPickleSpecsAndConfigs(TestCase):
+    def test(self):
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        config = pickle.loads(pickle.dumps(NESObservationConfig((8, 0, 224, 256), 42, 42, 3)))
+        self.assertEqual((8, 224, 42, 3), (config.crop_top, config.crop_height, config.width, config.frames))
+        vecs = [NESVecEmulator(path, 1, 1) for _ in range(2)]
+        vecs[0].set_reward_spec(create_spec())
+        vecs[1].set_reward_spec(pickle.loads(pickle.dumps(create_spec())))
+        for vec in vecs:
+            vec.reset()
+            for action in ACTIONS:
+                vec.step(np.full(1, action, dtype=np.uint8))
+        self.assertTrue(np.array_equal(vecs[0].infos(), vecs[1].infos()))
+        self.assertTrue(np.array_equal(vecs[0].rewards(), vecs[1].rewards()))
+
+
+class ShouldMatchInProcessBatch(TestCase):
+    def test(self):
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        vec = NESVecEmulator(path, 5, 1)
+        vec.set_reward_spec(create_spec())
+        with SharedVecEmulator(path, 5, num_workers=2, reward_spec=create_spec()) as shared:
+            self.assertEqual(5, len(shared))
+            self.assertEqual(2, shared.num_workers)
+            vec.reset()
+            screens, ram = shared.reset()
+            self.assertTrue(np.array_equal(vec.screen_buffer(), screens))
+            for step, action in enumerate(ACTIONS):
+                actions = np.full(5, action, dtype=np.uint8)
+                expected = vec.step(actions)
+                screens, ram = shared.step(actions)
+                if step == 60:
+                    vec.reset(3)
+                    screens, ram = shared.reset(3)
+                self.assertTrue(np.array_equal(vec.screen_buffer(), screens))
+                self.assertTrue(np.array_equal(expected[1], ram))
+                self.assertTrue(np.array_equal(vec.rewards(), shared.rewards()))
+                self.assertTrue(np.array_equal(vec.dones(), shared.dones()))
+                self.assertTrue(np.array_equal(vec.infos(), shared.infos()))
+
+
+class ShouldKeepTheLastOutputsDuringAStep(TestCase):
+    def test(self):
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        config = NESObservationConfig(frames=2)
+        vec = NESVecEmulator(path, 2, 1, observation=config)
+        with SharedVecEmulator(path, 2, num_workers=1, observation=config) as shared:
+            vec.reset()
+            shared.reset()
+            held = None
+            for action in ACTIONS:
+                actions = np.full(2, action, dtype=np.uint8)
+                shared.step_async(actions)
+                self.assertTrue(shared.is_stepping)
+                if held is not None:
+                    self.assertTrue(np.array_equal(held, views[0]))
+                views = shared.wait()
+                vec.step(actions)
+                self.assertTrue(np.array_equal(vec.frame_stacks(), views[0]))
+                held = views[0].copy()
+            self.assertRaises(ValueError, shared.rewards)
+            self.assertRaises(ValueError, shared.step, np.zeros(3, dtype=np.uint8))
+
+
+class ShouldFailToStartOnABadROM(TestCase):
+    def test(self):
+        self.assertRaises(RuntimeError, SharedVecEmulator, 'not-a-rom.nes', 1, num_workers=1)
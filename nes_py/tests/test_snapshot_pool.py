@@ -0,0 +1,71 @@
+"""Test cases for the NESSnapshotPool class."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESSnapshotPool
+from smb1 import create_smb1_emulator
+
+
+def advance(emulator, actions):
+    """Step the emulator once for each action."""
+    for action in actions:
+        emulator.controller(0)[:] = action
+        emulator.step()
+
+
+class ShouldRestoreDeltaSnapshots(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        pool = NESSnapshotPool(keyframe_interval=4)
+        advance(emulator, [0] * 60)
+        handles = [pool.save(emulator)]
+        rams = [emulator.memory_buffer().copy()]
+        for step in range(10):
+            advance(emulator, [8, 0, 129, 1][step % 4:] * 3)
+            handles.append(pool.save(emulator, parent=handles[-1]))
+            rams.append(emulator.memory_buffer().copy())
+        self.assertEqual(len(handles), len(pool))
+        for handle, ram in reversed(list(zip(handles, rams))):
+            pool.restore(handle, emulator)
+            self.assertTrue(np.array_equal(ram, emulator.memory_buffer()))
+
+
+class ShouldStoreLessThanFullStates(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        pool = NESSnapshotPool()
+        root = pool.save(emulator)
+        keyframe = pool.nbytes
+        parent = root
+        for _ in range(20):
+            advance(emulator, [1])
+            parent = pool.save(emulator, parent=parent)
+        self.assertLess(pool.nbytes, 21 * keyframe)
+
+
+class ShouldKeepParentsOfLiveSnapshots(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        pool = NESSnapshotPool()
+        advance(emulator, [0] * 30)
+        root = pool.save(emulator)
+        advance(emulator, [8] * 30)
+        child = pool.save(emulator, parent=root)
+        ram = emulator.memory_buffer().copy()
+        pool.release(root)
+        self.assertEqual(1, len(pool))
+        advance(emulator, [0] * 10)
+        pool.restore(child, emulator)
+        self.assertTrue(np.array_equal(ram, emulator.memory_buffer()))
+
+
+class ShouldRaiseValueErrorOnReleasedHandle(TestCase):
+    def test(self):
+        emulator = create_smb1_emulator()
+        pool = NESSnapshotPool()
+        handle = pool.save(emulator)
+        pool.release(handle)
+        self.assertRaises(ValueError, pool.restore, handle, emulator)
+        self.assertRaises(ValueError, pool.release, handle)
+        self.assertRaises(ValueError, pool.save, emulator, 1234)
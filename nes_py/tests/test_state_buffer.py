@@ -0,0 +1,133 @@
+"""Test cases for exchanging states through caller-provided buffers."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESEmulator
+from nes_py.emulator import STATE_SIZE
+from rom_file_abs_path import rom_file_abs_path
+
+
+def create_zelda_emulator():
+    """Return a new Zelda emulator after a reset."""
+    emulator = NESEmulator(rom_file_abs_path('the-legend-of-zelda.nes'))
+    emulator.reset()
+    return emulator
+
+
+class ShouldDumpStateIntoBuffers(TestCase):
+    def test(self):
+        emulator = create_zelda_emulator()
+        for _ in range(120):
+            emulator.step()
+        state = emulator.dump_state()
+        self.assertEqual(STATE_SIZE, len(state))
+        array = np.zeros(STATE_SIZE, dtype=np.uint8)
+        emulator.dump_state_into(array)
+        self.assertTrue(np.array_equal(state, array))
+        # a bytearray and an unaligned view of an array also hold states
+        buffer = bytearray(STATE_SIZE)
+        emulator.dump_state_into(buffer)
+        self.assertEqual(state.tobytes(), bytes(buffer))
+        unaligned = np.zeros(STATE_SIZE + 1, dtype=np.uint8)[1:]
+        emulator.dump_state_into(unaligned)
+        self.assertTrue(np.array_equal(state, unaligned))
+
+
+class ShouldLoadStateFromBuffers(TestCase):
+    def test(self):
+        emulator = create_zelda_emulator()
+        for _ in range(120):
+            emulator.step()
+        buffer = bytearray(STATE_SIZE)
+        emulator.dump_state_into(buffer)
+        ram = emulator.memory_buffer().copy()
+        for _ in range(60):
+            emulator.controller(0)[:] = 16
+            emulator.step()
+        self.assertFalse(np.array_equal(ram, emulator.memory_buffer()))
+        emulator.load_state_from(bytes(buffer))
+        self.assertTrue(np.array_equal(ram, emulator.memory_buffer()))
+        unaligned = np.zeros(STATE_SIZE + 1, dtype=np.uint8)[1:]
+        unaligned[:] = np.frombuffer(buffer, dtype=np.uint8)
+        emulator.step()
+        emulator.load_state_from(unaligned)
+        self.assertTrue(np.array_equal(ram, emulator.memory_buffer()))
+
+
+class ShouldRedrawOnlyOnRequest(TestCase):
+    def test(self):
+        # the redraw runs the PPU without the CPU, so it only reproduces
+        # screens that don't change the scroll mid-frame, like the title
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        emulator.reset()
+        for _ in range(120):
+            emulator.step()
+        state = emulator.dump_state()
+        screen = emulator.screen_buffer().copy()
+        for _ in range(60):
+            emulator.controller(0)[:] = 16
+            emulator.step()
+        moved = emulator.screen_buffer().copy()
+        # without a redraw the screen keeps the last frame
+        emulator.load_state(state)
+        self.assertTrue(np.array_equal(moved, emulator.screen_buffer()))
+        emulator.load_state_from(state, redraw=True)
+        self.assertTrue(np.array_equal(screen, emulator.screen_buffer()))
+
+
+class ShouldRejectInvalidBuffers(TestCase):
+    def test(self):
+        emulator = create_zelda_emulator()
+        self.assertRaises(ValueError, emulator.dump_state_into, bytearray(STATE_SIZE - 1))
+        self.assertRaises(ValueError, emulator.load_state_from, bytes(STATE_SIZE + 1))
+        strided = np.zeros(2 * STATE_SIZE, dtype=np.uint8)[::2]
+        self.assertRaises(ValueError, emulator.dump_state_into, strided)
+        self.assertRaises(BufferError, emulator.dump_state_into, bytes(STATE_SIZE))
+
+
+def corrupt(state, offset, value):
+    """Return a copy of a state with a little-endian uint32 at an offset."""
+    corrupted = state.copy()
+    corrupted[offset:offset + 4] = np.array([value], dtype='<u4').view(np.uint8)
+    return corrupted
+
+
+# the byte offsets of fields in the State struct (see state.hpp)
+PPU_SCANLINE = 324
+PPU_RENDER_X = 328
+MAPPER_REGISTERS = 12652
+
+
+class ShouldRejectCorruptedStates(TestCase):
+    def test(self):
+        emulator = create_zelda_emulator()
+        for _ in range(120):
+            emulator.step()
+        state = emulator.dump_state()
+        corrupted = [
+            # a scanline past the screen and the sprite table
+            corrupt(state, PPU_SCANLINE, 100000),
+            # a pixel past the end of the scanline
+            corrupt(state, PPU_RENDER_X, 100000),
+            # an SxROM PRG bank past the end of the PRG ROM
+            corrupt(state, MAPPER_REGISTERS + 9 * 4, 0x100000),
+        ]
+        for blob in corrupted:
+            self.assertRaises(ValueError, emulator.load_state, blob)
+            self.assertRaises(ValueError, emulator.load_state_from, blob.tobytes())
+        # the emulator keeps its state
+        self.assertTrue(np.array_equal(state, emulator.dump_state()))
+        emulator.step()
+
+
+class ShouldRejectStatesOfAnotherROM(TestCase):
+    def test(self):
+        # both ROMs use mapper 0
+        smb1 = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        excitebike = NESEmulator(rom_file_abs_path('excitebike.nes'))
+        smb1.reset()
+        excitebike.reset()
+        state = excitebike.dump_state()
+        self.assertRaises(ValueError, smb1.load_state, state)
+        self.assertRaises(ValueError, smb1.load_state_from, state)
@@ -0,0 +1,73 @@
+"""Test cases for the per-frame state hashes of the NESEmulator class."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESEmulator
+from nes_py.emulator import hash_state
+from rom_file_abs_path import rom_file_abs_path
+from smb1 import start_and_hold
+
+
+ACTIONS = start_and_hold(90, 30, 5, 128)
+
+
+def record_hashes(emulator, actions, render=True):
+    """Return the ring of state hashes after stepping the actions."""
+    ring = np.zeros(len(actions), dtype=np.uint64)
+    emulator.set_hash_ring(ring)
+    for action in actions:
+        emulator.controller(0)[:] = action
+        emulator.step(render)
+    emulator.clear_hash_ring()
+    return ring
+
+
+class ShouldHashEveryFrame(TestCase):
+    def test(self):
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        emulator.reset()
+        ring = np.zeros(8, dtype=np.uint64)
+        emulator.set_hash_ring(ring)
+        for frame in range(20):
+            emulator.step()
+            self.assertEqual(frame + 1, emulator.hash_count)
+            self.assertEqual(ring[frame % 8], emulator.state_hash())
+            self.assertEqual(ring[frame % 8], hash_state(emulator.dump_state()))
+        emulator.clear_hash_ring()
+        emulator.step()
+        self.assertEqual(0, emulator.hash_count)
+
+
+class ShouldReplayBitExactly(TestCase):
+    def test(self):
+        path = rom_file_abs_path('the-legend-of-zelda.nes')
+        emulator_a = NESEmulator(path)
+        emulator_b = NESEmulator(path)
+        emulator_a.reset()
+        emulator_b.reset()
+        hashes_a = record_hashes(emulator_a, ACTIONS)
+        # the pixels don't change the state, a headless replay matches
+        hashes_b = record_hashes(emulator_b, ACTIONS, render=False)
+        self.assertTrue(np.array_equal(hashes_a, hashes_b))
+        self.assertEqual(len(ACTIONS), len(np.unique(hashes_a)))
+
+
+class ShouldHashRolloutFrames(TestCase):
+    def test(self):
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        emulator.reset()
+        state = emulator.dump_state()
+        stepped = record_hashes(emulator, ACTIONS)
+        ring = np.zeros(len(ACTIONS), dtype=np.uint64)
+        emulator.set_hash_ring(ring)
+        emulator.rollout(state, ACTIONS, np.zeros(1, dtype=np.uint16))
+        self.assertTrue(np.array_equal(stepped, ring))
+
+
+class ShouldRejectInvalidRings(TestCase):
+    def test(self):
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        self.assertRaises(ValueError, emulator.set_hash_ring, np.zeros(0, dtype=np.uint64))
+        self.assertRaises(ValueError, emulator.set_hash_ring, np.zeros(8, dtype=np.uint64)[::2])
+        self.assertRaises(TypeError, emulator.set_hash_ring, np.zeros(8, dtype=np.int32))
@@ -0,0 +1,163 @@
+"""Test cases for the NESVecEmulator class."""
+from unittest import TestCase
+
+import numpy as np
+
+from nes_py.emulator import NESEmulator
+from nes_py.emulator import NESObservationConfig
+from nes_py.emulator import NESVecEmulator
+from nes_py.emulator import ObservationLayout
+from rom_file_abs_path import rom_file_abs_path
+
+
+def create_smb1_batch(num_envs=4, num_threads=2):
+    """Return a new batch of SMB1 emulators."""
+    path = rom_file_abs_path('super-mario-bros-1.nes')
+    return NESVecEmulator(path, num_envs, num_threads)
+
+
+class ShouldCreateBatchOfEmulators(TestCase):
+    def test(self):
+        vec = create_smb1_batch()
+        self.assertEqual(4, vec.num_envs)
+        self.assertEqual(4, len(vec))
+        self.assertEqual(2, vec.num_threads)
+
+
+class ShouldReturnBatchedObservations(TestCase):
+    def test(self):
+        vec = create_smb1_batch()
+        vec.reset()
+        screens, ram = vec.step(np.zeros(4, dtype=np.uint8))
+        self.assertEqual((4, NESVecEmulator.height, NESVecEmulator.width, 3), screens.shape)
+        self.assertEqual((4, 0x800), ram.shape)
+        self.assertTrue(screens.flags['C_CONTIGUOUS'])
+        self.assertTrue(ram.flags['C_CONTIGUOUS'])
+
+
+class ShouldAcceptTwoPlayerActions(TestCase):
+    def test(self):
+        vec = create_smb1_batch()
+        vec.reset()
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        emulator.reset()
+        # only the player 2 bytes differ between the emulators of the batch
+        actions = np.zeros((4, 2), dtype=np.uint8)
+        actions[:, 1] = [0, 1, 2, 64]
+        for _ in range(10):
+            screens, ram = vec.step(actions)
+            emulator.controller(0)[:] = actions[3, 0]
+            emulator.controller(1)[:] = actions[3, 1]
+            emulator.step()
+        # the game reads player 2, so the bytes reach the second controller
+        self.assertFalse(np.array_equal(ram[0], ram[3]))
+        self.assertTrue(np.array_equal(ram[3], emulator.memory_buffer()))
+        self.assertTrue(np.array_equal(screens[3], emulator.screen_buffer()))
+
+
+class ShouldRaiseValueErrorOnInvalidActionShape(TestCase):
+    def test(self):
+        vec = create_smb1_batch()
+        vec.reset()
+        self.assertRaises(ValueError, vec.step, np.zeros(3, dtype=np.uint8))
+        self.assertRaises(ValueError, vec.step, np.zeros((4, 3), dtype=np.uint8))
+
+
+class ShouldMatchSingleEmulator(TestCase):
+    def test(self):
+        vec = create_smb1_batch()
+        vec.reset()
+        emulator = NESEmulator(rom_file_abs_path('super-mario-bros-1.nes'))
+        emulator.reset()
+        rng = np.random.default_rng(0)
+        for _ in range(200):
+            actions = rng.integers(0, 256, size=4, dtype=np.uint8)
+            screens, ram = vec.step(actions)
+            emulator.controller(0)[:] = actions[2]
+            emulator.step()
+        self.assertTrue(np.array_equal(ram[2], emulator.memory_buffer()))
+        self.assertTrue(np.array_equal(screens[2], emulator.screen_buffer()))
+
+
+class ShouldStepAsynchronously(TestCase):
+    def test(self):
+        vec_async = create_smb1_batch()
+        vec_sync = create_smb1_batch()
+        vec_async.reset()
+        vec_sync.reset()
+        held = None
+        for frame in range(120):
+            actions = np.full(4, 8 if frame % 60 < 5 else 129, dtype=np.uint8)
+            vec_async.step_async(actions)
+            self.assertTrue(vec_async.is_stepping)
+            # the outputs of the last wait stay intact during the next step
+            if held is not None:
+                self.assertTrue(np.array_equal(held[1], views[1]))
+                self.assertTrue(np.array_equal(held[0], views[0]))
+            screens, ram = vec_sync.step(actions)
+            views = vec_async.wait()
+            self.assertFalse(vec_async.is_stepping)
+            self.assertTrue(np.array_equal(screens, views[0]))
+            self.assertTrue(np.array_equal(ram, views[1]))
+            held = (views[0].copy(), views[1].copy())
+
+
+class ShouldWriteToAnObservationBuffer(TestCase):
+    def test(self):
+        vec = create_smb1_batch()
+        reference = create_smb1_batch()
+        vec.reset()
+        reference.reset()
+        planar = np.zeros((4, 3, NESVecEmulator.height, NESVecEmulator.width), dtype=np.uint8)
+        self.assertRaises(ValueError, vec.set_observation_buffer, planar[:2])
+        self.assertRaises(ValueError, vec.set_observation_buffer, planar.transpose(0, 2, 3, 1))
+        vec.set_observation_buffer(planar, ObservationLayout.NCHW)
+        self.assertRaises(ValueError, vec.screen_buffer)
+        for frame in range(60):
+            actions = np.full(4, 8 if frame % 30 < 5 else 129, dtype=np.uint8)
+            observations, _ = vec.step(actions)
+            screens, _ = reference.step(actions)
+            self.assertTrue(np.shares_memory(planar, observations))
+            self.assertTrue(np.array_equal(screens.transpose(0, 3, 1, 2), planar))
+        # the observations export over DLPack without a copy
+        self.assertTrue(np.shares_memory(planar, np.from_dlpack(observations)))
+        vec.set_observation_buffer(None)
+        self.assertTrue(np.array_equal(reference.screen_buffer(), vec.screen_buffer()))
+
+
+class ShouldAlternateObservationBuffersOnAsyncSteps(TestCase):
+    def test(self):
+        vec = create_smb1_batch()
+        reference = create_smb1_batch()
+        vec.reset()
+        reference.reset()
+        buffers = np.zeros((2, 4, NESVecEmulator.height, NESVecEmulator.width, 3), dtype=np.uint8)
+        self.assertRaises(ValueError, vec.set_observation_buffer, None, back_buffer=buffers[1])
+        self.assertRaises(ValueError, vec.set_observation_buffer, buffers[0], back_buffer=buffers[0])
+        vec.set_observation_buffer(buffers[0], back_buffer=buffers[1])
+        held = None
+        for frame in range(60):
+            actions = np.full(4, 8 if frame % 30 < 5 else 129, dtype=np.uint8)
+            vec.step_async(actions)
+            # the buffer of the last wait stays intact during the next step
+            if held is not None:
+                self.assertTrue(np.array_equal(held, observations))
+            screens, _ = reference.step(actions)
+            observations, _ = vec.wait()
+            self.assertTrue(np.shares_memory(buffers[(frame + 1) % 2], observations))
+            self.assertTrue(np.array_equal(screens, observations))
+            held = observations.copy()
+
+
+class ShouldWriteStacksToAnObservationBuffer(TestCase):
+    def test(self):
+        config = NESObservationConfig(frames=3)
+        path = rom_file_abs_path('super-mario-bros-1.nes')
+        vec = NESVecEmulator(path, 2, 1, observation=config)
+        vec.reset()
+        interleaved = np.zeros((2, 84, 84, 3), dtype=np.uint8)
+        vec.set_observation_buffer(interleaved, ObservationLayout.NHWC)
+        for frame in range(30):
+            vec.step(np.full(2, 129, dtype=np.uint8))
+            self.assertTrue(np.array_equal(vec.frame_stacks().transpose(0, 2, 3, 1), interleaved))
+        self.assertEqual((2, 84, 84, 3), vec.observations().shape)
@@ -1,5 +1,6 @@
 """The setup script for installing and distributing the nes-py package."""
 import os
+import sys
 import subprocess
 from glob import glob
 from typing import List
@@ -71,6 +72,8 @@ def get_extension_modules() -> List[Pybind11Extension]:
             ],
             cxx_std=14,
             extra_compile_args=['-O3', '-Wall', '-Wextra', '-pedantic'],
+            # shm_open of the shared batches is in librt before glibc 2.34
+            libraries=['rt'] if sys.platform.startswith('linux') else [],
         ),
     ]
 